@@ -0,0 +1,30 @@
+// Minimal host stand-in for the Arduino core, for native unit tests
+#pragma once
+
+#include <cctype>
+#include <chrono>
+#include <cstdarg>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+inline bool psramInit() {
+	return false;
+}
+
+inline void * ps_malloc(size_t size) {
+	return malloc(size);
+}
+
+inline unsigned long millis() {
+	using namespace std::chrono;
+	return duration_cast<milliseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+inline unsigned long micros() {
+	using namespace std::chrono;
+	return duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+inline void debug_log(const char *format, ...) {}
@@ -0,0 +1,15 @@
+// Minimal host stand-in for the Arduino Stream class, for native unit tests
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+class Stream {
+	public:
+		virtual ~Stream() {}
+		virtual int available() = 0;
+		virtual int read() = 0;
+		virtual int peek() = 0;
+		virtual size_t write(uint8_t b) = 0;
+		virtual size_t readBytes(char * buffer, size_t length) = 0;
+};
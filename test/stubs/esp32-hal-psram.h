@@ -0,0 +1,4 @@
+// Minimal host stand-in for the Arduino PSRAM helpers, for native unit tests
+#pragma once
+
+#include "Arduino.h"
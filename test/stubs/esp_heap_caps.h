@@ -0,0 +1,16 @@
+// Minimal host stand-in for the ESP-IDF heap allocator, for native unit tests
+#pragma once
+
+#include <cstdint>
+#include <cstdlib>
+
+#define MALLOC_CAP_8BIT		0
+#define MALLOC_CAP_SPIRAM	0
+
+inline void * heap_caps_malloc(size_t size, uint32_t caps) {
+	return malloc(size);
+}
+
+inline void heap_caps_free(void * ptr) {
+	free(ptr);
+}
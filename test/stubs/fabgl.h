@@ -0,0 +1,146 @@
+// Minimal host stand-in for the vdp-gl sound and bitmap classes, for native unit tests
+#pragma once
+
+#include <cstdint>
+
+// FreeRTOS task calls used by the audio driver; the tests drive channels directly, so these do nothing
+typedef void * TaskHandle_t;
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+#define pdPASS				1
+#define pdTRUE				1
+#define portMAX_DELAY		0xFFFFFFFF
+#define pdMS_TO_TICKS(ms)	(ms)
+
+inline void xTaskNotifyGive(TaskHandle_t task) {}
+inline uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t ticks) {
+	return 0;
+}
+inline BaseType_t xTaskCreatePinnedToCore(void (*task)(void *), const char * name, uint32_t stack, void * parameters, int priority, TaskHandle_t * handle, int core) {
+	*handle = nullptr;
+	return pdPASS;
+}
+
+class WaveformGenerator {
+	public:
+		virtual ~WaveformGenerator() {}
+		virtual void setFrequency(int value) = 0;
+		virtual int getSample() = 0;
+		virtual void setSampleRate(int value) {
+			m_sampleRate = value;
+		}
+		int sampleRate() {
+			return m_sampleRate;
+		}
+		void setVolume(int value) {
+			m_volume = value;
+		}
+		int volume() {
+			return m_volume;
+		}
+		void enable(bool value) {
+			m_enabled = value;
+		}
+		bool enabled() {
+			return m_enabled;
+		}
+		int duration() {
+			return m_duration;
+		}
+		void setDuration(int value) {
+			m_duration = value;
+		}
+		void decDuration() {
+			if (m_duration > 0) {
+				m_duration--;
+			}
+		}
+	private:
+		int		m_sampleRate = 16384;
+		int		m_volume = 100;
+		int		m_duration = -1;
+		bool	m_enabled = false;
+};
+
+// Square wave, as vdp-gl generates it
+class SquareWaveformGenerator : public WaveformGenerator {
+	public:
+		void setFrequency(int value) {
+			m_frequency = value;
+			m_phaseInc = (((uint32_t)value * 256) << 11) / sampleRate();
+		}
+		void setDutyCycle(int value) {
+			m_dutyCycle = value;
+		}
+		int getSample() {
+			if (m_frequency == 0 || duration() == 0) {
+				if (m_lastSample > 0) {
+					--m_lastSample;
+				} else if (m_lastSample < 0) {
+					++m_lastSample;
+				} else {
+					m_phaseAcc = 0;
+				}
+				return m_lastSample;
+			}
+			int sample = ((m_phaseAcc >> 11) & 0xFF) <= m_dutyCycle ? 127 : -127;
+			m_phaseAcc = (m_phaseAcc + m_phaseInc) & 0x7FFFF;
+			sample = sample * volume() / 127;
+			m_lastSample = sample;
+			decDuration();
+			return sample;
+		}
+	private:
+		int			m_frequency = 0;
+		int			m_lastSample = 0;
+		uint32_t	m_phaseAcc = 0;
+		uint32_t	m_phaseInc = 0;
+		uint32_t	m_dutyCycle = 127;
+};
+
+class SawtoothWaveformGenerator : public SquareWaveformGenerator {};
+class SineWaveformGenerator : public SquareWaveformGenerator {};
+class TriangleWaveformGenerator : public SquareWaveformGenerator {};
+class NoiseWaveformGenerator : public SquareWaveformGenerator {};
+class VICNoiseGenerator : public SquareWaveformGenerator {};
+
+// Bitmaps only describe their pixel data here, as nothing is drawn
+enum class PixelFormat {
+	Undefined,
+	Native,
+	Mask,
+	RGBA2222,
+	RGBA8888,
+};
+
+struct Bitmap {
+	Bitmap() {}
+	Bitmap(int width, int height, void const * data, PixelFormat format, bool copy = false)
+		: width(width), height(height), format(format), data((uint8_t *)data) {}
+
+	int16_t		width = 0;
+	int16_t		height = 0;
+	PixelFormat	format = PixelFormat::Undefined;
+	uint8_t *	data = nullptr;
+};
+
+namespace fabgl {
+	class SoundGenerator {
+		public:
+			SoundGenerator(int sampleRate) {}
+			void attach(WaveformGenerator * generator) {}
+			void detach(WaveformGenerator * generator) {}
+			void clear() {}
+			bool play(bool value) {
+				return false;
+			}
+			void setVolume(int value) {
+				m_volume = value;
+			}
+			int volume() {
+				return m_volume;
+			}
+		private:
+			int		m_volume = 127;
+	};
+}
@@ -0,0 +1,15 @@
+// Minimal host stand-in for the esp-dsp matrix class, for native unit tests
+#pragma once
+
+namespace dspm {
+	class Mat {
+		public:
+			Mat(float * data, int rows, int cols) : data(data), rows(rows), cols(cols) {}
+			Mat inverse() {
+				return *this;
+			}
+			float * data;
+			int rows;
+			int cols;
+	};
+}
@@ -0,0 +1,132 @@
+// AudioSample decoding tests, checking buffered 16-bit and ADPCM decoding and seeking against a linear decode
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <vector>
+#include <unity.h>
+
+#include "agon_audio.h"
+
+// Decode the whole of the sample data in one pass, as the reference for every read
+static std::vector<int8_t> linearDecode(const std::vector<uint8_t> &data, uint8_t format) {
+	std::vector<int8_t> samples;
+	switch (format) {
+		case AUDIO_FORMAT_8BIT_SIGNED:
+		case AUDIO_FORMAT_8BIT_UNSIGNED:
+			for (auto byte : data) {
+				samples.push_back(byte ^ (format == AUDIO_FORMAT_8BIT_UNSIGNED ? 0x80 : 0));
+			}
+			break;
+		case AUDIO_FORMAT_16BIT_SIGNED:
+			for (size_t i = 0; i + 1 < data.size(); i += 2) {
+				int32_t sample = (int16_t)(data[i] | (data[i + 1] << 8));
+				samples.push_back(std::min(127, (int)floor(sample / 256.0 + 0.5)));
+			}
+			break;
+		case AUDIO_FORMAT_ADPCM: {
+			AdpcmState state;
+			for (auto byte : data) {
+				samples.push_back(decodeAdpcm(state, byte & 0x0F) >> 8);
+				samples.push_back(decodeAdpcm(state, byte >> 4) >> 8);
+			}
+		}	break;
+	}
+	return samples;
+}
+
+// Split the data into blocks of random sizes, including empty and odd-sized blocks
+static std::shared_ptr<AudioSample> makeSample(const std::vector<uint8_t> &data, uint8_t format) {
+	BufferVector blocks;
+	size_t offset = 0;
+	while (offset < data.size()) {
+		size_t size = std::min(data.size() - offset, (size_t)(rand() % 4 == 0 ? rand() % 4 : rand() % 700));
+		auto block = make_shared_psram<BufferStream>(size);
+		memcpy(block->getBuffer(), data.data() + offset, size);
+		blocks.push_back(block);
+		offset += size;
+	}
+	return std::make_shared<AudioSample>(blocks, format);
+}
+
+static std::vector<uint8_t> randomData(size_t size) {
+	std::vector<uint8_t> data(size);
+	for (auto &byte : data) {
+		byte = rand();
+	}
+	return data;
+}
+
+// Read from a range of seek positions, including either side of the ADPCM checkpoints and the end of the sample
+static void checkFormat(uint8_t format) {
+	for (auto trial = 0; trial < 50; trial++) {
+		auto data = randomData(rand() % 3000);
+		auto expected = linearDecode(data, format);
+		auto sample = makeSample(data, format);
+		TEST_ASSERT_EQUAL(expected.size(), sample->getSize());
+
+		AudioSamplePosition position;
+		int32_t repeatCount;
+		for (auto seek = 0; seek < 40; seek++) {
+			uint32_t start;
+			switch (seek % 4) {
+				case 0: start = rand() % (expected.size() + 1); break;
+				case 1: start = (rand() % 16) * ADPCM_SEEK_INTERVAL + rand() % 3; break;
+				case 2: start = (rand() % 16 + 1) * ADPCM_SEEK_INTERVAL - rand() % 3 - 1; break;
+				default: start = expected.size() - std::min(expected.size(), (size_t)(rand() % 40)); break;
+			}
+			sample->seekTo(start, position, repeatCount);
+			TEST_ASSERT_EQUAL((int32_t)(expected.size() - start), repeatCount);
+			for (uint32_t i = start; i < start + 600; i++) {
+				// reading past the end gives silence
+				int8_t value = i < expected.size() ? expected[i] : 0;
+				TEST_ASSERT_EQUAL(value, sample->getSample(position));
+			}
+		}
+	}
+}
+
+void test_8bit_signed() {
+	checkFormat(AUDIO_FORMAT_8BIT_SIGNED);
+}
+
+void test_8bit_unsigned() {
+	checkFormat(AUDIO_FORMAT_8BIT_UNSIGNED);
+}
+
+void test_16bit_signed() {
+	checkFormat(AUDIO_FORMAT_16BIT_SIGNED);
+}
+
+void test_adpcm() {
+	checkFormat(AUDIO_FORMAT_ADPCM);
+}
+
+// A full scale 16-bit sample rounds to the nearest 8-bit value, saturating at the top
+void test_16bit_rounding() {
+	const int16_t values[] = { 0, 127, 128, 255, -128, -129, -32768, 32767, 32639, 32640, -32640 };
+	const int8_t expected[] = { 0, 0, 1, 1, 0, -1, -128, 127, 127, 127, -127 };
+	std::vector<uint8_t> data;
+	for (auto value : values) {
+		data.push_back(value & 0xFF);
+		data.push_back((uint16_t)value >> 8);
+	}
+	auto sample = makeSample(data, AUDIO_FORMAT_16BIT_SIGNED);
+	AudioSamplePosition position;
+	int32_t repeatCount;
+	sample->seekTo(0, position, repeatCount);
+	for (auto value : expected) {
+		TEST_ASSERT_EQUAL(value, sample->getSample(position));
+	}
+}
+
+int main(int argc, char **argv) {
+	srand(1);
+	UNITY_BEGIN();
+	RUN_TEST(test_8bit_signed);
+	RUN_TEST(test_8bit_unsigned);
+	RUN_TEST(test_16bit_signed);
+	RUN_TEST(test_adpcm);
+	RUN_TEST(test_16bit_rounding);
+	return UNITY_END();
+}
@@ -0,0 +1,251 @@
+// Block waveform generator tests, checking volume scaling and ramps, note starts, and the oscillator shapes
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <unity.h>
+
+#include "agon_audio.h"
+
+#define SAMPLE_RATE		16384
+
+template <class Generator>
+static void setUp(Generator &generator, int frequency, int volume) {
+	generator.setSampleRate(SAMPLE_RATE);
+	generator.setFrequency(frequency);
+	generator.setVolume(volume);
+	generator.startNote();
+	generator.enable(true);
+}
+
+// At a steady volume every sample is scaled exactly as sample * volume / 127
+template <class Generator>
+static void checkSteadyVolume() {
+	for (auto volume = 0; volume <= 127; volume++) {
+		Generator generator, reference;
+		setUp(generator, 440 + volume * 7, volume);
+		setUp(reference, 440 + volume * 7, 127);
+		int8_t samples[WAVEFORM_RENDER_BLOCK];
+		for (auto block = 0; block < 8; block++) {
+			reference.render(samples, WAVEFORM_RENDER_BLOCK);
+			for (auto i = 0; i < WAVEFORM_RENDER_BLOCK; i++) {
+				TEST_ASSERT_EQUAL(samples[i] * volume / 127, generator.getSample());
+			}
+		}
+	}
+}
+
+void test_square_steady_volume() {
+	checkSteadyVolume<BlockSquareGenerator>();
+}
+
+void test_sine_steady_volume() {
+	checkSteadyVolume<BlockSineGenerator>();
+}
+
+void test_triangle_steady_volume() {
+	checkSteadyVolume<BlockTriangleGenerator>();
+}
+
+void test_sawtooth_steady_volume() {
+	checkSteadyVolume<BlockSawtoothGenerator>();
+}
+
+void test_noise_steady_volume() {
+	checkSteadyVolume<BlockNoiseGenerator>();
+}
+
+// A volume change is ramped across the next block, ending at the new volume
+void test_volume_ramp() {
+	BlockSquareGenerator generator;
+	generator.setDutyCycle(255);
+	setUp(generator, 440, 0);
+	for (auto i = 0; i < WAVEFORM_RENDER_BLOCK; i++) {
+		TEST_ASSERT_EQUAL(0, generator.getSample());
+	}
+	generator.setVolume(127);
+	int last = 0;
+	for (auto i = 0; i < WAVEFORM_RENDER_BLOCK; i++) {
+		auto sample = generator.getSample();
+		TEST_ASSERT_TRUE(sample > last);
+		last = sample;
+	}
+	TEST_ASSERT_EQUAL(127, last);
+}
+
+// Starting a note drops samples rendered for the last one, and doesn't ramp from its volume
+void test_start_note_drops_rendered_samples() {
+	BlockSawtoothGenerator generator, reference;
+	setUp(generator, 1000, 127);
+	setUp(reference, 1000, 127);
+	int8_t samples[WAVEFORM_RENDER_BLOCK];
+	reference.render(samples, WAVEFORM_RENDER_BLOCK);
+	for (auto i = 0; i < 5; i++) {
+		TEST_ASSERT_EQUAL(samples[i], generator.getSample());
+	}
+
+	generator.setVolume(50);
+	generator.startNote();
+	reference.render(samples, WAVEFORM_RENDER_BLOCK);
+	for (auto i = 0; i < WAVEFORM_RENDER_BLOCK; i++) {
+		TEST_ASSERT_EQUAL(samples[i] * 50 / 127, generator.getSample());
+	}
+}
+
+// A duration silences the generator after that many samples, and runs out once they have all been played
+void test_duration() {
+	BlockSawtoothGenerator generator, reference;
+	setUp(generator, 1000, 127);
+	setUp(reference, 1000, 127);
+	generator.setDuration(20);
+	int8_t samples[WAVEFORM_RENDER_BLOCK * 2];
+	reference.render(samples, WAVEFORM_RENDER_BLOCK * 2);
+	for (auto i = 0; i < 20; i++) {
+		TEST_ASSERT_TRUE(generator.duration() != 0);
+		TEST_ASSERT_EQUAL(samples[i], generator.getSample());
+	}
+	for (auto i = 0; i < 64; i++) {
+		TEST_ASSERT_EQUAL(0, generator.getSample());
+		TEST_ASSERT_EQUAL(0, generator.duration());
+	}
+}
+
+// Count the cycles of a waveform over a second, from its rising zero crossings
+template <class Generator>
+static int countCycles(Generator &generator) {
+	int8_t samples[SAMPLE_RATE];
+	generator.render(samples, SAMPLE_RATE);
+	int cycles = 0;
+	for (auto i = 1; i < SAMPLE_RATE; i++) {
+		cycles += samples[i - 1] < 0 && samples[i] >= 0;
+	}
+	return cycles;
+}
+
+template <class Generator>
+static void checkOscillator(int minimum, int maximum, int maxStep) {
+	const int frequencies[] = { 50, 440, 1000, 4000 };
+	for (auto frequency : frequencies) {
+		Generator generator;
+		setUp(generator, frequency, 127);
+		TEST_ASSERT_INT_WITHIN(1, frequency, countCycles(generator));
+	}
+
+	// a slow cycle covers the whole range, without jumps beyond those the shape has
+	Generator generator;
+	setUp(generator, 16, 127);
+	int8_t samples[1024];
+	generator.render(samples, 1024);
+	int low = 127, high = -128;
+	for (auto i = 0; i < 1024; i++) {
+		low = std::min<int>(low, samples[i]);
+		high = std::max<int>(high, samples[i]);
+		if (i > 0) {
+			TEST_ASSERT_TRUE(abs(samples[i] - samples[i - 1]) <= maxStep);
+		}
+	}
+	TEST_ASSERT_EQUAL(minimum, low);
+	TEST_ASSERT_EQUAL(maximum, high);
+}
+
+void test_square_oscillator() {
+	checkOscillator<BlockSquareGenerator>(-127, 127, 254);
+}
+
+void test_sine_oscillator() {
+	checkOscillator<BlockSineGenerator>(-127, 127, 4);
+}
+
+void test_triangle_oscillator() {
+	checkOscillator<BlockTriangleGenerator>(-127, 127, 2);
+}
+
+void test_sawtooth_oscillator() {
+	checkOscillator<BlockSawtoothGenerator>(-128, 127, 255);
+}
+
+// The duty cycle sets how much of each cycle is high
+void test_square_duty_cycle() {
+	for (auto duty : { 0, 31, 127, 200, 255 }) {
+		BlockSquareGenerator generator;
+		generator.setDutyCycle(duty);
+		setUp(generator, 16, 127);
+		int8_t samples[1024];
+		generator.render(samples, 1024);
+		int high = 0;
+		for (auto i = 0; i < 1024; i++) {
+			high += samples[i] > 0;
+		}
+		TEST_ASSERT_INT_WITHIN(4, (duty + 1) * 4, high);
+	}
+}
+
+// A frequency of zero is silent
+void test_zero_frequency() {
+	BlockSineGenerator generator;
+	setUp(generator, 0, 127);
+	for (auto i = 0; i < 64; i++) {
+		TEST_ASSERT_EQUAL(0, generator.getSample());
+	}
+}
+
+static volatile int sampleTotal;
+
+// Time a generator's samples as the sound generator asks for them, one at a time through its base class
+template <class Generator>
+static double timeSamples() {
+	using clock = std::chrono::steady_clock;
+	Generator generator;
+	setUp(generator, 440, 100);
+	WaveformGenerator * volatile source = &generator;
+	int total = 0;
+	double best = 1e9;
+	for (auto round = 0; round < 10; round++) {
+		auto begin = clock::now();
+		for (auto i = 0; i < SAMPLE_RATE * 16; i++) {
+			total += source->getSample();
+		}
+		best = std::min(best, std::chrono::duration<double, std::nano>(clock::now() - begin).count() / (SAMPLE_RATE * 16));
+	}
+	sampleTotal = total;
+	return best;
+}
+
+template <>
+void setUp(SquareWaveformGenerator &generator, int frequency, int volume) {
+	generator.setSampleRate(SAMPLE_RATE);
+	generator.setFrequency(frequency);
+	generator.setVolume(volume);
+	generator.enable(true);
+}
+
+// Compare the square generator's block loop with the vdp-gl generator, both wrapped and called directly
+void test_benchmark() {
+	auto block = timeSamples<BlockSquareGenerator>();
+	auto wrapped = timeSamples<BlockWaveformSource<SquareWaveformGenerator>>();
+	auto direct = timeSamples<SquareWaveformGenerator>();
+
+	char message[128];
+	snprintf(message, sizeof(message), "ns per sample: block %.2f, wrapped %.2f, vdp-gl direct %.2f", block, wrapped, direct);
+	TEST_MESSAGE(message);
+}
+
+int main(int argc, char **argv) {
+	UNITY_BEGIN();
+	RUN_TEST(test_square_steady_volume);
+	RUN_TEST(test_sine_steady_volume);
+	RUN_TEST(test_triangle_steady_volume);
+	RUN_TEST(test_sawtooth_steady_volume);
+	RUN_TEST(test_noise_steady_volume);
+	RUN_TEST(test_volume_ramp);
+	RUN_TEST(test_start_note_drops_rendered_samples);
+	RUN_TEST(test_duration);
+	RUN_TEST(test_square_oscillator);
+	RUN_TEST(test_sine_oscillator);
+	RUN_TEST(test_triangle_oscillator);
+	RUN_TEST(test_sawtooth_oscillator);
+	RUN_TEST(test_square_duty_cycle);
+	RUN_TEST(test_zero_frequency);
+	RUN_TEST(test_benchmark);
+	return UNITY_END();
+}
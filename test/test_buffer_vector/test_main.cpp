@@ -0,0 +1,192 @@
+// BufferVector offset index tests, and a buffer adjust benchmark against a linear scan of the blocks
+
+#include <chrono>
+#include <cstdio>
+#include <unity.h>
+
+#include "buffers.h"
+
+// Build a zeroed buffer of blockCount blocks, with sizes varying from 1 to 32 bytes
+static BufferVector makeBuffer(size_t blockCount) {
+	BufferVector buffer;
+	for (size_t i = 0; i < blockCount; i++) {
+		auto block = make_shared_psram<BufferStream>((i * 7) % 32 + 1);
+		memset(block->getBuffer(), 0, block->size());
+		buffer.push_back(block);
+	}
+	return buffer;
+}
+
+// Reference lookup, as done before the index was added
+static size_t linearFindBlock(const BufferVector &buffer, uint32_t position) {
+	size_t blockIndex = 0;
+	while (blockIndex < buffer.size() && position >= buffer[blockIndex]->size()) {
+		position -= buffer[blockIndex]->size();
+		blockIndex++;
+	}
+	return blockIndex;
+}
+
+static uint32_t linearTotalSize(const BufferVector &buffer) {
+	uint32_t total = 0;
+	for (const auto &block : buffer) {
+		total += block->size();
+	}
+	return total;
+}
+
+// Check the index against a fresh walk of the blocks
+static void checkIndex(const BufferVector &buffer) {
+	TEST_ASSERT_EQUAL_UINT32(linearTotalSize(buffer), buffer.totalSize());
+	uint32_t start = 0;
+	for (size_t i = 0; i < buffer.size(); i++) {
+		TEST_ASSERT_EQUAL_UINT32(start, buffer.blockStart(i));
+		start += buffer[i]->size();
+	}
+	TEST_ASSERT_EQUAL_UINT32(start, buffer.blockStart(buffer.size()));
+	for (uint32_t position = 0; position <= start; position++) {
+		TEST_ASSERT_EQUAL(linearFindBlock(buffer, position), buffer.findBlock(position));
+	}
+}
+
+void test_empty_buffer() {
+	BufferVector buffer;
+	TEST_ASSERT_EQUAL_UINT32(0, buffer.totalSize());
+	TEST_ASSERT_EQUAL(0, buffer.findBlock(0));
+	TEST_ASSERT_EQUAL(0, buffer.findBlock(100));
+}
+
+void test_push_back_extends_index() {
+	auto buffer = makeBuffer(10);
+	checkIndex(buffer);
+	buffer.push_back(make_shared_psram<BufferStream>(5));
+	checkIndex(buffer);
+}
+
+void test_empty_blocks_are_skipped() {
+	BufferVector buffer;
+	buffer.push_back(make_shared_psram<BufferStream>(4));
+	buffer.push_back(make_shared_psram<BufferStream>(0));
+	buffer.push_back(make_shared_psram<BufferStream>(0));
+	buffer.push_back(make_shared_psram<BufferStream>(4));
+	checkIndex(buffer);
+	TEST_ASSERT_EQUAL(3, buffer.findBlock(4));
+}
+
+void test_mutators_rebuild_index() {
+	auto buffer = makeBuffer(20);
+	checkIndex(buffer);
+
+	buffer.reverse();
+	checkIndex(buffer);
+
+	auto other = makeBuffer(5);
+	buffer.insert(buffer.begin() + 3, other.begin(), other.end());
+	checkIndex(buffer);
+
+	buffer.erase(buffer.begin() + 1, buffer.begin() + 8);
+	checkIndex(buffer);
+
+	buffer.swap(other);
+	checkIndex(buffer);
+	checkIndex(other);
+
+	buffer.assign(other.begin(), other.end());
+	checkIndex(buffer);
+
+	buffer.clear();
+	checkIndex(buffer);
+}
+
+// Reference span lookup, as getBufferSpan was before the index was added
+static tcb::span<uint8_t> linearGetBufferSpan(const BufferVector &buffer, AdvancedOffset &offset, uint8_t size = 1) {
+	while (offset.blockIndex < buffer.size()) {
+		auto &block = buffer[offset.blockIndex];
+		if ((offset.blockOffset + size) <= block->size()) {
+			return { block->getBuffer() + offset.blockOffset, block->size() - offset.blockOffset };
+		}
+		offset.blockOffset = std::max<int32_t>(0, offset.blockOffset - block->size());
+		offset.blockIndex++;
+	}
+	return {};
+}
+
+// A single byte adjust, as done by the buffer adjust command, reading and writing back at an offset from the buffer start
+static void indexedAdjust(const BufferVector &buffer, uint32_t position) {
+	AdvancedOffset offset;
+	offset.blockOffset = position;
+	auto value = getBufferByte(buffer, offset);
+	setBufferByte(value + 1, buffer, offset);
+}
+
+static void linearAdjust(const BufferVector &buffer, uint32_t position) {
+	AdvancedOffset offset;
+	offset.blockOffset = position;
+	auto value = linearGetBufferSpan(buffer, offset).front();
+	linearGetBufferSpan(buffer, offset).front() = value + 1;
+}
+
+// Time adjusts spread through the buffer, returning the best time per adjust over several rounds
+static double timeAdjusts(const BufferVector &buffer, void (*adjust)(const BufferVector &, uint32_t)) {
+	using clock = std::chrono::steady_clock;
+	const uint32_t adjusts = 4096;
+	const int rounds = 10;
+	auto total = buffer.totalSize();
+	double best = 0;
+	for (int r = 0; r < rounds; r++) {
+		auto begin = clock::now();
+		for (uint32_t i = 0; i < adjusts; i++) {
+			adjust(buffer, (uint64_t)i * total / adjusts);
+		}
+		auto time = std::chrono::duration<double, std::nano>(clock::now() - begin).count() / adjusts;
+		best = r == 0 ? time : std::min(best, time);
+	}
+	return best;
+}
+
+// Sum of every byte, to check both adjusts changed the same bytes
+static uint32_t checksum(const BufferVector &buffer) {
+	uint32_t sum = 0;
+	for (const auto &block : buffer) {
+		for (uint32_t i = 0; i < block->size(); i++) {
+			sum = sum * 31 + block->getBuffer()[i];
+		}
+	}
+	return sum;
+}
+
+static void benchmark(size_t blockCount) {
+	auto indexedBuffer = makeBuffer(blockCount);
+	auto linearBuffer = makeBuffer(blockCount);
+	auto indexed = timeAdjusts(indexedBuffer, indexedAdjust);
+	auto linear = timeAdjusts(linearBuffer, linearAdjust);
+	TEST_ASSERT_EQUAL_UINT32(checksum(linearBuffer), checksum(indexedBuffer));
+
+	char message[128];
+	snprintf(message, sizeof(message), "%zu blocks: indexed %.1f ns/adjust, linear %.1f ns/adjust", blockCount, indexed, linear);
+	TEST_MESSAGE(message);
+}
+
+void test_benchmark_1_block() {
+	benchmark(1);
+}
+
+void test_benchmark_64_blocks() {
+	benchmark(64);
+}
+
+void test_benchmark_4096_blocks() {
+	benchmark(4096);
+}
+
+int main(int argc, char **argv) {
+	UNITY_BEGIN();
+	RUN_TEST(test_empty_buffer);
+	RUN_TEST(test_push_back_extends_index);
+	RUN_TEST(test_empty_blocks_are_skipped);
+	RUN_TEST(test_mutators_rebuild_index);
+	RUN_TEST(test_benchmark_1_block);
+	RUN_TEST(test_benchmark_64_blocks);
+	RUN_TEST(test_benchmark_4096_blocks);
+	return UNITY_END();
+}
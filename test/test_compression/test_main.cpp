@@ -0,0 +1,232 @@
+// TurboVega compression tests, checking the hashed match finder against the linear window search it replaced
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include <Arduino.h>
+#include <unity.h>
+
+#include "compression.h"
+
+// The original compressor, which searched the whole window for each string size in turn
+class ReferenceCompressor {
+	public:
+		std::vector<uint8_t> compress(const std::vector<uint8_t> &input) {
+			for (auto byte : input) {
+				compressByte(byte);
+			}
+			while (string_size) {
+				writeCode(string_data[string_read_index++], 10);
+				string_size--;
+				string_read_index &= (COMPRESSION_STRING_SIZE - 1);
+			}
+			if (out_bits) {
+				output.push_back(out_byte << (8 - out_bits));
+			}
+			return output;
+		}
+
+	private:
+		void writeCode(uint32_t code, uint8_t code_bits) {
+			while (code_bits--) {
+				out_byte = (out_byte << 1) | ((code >> code_bits) & 1);
+				if (++out_bits == 8) {
+					output.push_back(out_byte);
+					out_byte = 0;
+					out_bits = 0;
+				}
+			}
+		}
+
+		bool findString(uint32_t size, uint32_t &match) {
+			if (window_size < size) {
+				return false;
+			}
+			for (uint32_t start = 0; start <= window_size - size; start++) {
+				uint32_t wi = start;
+				uint32_t si = string_read_index;
+				uint32_t i = 0;
+				while (i < size && window_data[wi] == string_data[si]) {
+					wi = (wi + 1) & (COMPRESSION_WINDOW_SIZE - 1);
+					si = (si + 1) & (COMPRESSION_STRING_SIZE - 1);
+					i++;
+				}
+				if (i == size) {
+					match = start;
+					return true;
+				}
+			}
+			return false;
+		}
+
+		void compressByte(uint8_t orig_byte) {
+			string_data[string_write_index++] = orig_byte;
+			string_write_index &= (COMPRESSION_STRING_SIZE - 1);
+			if (string_size < COMPRESSION_STRING_SIZE) {
+				string_size++;
+			} else {
+				string_read_index = (string_read_index + 1) & (COMPRESSION_STRING_SIZE - 1);
+			}
+			if (string_size < 16) {
+				return;
+			}
+
+			uint32_t start;
+			if (findString(16, start)) {
+				writeCode(0x300 | start, 10);
+				string_size = 0;
+				return;
+			}
+			for (uint32_t size = 8; size >= 4; size /= 2) {
+				if (findString(size, start)) {
+					writeCode((size == 8 ? 0x200 : 0x100) | start, 10);
+					string_size -= size;
+					string_read_index = (string_read_index + size) & (COMPRESSION_STRING_SIZE - 1);
+					return;
+				}
+			}
+
+			uint8_t old_byte = string_data[string_read_index++];
+			writeCode(old_byte, 10);
+			string_size--;
+			string_read_index &= (COMPRESSION_STRING_SIZE - 1);
+			window_data[window_write_index++] = old_byte;
+			window_write_index &= (COMPRESSION_WINDOW_SIZE - 1);
+			if (window_size < COMPRESSION_WINDOW_SIZE) {
+				window_size++;
+			}
+		}
+
+		std::vector<uint8_t> output;
+		uint32_t	window_size = 0;
+		uint32_t	window_write_index = 0;
+		uint32_t	string_size = 0;
+		uint32_t	string_read_index = 0;
+		uint32_t	string_write_index = 0;
+		uint8_t		window_data[COMPRESSION_WINDOW_SIZE] = {};
+		uint8_t		string_data[COMPRESSION_STRING_SIZE] = {};
+		uint8_t		out_byte = 0;
+		uint8_t		out_bits = 0;
+};
+
+static std::vector<uint8_t> compress(const std::vector<uint8_t> &input) {
+	std::vector<uint8_t> output(agon_max_compressed_size(input.size()));
+	auto p_temp = output.data();
+	CompressionData cd;
+	agon_init_compression(&cd, &p_temp, local_write_compressed_byte);
+	for (auto byte : input) {
+		agon_compress_byte(&cd, byte);
+	}
+	agon_finish_compression(&cd);
+	output.resize(cd.output_count);
+	return output;
+}
+
+static std::vector<uint8_t> decompress(const std::vector<uint8_t> &input, uint32_t orig_size) {
+	std::vector<uint8_t> output(orig_size);
+	auto p_temp = output.data();
+	DecompressionData dd;
+	agon_init_decompression(&dd, &p_temp, local_write_decompressed_byte, orig_size);
+	for (auto byte : input) {
+		agon_decompress_byte(&dd, byte);
+	}
+	output.resize(dd.output_count);
+	return output;
+}
+
+// Compress, check against the reference compressor, and check the data survives the round trip
+static void checkRoundTrip(const std::vector<uint8_t> &input) {
+	auto compressed = compress(input);
+	auto expected = ReferenceCompressor().compress(input);
+	TEST_ASSERT_EQUAL(expected.size(), compressed.size());
+	if (!expected.empty()) {
+		TEST_ASSERT_EQUAL_UINT8_ARRAY(expected.data(), compressed.data(), expected.size());
+	}
+
+	auto decompressed = decompress(compressed, input.size());
+	TEST_ASSERT_EQUAL(input.size(), decompressed.size());
+	if (!input.empty()) {
+		TEST_ASSERT_EQUAL_UINT8_ARRAY(input.data(), decompressed.data(), input.size());
+	}
+}
+
+static std::vector<uint8_t> randomData(size_t size, int range) {
+	std::vector<uint8_t> data(size);
+	for (auto &byte : data) {
+		byte = rand() % range;
+	}
+	return data;
+}
+
+// Sizes around the string length, and longer inputs that fill and wrap the window
+static const size_t sizes[] = { 0, 1, 3, 4, 15, 16, 17, 31, 255, 256, 257, 1000, 20000 };
+
+void test_random_data() {
+	for (auto size : sizes) {
+		checkRoundTrip(randomData(size, 256));
+	}
+}
+
+void test_low_entropy_data() {
+	for (auto size : sizes) {
+		checkRoundTrip(randomData(size, 2));
+		checkRoundTrip(randomData(size, 4));
+	}
+}
+
+void test_repeated_patterns() {
+	for (auto size : sizes) {
+		for (size_t period : { 1, 3, 4, 7, 8, 16, 100, 255, 256, 300 }) {
+			auto pattern = randomData(period, 256);
+			std::vector<uint8_t> data(size);
+			for (size_t i = 0; i < size; i++) {
+				data[i] = pattern[i % period];
+			}
+			checkRoundTrip(data);
+		}
+	}
+}
+
+void test_text_like_data() {
+	static const char * words[] = { "the ", "vdp ", "buffer ", "sample ", "sprite ", "agon ", "\r\n", "10 PRINT ", "GOTO 10" };
+	for (auto size : sizes) {
+		std::vector<uint8_t> data;
+		while (data.size() < size) {
+			auto word = words[rand() % (sizeof(words) / sizeof(words[0]))];
+			data.insert(data.end(), word, word + strlen(word));
+		}
+		data.resize(size);
+		checkRoundTrip(data);
+	}
+}
+
+// Time both compressors over the same low-entropy input
+void test_benchmark() {
+	using clock = std::chrono::steady_clock;
+	auto input = randomData(200000, 4);
+
+	auto begin = clock::now();
+	auto compressed = compress(input);
+	auto hashed = std::chrono::duration<double, std::milli>(clock::now() - begin).count();
+
+	begin = clock::now();
+	auto expected = ReferenceCompressor().compress(input);
+	auto linear = std::chrono::duration<double, std::milli>(clock::now() - begin).count();
+	TEST_ASSERT_EQUAL(expected.size(), compressed.size());
+
+	char message[128];
+	snprintf(message, sizeof(message), "%zu bytes: hashed %.1f ms, linear %.1f ms", input.size(), hashed, linear);
+	TEST_MESSAGE(message);
+}
+
+int main(int argc, char **argv) {
+	srand(1);
+	UNITY_BEGIN();
+	RUN_TEST(test_random_data);
+	RUN_TEST(test_low_entropy_data);
+	RUN_TEST(test_repeated_patterns);
+	RUN_TEST(test_text_like_data);
+	RUN_TEST(test_benchmark);
+	return UNITY_END();
+}
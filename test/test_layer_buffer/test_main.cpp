@@ -0,0 +1,240 @@
+// Tile layer buffer tests, checking incremental updates after scrolls and tile writes against full redraws
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include <Arduino.h>
+#include <unity.h>
+
+#include "tile_layers.h"
+
+// A tile bank, tile map and tile layer, with the storage they point into
+struct TestLayer {
+	TileBank bank;
+	TileMap map;
+	TileLayer layer;
+	std::vector<uint8_t> tileData;
+	std::vector<uint8_t> variantData;
+	std::vector<std::vector<Tile>> columns;
+	std::vector<Tile *> columnPointers;
+	std::vector<uint8_t> layerData;
+
+	TestLayer(int layerWidth, int layerHeight, int mapWidth, int mapHeight) :
+		tileData(TILEBANK_SIZE), variantData(TILEBANK_VARIANTS_SIZE), columns(mapWidth, std::vector<Tile>(mapHeight)),
+		layerData(((layerHeight + 1) * 8) * ((layerWidth + 1) * 8))
+	{
+		for (auto &pixel : tileData) {
+			pixel = rand();
+		}
+		bank.ptr = tileData.data();
+		bank.variants = variantData.data();
+		for (auto tileId = 0; tileId < 256; tileId++) {
+			updateTileVariants(bank, tileId);
+		}
+
+		for (auto &column : columns) {
+			for (auto &tile : column) {
+				tile = randomTile();
+			}
+			columnPointers.push_back(column.data());
+		}
+		map.tiles = columnPointers.data();
+		map.width = mapWidth;
+		map.height = mapHeight;
+
+		layer.width = layerWidth;
+		layer.height = layerHeight;
+		layer.sourceXPos = 0;
+		layer.sourceYPos = 0;
+		layer.xOffset = 0;
+		layer.yOffset = 0;
+		layer.ptr = layerData.data();
+		layer.initialised = true;
+	}
+
+	// Tile 0 is transparent, so give it a fair share
+	static Tile randomTile() {
+		return { (uint8_t)(rand() % 4 == 0 ? 0 : rand() % 256), (uint8_t)(rand() % 4) };
+	}
+
+	// Scroll to a tile map pixel position, as vdu_sys_layers_tilelayer_set_scroll would
+	void scrollTo(int x, int y) {
+		layer.sourceXPos = x / 8;
+		layer.sourceYPos = y / 8;
+		layer.xOffset = x % 8;
+		layer.yOffset = y % 8;
+	}
+
+	void setTile(int x, int y, Tile tile) {
+		map.tiles[x][y] = tile;
+		markTileDirty(layer, map, x, y);
+	}
+
+	int pixelWidth() {
+		return layer.width * 8;
+	}
+
+	int pixelHeight() {
+		return layer.height * 8;
+	}
+};
+
+// Render the whole layer buffer from scratch into a copy of the layer
+static std::vector<uint8_t> fullRedraw(TestLayer &test) {
+	std::vector<uint8_t> data(test.layerData.size());
+	TileLayer layer = test.layer;
+	layer.ptr = data.data();
+	layer.rendered = false;
+	auto dirtyTiles = test.map.dirtyTiles;
+	updateLayerBuffer(layer, test.map, test.bank);
+	test.map.dirtyTiles = dirtyTiles;
+	return data;
+}
+
+static void checkMatchesFullRedraw(TestLayer &test) {
+	auto expected = fullRedraw(test);
+	TEST_ASSERT_EQUAL_UINT8_ARRAY(expected.data(), test.layerData.data(), test.pixelWidth() * test.pixelHeight());
+}
+
+// Layer sizes from vdu_sys_layers_tilelayer_init, over tile maps both smaller and larger than them
+static const int layerSizes[][2] = { { 80, 60 }, { 80, 30 }, { 40, 30 }, { 40, 25 } };
+static const int mapSizes[][2] = { { 32, 32 }, { 32, 128 }, { 128, 32 }, { 64, 64 }, { 128, 128 } };
+
+// A full redraw puts the right pixel of the right tile variant everywhere, wrapping around the tile map
+void test_full_redraw() {
+	for (auto &layerSize : layerSizes) {
+		for (auto &mapSize : mapSizes) {
+			TestLayer test(layerSize[0], layerSize[1], mapSize[0], mapSize[1]);
+			int mapPixelWidth = mapSize[0] * 8;
+			int mapPixelHeight = mapSize[1] * 8;
+			int originX = rand() % mapPixelWidth;
+			int originY = rand() % mapPixelHeight;
+			test.scrollTo(originX, originY);
+			updateLayerBuffer(test.layer, test.map, test.bank);
+
+			for (auto y = 0; y < test.pixelHeight(); y++) {
+				for (auto x = 0; x < test.pixelWidth(); x++) {
+					int mapX = (originX + x) % mapPixelWidth;
+					int mapY = (originY + y) % mapPixelHeight;
+					auto &tile = test.map.tiles[mapX / 8][mapY / 8];
+					int tileX = tile.attribute & 0x01 ? 7 - mapX % 8 : mapX % 8;
+					int tileY = tile.attribute & 0x02 ? 7 - mapY % 8 : mapY % 8;
+					uint8_t expected = tile.id == 0 ? 0 : test.tileData[(tile.id * 64) + (tileY * 8) + tileX];
+					TEST_ASSERT_EQUAL_UINT8(expected, test.layerData[(y * test.pixelWidth()) + x]);
+				}
+			}
+		}
+	}
+}
+
+// Apply random scrolls and tile writes, checking the buffer after each update
+static void checkRandomUpdates(int maxStep, int maxTiles) {
+	for (auto &layerSize : layerSizes) {
+		for (auto &mapSize : mapSizes) {
+			TestLayer test(layerSize[0], layerSize[1], mapSize[0], mapSize[1]);
+			int mapPixelWidth = mapSize[0] * 8;
+			int mapPixelHeight = mapSize[1] * 8;
+			int x = 0, y = 0;
+
+			for (auto update = 0; update < 100; update++) {
+				if (rand() % 8 == 0) {
+					// an occasional jump anywhere
+					x = rand() % mapPixelWidth;
+					y = rand() % mapPixelHeight;
+				} else {
+					x = (x + rand() % (maxStep * 2 + 1) - maxStep + mapPixelWidth) % mapPixelWidth;
+					y = (y + rand() % (maxStep * 2 + 1) - maxStep + mapPixelHeight) % mapPixelHeight;
+				}
+				test.scrollTo(x, y);
+
+				auto tiles = rand() % (maxTiles + 1);
+				for (auto n = 0; n < tiles; n++) {
+					test.setTile(rand() % mapSize[0], rand() % mapSize[1], TestLayer::randomTile());
+				}
+
+				updateLayerBuffer(test.layer, test.map, test.bank);
+				TEST_ASSERT_TRUE(test.layer.rendered);
+				TEST_ASSERT_EQUAL(0, test.map.dirtyTiles.size());
+				checkMatchesFullRedraw(test);
+			}
+		}
+	}
+}
+
+void test_small_scrolls() {
+	checkRandomUpdates(3, 0);
+}
+
+void test_large_scrolls() {
+	checkRandomUpdates(400, 0);
+}
+
+void test_tile_writes() {
+	checkRandomUpdates(0, 20);
+}
+
+void test_scrolls_and_tile_writes() {
+	checkRandomUpdates(12, 20);
+}
+
+// Enough tile writes to give up on tracking them, and redraw the whole layer
+void test_many_tile_writes() {
+	checkRandomUpdates(12, 5000);
+}
+
+// A scroll position past the end of the tile map is shown from its start
+void test_out_of_range_scroll() {
+	TestLayer test(40, 25, 32, 32);
+	updateLayerBuffer(test.layer, test.map, test.bank);
+	test.scrollTo(8 * 10 + 3, 8 * 5 + 6);
+	updateLayerBuffer(test.layer, test.map, test.bank);
+	test.layer.sourceXPos = 200;
+	test.setTile(3, 4, TestLayer::randomTile());
+	updateLayerBuffer(test.layer, test.map, test.bank);
+	checkMatchesFullRedraw(test);
+	TEST_ASSERT_EQUAL(3, test.layer.renderedX);
+}
+
+// Time scrolling a pixel at a time with a few tile changes, updated incrementally and redrawn in full
+void test_benchmark() {
+	using clock = std::chrono::steady_clock;
+	TestLayer test(80, 60, 128, 128);
+	const int frames = 200;
+
+	auto begin = clock::now();
+	for (auto frame = 0; frame < frames; frame++) {
+		test.scrollTo(frame, frame / 2);
+		for (auto n = 0; n < 4; n++) {
+			test.setTile(rand() % 128, rand() % 128, TestLayer::randomTile());
+		}
+		updateLayerBuffer(test.layer, test.map, test.bank);
+	}
+	auto incremental = std::chrono::duration<double, std::micro>(clock::now() - begin).count() / frames;
+
+	begin = clock::now();
+	for (auto frame = 0; frame < frames; frame++) {
+		test.scrollTo(frame, frame / 2);
+		test.layer.rendered = false;
+		updateLayerBuffer(test.layer, test.map, test.bank);
+	}
+	auto full = std::chrono::duration<double, std::micro>(clock::now() - begin).count() / frames;
+
+	char message[128];
+	snprintf(message, sizeof(message), "640x480 layer, us per frame: incremental %.1f, full redraw %.1f", incremental, full);
+	TEST_MESSAGE(message);
+}
+
+int main(int argc, char **argv) {
+	srand(1);
+	UNITY_BEGIN();
+	RUN_TEST(test_full_redraw);
+	RUN_TEST(test_small_scrolls);
+	RUN_TEST(test_large_scrolls);
+	RUN_TEST(test_tile_writes);
+	RUN_TEST(test_scrolls_and_tile_writes);
+	RUN_TEST(test_many_tile_writes);
+	RUN_TEST(test_out_of_range_scroll);
+	RUN_TEST(test_benchmark);
+	return UNITY_END();
+}
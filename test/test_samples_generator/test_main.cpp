@@ -0,0 +1,170 @@
+// EnhancedSamplesGenerator tests, checking the 32.32 fixed point phase against the double precision playback it replaced
+//
+// The two don't stay within 1 LSB across loop points. Looping drops the fractional phase, so the smallest
+// difference in step (the fixed point step is truncated to 32.32) can make a loop happen one output sample
+// earlier or later, after which the outputs are shifted by a sample. Interpolating past a loop point can
+// also overshoot 8 bits, which the block renderer now clamps.
+// So the unmodified double code is only compared up to the first loop point, and playback across loops is
+// compared against a reference using the same truncated step and clamping.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <unity.h>
+
+#include "agon_audio.h"
+
+// The double precision sample generator, as it was before the fixed point phase accumulator
+// Unless exact is set, it uses the truncated fixed point step and clamps to 8 bits
+class ReferenceGenerator {
+	public:
+		ReferenceGenerator(std::shared_ptr<AudioSample> sample, int sampleRate, bool exact) : _sample(sample), _sampleRate(sampleRate), _exact(exact) {}
+
+		void setFrequency(int value) {
+			auto baseFrequency = _sample->baseFrequency;
+			auto frequencyAdjust = baseFrequency > 0 ? (double)value / (double)baseFrequency : 1.0;
+			samplesPerGet = frequencyAdjust * ((double)_sample->sampleRate / (double)_sampleRate);
+			if (!_exact) {
+				samplesPerGet = floor(samplesPerGet * SAMPLE_PHASE_ONE) / SAMPLE_PHASE_ONE;
+			}
+		}
+
+		void seekTo(uint32_t offset) {
+			_sample->seekTo(offset, position, repeatCount);
+			fractionalSampleOffset = 0.0;
+			previousSample = _sample->getSample(position);
+			currentSample = _sample->getSample(position);
+		}
+
+		int getSample(int volume) {
+			while (fractionalSampleOffset >= 1.0) {
+				previousSample = currentSample;
+				currentSample = getNextSample();
+				fractionalSampleOffset = fractionalSampleOffset - 1.0;
+			}
+			int sample = currentSample * fractionalSampleOffset + previousSample * (1.0 - fractionalSampleOffset);
+			if (!_exact) {
+				sample = std::max(-128, std::min(127, sample));
+			}
+			fractionalSampleOffset = fractionalSampleOffset + samplesPerGet;
+			return sample * volume / 127;
+		}
+
+		// Whether a loop point has been reached, or is close enough that the generator may have reached it
+		bool nearLoop() {
+			return looped || (repeatCount > 0 && repeatCount <= samplesPerGet + 2);
+		}
+
+	private:
+		int8_t getNextSample() {
+			auto sample = _sample->getSample(position);
+			repeatCount--;
+			if (repeatCount == 0) {
+				looped = true;
+				seekTo(_sample->repeatStart);
+			}
+			return sample;
+		}
+
+		std::shared_ptr<AudioSample> _sample;
+		int					_sampleRate;
+		bool				_exact;
+		bool				looped = false;
+		AudioSamplePosition	position;
+		int32_t				repeatCount = 0;
+		int					previousSample = 0;
+		int					currentSample = 0;
+		double				samplesPerGet = 1.0;
+		double				fractionalSampleOffset = 0.0;
+};
+
+// A sample of random blocks, or of a slow sine sweep
+static std::shared_ptr<AudioSample> makeSample(bool random, uint8_t format, uint32_t sampleRate, uint16_t baseFrequency) {
+	BufferVector blocks;
+	auto blockCount = rand() % 4 + 1;
+	uint32_t n = 0;
+	for (auto b = 0; b < blockCount; b++) {
+		auto block = make_shared_psram<BufferStream>(rand() % 2000 + 16);
+		auto data = block->getBuffer();
+		for (uint32_t i = 0; i < block->size(); i++, n++) {
+			data[i] = random ? rand() : (uint8_t)(int8_t)(sin(n * 0.05) * 120) ^ (format == AUDIO_FORMAT_8BIT_UNSIGNED ? 0x80 : 0);
+		}
+		blocks.push_back(block);
+	}
+	return std::make_shared<AudioSample>(blocks, format, sampleRate, baseFrequency);
+}
+
+// Play a sample at a range of pitches, checking every output sample against the reference
+// An exact reference is only compared until it nears its first loop point
+static void comparePitches(bool random, bool repeat, bool exact) {
+	const int outputRates[] = { 16384, 44100 };
+	int maxDifference = 0;
+	for (auto trial = 0; trial < 40; trial++) {
+		auto format = (uint8_t)(rand() % 2);
+		auto sample = makeSample(random, format, (rand() % 4 + 1) * 8000, rand() % 2 ? 0 : 440);
+		if (repeat) {
+			auto size = sample->getSize();
+			sample->repeatStart = rand() % size;
+			sample->repeatLength = rand() % 3 == 0 ? -1 : rand() % (size - sample->repeatStart) + 1;
+		}
+		auto outputRate = outputRates[trial % 2];
+		auto frequency = 20 + (trial * 997) % 4000;
+		auto volume = rand() % 128;
+
+		EnhancedSamplesGenerator generator(sample);
+		generator.setSampleRate(outputRate);
+		generator.setFrequency(frequency);
+		generator.setVolume(volume);
+		generator.seekTo(0);
+
+		ReferenceGenerator reference(sample, outputRate, exact);
+		reference.setFrequency(frequency);
+		reference.seekTo(0);
+
+		for (auto i = 0; i < 20000 && !(exact && reference.nearLoop()); i++) {
+			auto expected = reference.getSample(volume);
+			auto actual = generator.getSample();
+			maxDifference = std::max(maxDifference, abs(expected - actual));
+			TEST_ASSERT_INT_WITHIN(1, expected, actual);
+		}
+	}
+	char message[64];
+	snprintf(message, sizeof(message), "largest difference %d", maxDifference);
+	TEST_MESSAGE(message);
+}
+
+void test_random_sample_pitches() {
+	comparePitches(true, false, false);
+}
+
+void test_structured_sample_pitches() {
+	comparePitches(false, false, false);
+}
+
+void test_repeating_sample_pitches() {
+	comparePitches(false, true, false);
+}
+
+void test_random_sample_pitches_exact() {
+	comparePitches(true, false, true);
+}
+
+void test_structured_sample_pitches_exact() {
+	comparePitches(false, false, true);
+}
+
+void test_repeating_sample_pitches_exact() {
+	comparePitches(false, true, true);
+}
+
+int main(int argc, char **argv) {
+	srand(1);
+	UNITY_BEGIN();
+	RUN_TEST(test_random_sample_pitches);
+	RUN_TEST(test_structured_sample_pitches);
+	RUN_TEST(test_repeating_sample_pitches);
+	RUN_TEST(test_random_sample_pitches_exact);
+	RUN_TEST(test_structured_sample_pitches_exact);
+	RUN_TEST(test_repeating_sample_pitches_exact);
+	return UNITY_END();
+}
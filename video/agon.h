@@ -18,6 +18,8 @@
 #define EPOCH_YEAR				1980	// 1-byte dates are offset from this (for FatFS)
 #define MAX_SPRITES				256		// Maximum number of sprites
 #define MAX_BITMAPS				256		// Maximum number of bitmaps
+#define MAX_TILE_BANKS			4		// Maximum number of tile banks
+#define MAX_TILE_LAYERS			4		// Maximum number of tile layers, each with its own tile map
 
 // #define VDP_USE_WDT						// Use the esp watchdog timer (experimental)
 
@@ -33,6 +35,8 @@
 
 #define UART_RX_SIZE			256		// The RX buffer size
 #define UART_RX_THRESH			128		// Point at which RTS is toggled
+#define INPUT_RING_SIZE			256		// Stream processor input ring size (must be a power of 2)
+#define INPUT_RING_MASK			(INPUT_RING_SIZE - 1)
 
 #define GPIO_ITRP				17		// VSync Interrupt Pin - for reference only
 
@@ -107,6 +111,7 @@
 #define MAX_AUDIO_CHANNELS		32		// Maximum number of audio channels
 #define AUDIO_CHANNEL_PRIORITY	3		// Sound driver task priority with 3 (configMAX_PRIORITIES - 1) being the highest, and 0 being the lowest
 #define AUDIO_CORE				0		// Core to run audio tasks on
+#define AUDIO_COMMAND_QUEUE_SIZE	64	// Commands that can wait for the audio task (must be a power of two)
 
 // Audio command definitions
 //
@@ -151,6 +156,8 @@
 
 #define AUDIO_FORMAT_8BIT_SIGNED	0	// 8-bit signed sample
 #define AUDIO_FORMAT_8BIT_UNSIGNED	1	// 8-bit unsigned sample
+#define AUDIO_FORMAT_16BIT_SIGNED	2	// 16-bit signed little-endian sample, played back as 8-bit
+#define AUDIO_FORMAT_ADPCM			3	// 4-bit IMA ADPCM sample, low nibble first, with no block headers
 #define AUDIO_FORMAT_DATA_MASK		7	// data bit mask for format
 #define AUDIO_FORMAT_WITH_RATE		8	// OR this with the format to indicate a sample rate follows
 #define AUDIO_FORMAT_TUNEABLE		16	// OR this with the format to indicate sample can be tuned (frequency adjustable)
@@ -278,6 +285,7 @@
 #define BUFFERED_READ_FLAG				0x30	// Read flag value into a buffer
 #define BUFFERED_COMPRESS				0x40	// Compress blocks from multiple buffers into one buffer
 #define BUFFERED_DECOMPRESS				0x41	// Decompress blocks from multiple buffers into one buffer
+#define BUFFERED_COMPRESS_FORMAT		0x42	// Compress blocks from multiple buffers into one buffer using a given format
 #define BUFFERED_EXPAND_BITMAP			0x48	// Expand a bitmap buffer
 #define BUFFERED_ADD_CALLBACK			0x50	// Add a callback
 #define BUFFERED_REMOVE_CALLBACK		0x51	// Remove a callback
@@ -390,6 +398,7 @@
 #define TRANSFORM_BITMAP_RESIZE		0x01	// Resize
 #define TRANSFORM_BITMAP_EXPLICIT_SIZE	0x02	// Use an explicit size (width and height)
 #define TRANSFORM_BITMAP_TRANSLATE	0x04	// Translate
+#define TRANSFORM_BITMAP_BILINEAR	0x08	// Bilinear filtering (RGBA2222 and RGBA8888 sources only)
 
 // Transform data flags
 #define TRANSFORM_DATA_HAS_SIZE		0x01	// Explicit size set (otherwise size = rows - 1)
@@ -409,6 +418,16 @@
 #define BUFFERED_BITMAP_BASEID	0xFA00	// Base ID for buffered bitmaps
 #define BUFFERED_SAMPLE_BASEID	0xFB00	// Base ID for buffered samples
 
+// Sprite batch update record flags
+#define SPRITE_UPDATE_MOVE		0x01	// Move sprite to x,y
+#define SPRITE_UPDATE_MOVE_BY	0x02	// Move sprite by x,y (takes precedence over move)
+#define SPRITE_UPDATE_FRAME		0x04	// Set current frame
+#define SPRITE_UPDATE_SHOW		0x08	// Show sprite
+#define SPRITE_UPDATE_HIDE		0x10	// Hide sprite (takes precedence over show)
+
+// Buffered command cache
+#define COMMAND_CACHE_MAX_COMMANDS	1024	// Maximum number of commands recorded for a single buffer call
+
 // Copper commands
 #define COPPER_CREATE_PALETTE		0		// Create a palette
 #define COPPER_DELETE_PALLETE		1		// Delete a palette
@@ -448,6 +467,7 @@
 #define FEATUREFLAG_CONTEXT_ID	0x0230	// Current active context ID
 #define FEATUREFLAG_TILE_ENGINE	0x0300	// Tile engine flag (layers commands)
 #define FEATUREFLAG_COPPER		0x0310	// Copper feature flag
+#define FEATUREFLAG_COMMAND_CACHE	0x0320	// Buffered command decode cache flag
 #define FEATURE_FLAG_AUTO_HW_SPRITES	0x0400	// Auto hardware sprites flag
 #define FEATUREFLAG_VDU_VARIABLES_START	0x1000	// VDU variables start at 0x1000
 #define FEATUREFLAG_VDU_VARIABLES_END	0x1FFF	// VDU variables end
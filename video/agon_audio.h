@@ -10,6 +10,7 @@
 #ifndef AGON_AUDIO_H
 #define AGON_AUDIO_H
 
+#include <algorithm>
 #include <memory>
 #include <vector>
 #include <unordered_map>
@@ -25,7 +26,10 @@ std::mutex soundGeneratorMutex;
 
 // audio channels and their associated tasks
 AudioChannel *audioChannels[MAX_AUDIO_CHANNELS];
-TaskHandle_t audioTask;
+TaskHandle_t audioTask = nullptr;
+// Commands from the VDU processor, which are applied by the audio task
+SPSCQueue<AudioCommand, AUDIO_COMMAND_QUEUE_SIZE> audioCommands;
+uint8_t soundGeneratorVolume;		// master volume, as last set by the VDU processor
 // Storage for our sample data
 std::unordered_map<uint16_t, std::shared_ptr<AudioSample>,
 	std::hash<uint16_t>, std::equal_to<uint16_t>,
@@ -33,24 +37,89 @@ std::unordered_map<uint16_t, std::shared_ptr<AudioSample>,
 fabgl::SoundGenerator *soundGenerator;  // audio handling sub-system
 
 bool channelEnabled(uint8_t channel);
+void rebuildSoundGenerator(uint16_t sampleRate);
+
+// Queue a command for the audio task
+// Never waits - if the queue is full the command is dropped, and any waveform or envelope it carries is freed
+//
+bool queueAudioCommand(const AudioCommand & command) {
+	if (!audioCommands.push(command)) {
+		debug_log("queueAudioCommand: queue full, dropped command %d for channel %d (%d overflows)\n\r", (int)command.type, command.channel, audioCommands.overflows());
+		switch (command.type) {
+			case AudioCommandType::Waveform:
+				delete (BlockWaveformGenerator *)command.object;
+				break;
+			case AudioCommandType::VolumeEnvelope:
+				delete (VolumeEnvelope *)command.object;
+				break;
+			case AudioCommandType::FrequencyEnvelope:
+				delete (FrequencyEnvelope *)command.object;
+				break;
+		}
+		return false;
+	}
+	if (audioTask) {
+		xTaskNotifyGive(audioTask);
+	}
+	return true;
+}
+
+// Apply a queued command on the audio task
+//
+void applyAudioCommand(const AudioCommand & command, uint64_t now) {
+	switch (command.type) {
+		case AudioCommandType::GeneratorSampleRate:
+			rebuildSoundGenerator(command.value);
+			soundGenerator->setVolume(command.volume);
+			break;
+		case AudioCommandType::GeneratorVolume:
+			soundGenerator->setVolume(command.volume);
+			break;
+		default:
+			if (channelEnabled(command.channel)) {
+				audioChannels[command.channel]->apply(command, now);
+			}
+			break;
+	}
+}
 
 // Audio channel driver task
+// Applies queued commands, then sleeps until the earliest time a channel needs updating, or until another command arrives
 //
 void audioDriver(void * parameters) {
+	uint64_t deadlines[MAX_AUDIO_CHANNELS] = {};
+	bool notified = true;		// update every channel on the first pass
+
 	while (true) {
 		auto now = millis();
+		AudioCommand command;
+		while (audioCommands.pop(command)) {
+			applyAudioCommand(command, now);
+		}
+
+		uint64_t nextDeadline = AUDIO_NO_DEADLINE;
 		for (int i=0; i<MAX_AUDIO_CHANNELS; i++) {
 			if (audioChannels[i]) {
-				audioChannels[i]->loop(now);
+				// a command may have been for any channel, so update them all when notified
+				if (notified || deadlines[i] <= now) {
+					deadlines[i] = audioChannels[i]->loop(now);
+				}
+				nextDeadline = std::min(nextDeadline, deadlines[i]);
 			}
 		}
-		vTaskDelay(pdMS_TO_TICKS(1));
+
+		TickType_t wait = portMAX_DELAY;
+		if (nextDeadline != AUDIO_NO_DEADLINE) {
+			now = millis();
+			wait = nextDeadline > now ? std::max<TickType_t>(1, pdMS_TO_TICKS(nextDeadline - now)) : 0;
+		}
+		notified = ulTaskNotifyTake(pdTRUE, wait) > 0;
 	}
 }
 
 BaseType_t initAudioTask() {
 	return xTaskCreatePinnedToCore(audioDriver, "audioDriver",
-		2048,
+		4096,						// Stack size, allowing for the sound generator to be rebuilt on this task
 		nullptr,
 		AUDIO_CHANNEL_PRIORITY,		// Priority, with 3 (configMAX_PRIORITIES - 1) being the highest, and 0 being the lowest.
 		&audioTask,
@@ -60,19 +129,18 @@ BaseType_t initAudioTask() {
 
 BaseType_t initAudioChannel(int channel) {
 	if (!channelEnabled(channel)) {
+		// the channel must be visible to the audio task before anything is queued for it
 		audioChannels[channel] = new AudioChannel(channel);
+		audioChannels[channel]->setWaveform(AUDIO_WAVE_DEFAULT);
 		return pdPASS;
 	}
 	return 0;
 }
 
-// Change the sample rate
+// Make a new sound generator and re-attach all our active channels
+// Only called by the audio task, other than during initialisation
 //
-void setSampleRate(uint16_t sampleRate) {
-	// make a new sound generator and re-attach all our active channels
-	if (sampleRate == 65535) {
-		sampleRate = AUDIO_DEFAULT_SAMPLE_RATE;
-	}
+void rebuildSoundGenerator(uint16_t sampleRate) {
 	{
 		// detach the old sound generator
 		auto lock = std::unique_lock<std::mutex>(soundGeneratorMutex);
@@ -85,20 +153,31 @@ void setSampleRate(uint16_t sampleRate) {
 	}
 	for (int chan=0; chan<MAX_AUDIO_CHANNELS; chan++) {
 		if (audioChannels[chan]) {
-			auto lock = audioChannels[chan]->lock();
 			audioChannels[chan]->attachSoundGenerator();
 		}
 	}
 	soundGenerator->play(true);
 }
 
+// Change the sample rate
+// The audio task rebuilds the sound generator, keeping the current master volume
+//
+void setSampleRate(uint16_t sampleRate) {
+	if (sampleRate == 65535) {
+		sampleRate = AUDIO_DEFAULT_SAMPLE_RATE;
+	}
+	queueAudioCommand({ AudioCommandType::GeneratorSampleRate, 255, soundGeneratorVolume, 0, sampleRate });
+}
+
 // Initialise the sound driver
 //
 void initAudio() {
 	for (int i=0; i<MAX_AUDIO_CHANNELS; i++) {
 		audioChannels[i] = nullptr;
 	}
-	setSampleRate(AUDIO_DEFAULT_SAMPLE_RATE);
+	// the audio task isn't running yet, so the sound generator can be made here
+	rebuildSoundGenerator(AUDIO_DEFAULT_SAMPLE_RATE);
+	soundGeneratorVolume = soundGenerator->volume();
 	for (uint8_t i = 0; i < AUDIO_CHANNELS; i++) {
 		initAudioChannel(i);
 	}
@@ -133,11 +212,13 @@ uint8_t getChannelStatus(uint8_t channel) {
 //
 uint8_t setVolume(uint8_t channel, uint8_t volume) {
 	if (channel == 255) {
-		if (volume == 255) {
-			return soundGenerator->volume();
+		if (volume != 255) {
+			volume = volume < 128 ? volume : 127;
+			if (queueAudioCommand({ AudioCommandType::GeneratorVolume, 255, volume })) {
+				soundGeneratorVolume = volume;
+			}
 		}
-		soundGenerator->setVolume(volume < 128 ? volume : 127);
-		return soundGenerator->volume();
+		return soundGeneratorVolume;
 	} else if (channelEnabled(channel)) {
 		return audioChannels[channel]->setVolume(volume);
 	}
@@ -214,8 +295,7 @@ uint8_t enableChannel(uint8_t channel) {
 //
 uint8_t disableChannel(uint8_t channel) {
 	if (channelEnabled(channel)) {
-		audioChannels[channel]->goIdle();
-		return 1;
+		return audioChannels[channel]->goIdle();
 	}
 	return 0;
 }
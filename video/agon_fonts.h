@@ -35,12 +35,15 @@
 
 #pragma once
 
+#include <algorithm>
 #include <memory>
 #include <unordered_map>
+#include <vector>
 
 #include <fabgl.h>
 
 #include "agon.h"
+#include "agon_screen.h"
 #include "buffers.h"
 #include "types.h"
 
@@ -330,10 +333,205 @@ const fabgl::FontInfo FONT_AGON = {
 	.codepage  = 1252,
 };
 
+// Glyph index, used to match character cell pixel data back to a character code
+// Glyphs are hashed into buckets, with each bucket chained in match order
+// (32-255, then 0-31) so the first match found is the same as a linear search
+//
+struct GlyphIndex {
+	const fabgl::FontInfo *	font = nullptr;
+	const uint8_t *		data = nullptr;
+	const uint32_t *	chptr = nullptr;
+	uint8_t				width = 0;
+	uint8_t				height = 0;
+	uint32_t			generation = 0;
+	int16_t				buckets[256];
+	int16_t				next[256];
+	uint8_t				canonical[256];		// First character in match order with an identical glyph
+};
+
+GlyphIndex		glyphIndex;
+uint32_t		glyphGeneration = 1;		// Changes whenever glyph data may have been altered in place
+
+// Shadow character grid, recording characters drawn by text plotting at cell-aligned positions
+// Cells are only valid whilst their generation matches screenCharGeneration,
+// which is changed by any other drawing that could have overwritten them
+//
+struct ScreenCharCell {
+	uint32_t				generation = 0;
+	uint32_t				glyphGeneration = 0;
+	const fabgl::FontInfo *	font = nullptr;
+	RGB888					bg;
+	uint8_t					c = 0;
+};
+
+std::vector<ScreenCharCell, psram_allocator<ScreenCharCell>> screenChars;
+uint16_t		screenCharCols = 0;
+uint16_t		screenCharRows = 0;
+uint8_t			screenCharWidth = 0;
+uint8_t			screenCharHeight = 0;
+uint32_t		screenCharGeneration = 1;
+
+// Mark the glyph index as stale, for when font data has been changed
+//
+inline void invalidateGlyphIndex() {
+	glyphGeneration++;
+}
+
+inline const uint8_t * getGlyphPtr(const fabgl::FontInfo * font, uint8_t c) {
+	if (font->chptr == nullptr) {
+		return font->data + (c * font->height * ((font->width + 7) >> 3));
+	}
+	return font->data + font->chptr[c];
+}
+
+inline uint8_t hashGlyph(const uint8_t * data, uint16_t size) {
+	uint32_t hash = 2166136261u;
+	for (uint16_t i = 0; i < size; i++) {
+		hash = (hash ^ data[i]) * 16777619u;
+	}
+	return (hash ^ (hash >> 8) ^ (hash >> 16) ^ (hash >> 24)) & 0xFF;
+}
+
+// Get the glyph index for a font, rebuilding it if the font or its glyphs have changed
+//
+GlyphIndex & getGlyphIndex(const fabgl::FontInfo * font) {
+	auto &index = glyphIndex;
+	if (index.font == font && index.data == font->data && index.chptr == font->chptr
+		&& index.width == font->width && index.height == font->height && index.generation == glyphGeneration) {
+		return index;
+	}
+	index.font = font;
+	index.data = font->data;
+	index.chptr = font->chptr;
+	index.width = font->width;
+	index.height = font->height;
+	index.generation = glyphGeneration;
+
+	uint16_t size = ((font->width + 7) >> 3) * font->height;
+	std::fill_n(index.buckets, 256, -1);
+	// insert in reverse match order, so that each chain ends up in match order
+	for (auto i = 255 + 31; i >= 32; i--) {
+		uint8_t c = i & 0xFF;
+		auto hash = hashGlyph(getGlyphPtr(font, c), size);
+		index.next[c] = index.buckets[hash];
+		index.buckets[hash] = c;
+	}
+	for (auto c = 0; c < 256; c++) {
+		auto glyph = getGlyphPtr(font, c);
+		auto match = index.buckets[hashGlyph(glyph, size)];
+		while (match != -1 && memcmp(getGlyphPtr(font, match), glyph, size) != 0) {
+			match = index.next[match];
+		}
+		// character 31 isn't part of the match order, so may not be found
+		index.canonical[c] = match == -1 ? c : match;
+	}
+	return index;
+}
+
+// Find the character whose glyph matches the given data, or -1 if there is none
+//
+int16_t findGlyph(const fabgl::FontInfo * font, const uint8_t * data) {
+	auto &index = getGlyphIndex(font);
+	uint16_t size = ((font->width + 7) >> 3) * font->height;
+	for (auto c = index.buckets[hashGlyph(data, size)]; c != -1; c = index.next[c]) {
+		if (memcmp(getGlyphPtr(font, c), data, size) == 0) {
+			return c;
+		}
+	}
+	return -1;
+}
+
+// Get the character that a glyph match would report for the given character
+//
+inline uint8_t canonicalGlyph(const fabgl::FontInfo * font, uint8_t c) {
+	return getGlyphIndex(font).canonical[c];
+}
+
+// Mark all cells in the shadow character grid as stale
+//
+inline void invalidateScreenChars() {
+	screenCharGeneration++;
+}
+
+// Discard the shadow character grid, such as after a mode change
+//
+void resetScreenChars() {
+	screenChars.clear();
+	screenCharCols = 0;
+	screenCharRows = 0;
+	screenCharWidth = 0;
+	screenCharHeight = 0;
+	invalidateScreenChars();
+}
+
+// Get the shadow grid cell for a character at a screen position
+// returns nullptr if the position isn't aligned to a cell of the given size
+// If allocate is set, the grid is resized when the cell size differs from the current one
+//
+ScreenCharCell * getScreenCharCell(int x, int y, uint8_t width, uint8_t height, bool allocate) {
+	if (width == 0 || height == 0 || x < 0 || y < 0 || (x % width) != 0 || (y % height) != 0) {
+		return nullptr;
+	}
+	if (width != screenCharWidth || height != screenCharHeight) {
+		if (!allocate) {
+			return nullptr;
+		}
+		screenCharWidth = width;
+		screenCharHeight = height;
+		screenCharCols = canvasW / width;
+		screenCharRows = canvasH / height;
+		screenChars.assign(screenCharCols * screenCharRows, ScreenCharCell());
+	}
+	auto col = x / width;
+	auto row = y / height;
+	if (col >= screenCharCols || row >= screenCharRows) {
+		return nullptr;
+	}
+	return &screenChars[row * screenCharCols + col];
+}
+
+// Scroll the shadow character grid along with a region of the screen
+// Moves that aren't whole cells, or regions not aligned to cells, invalidate the whole grid
+//
+void scrollScreenChars(const Rect &region, int moveX, int moveY) {
+	if (screenChars.empty()) {
+		return;
+	}
+	auto w = screenCharWidth;
+	auto h = screenCharHeight;
+	if ((moveX % w) != 0 || (moveY % h) != 0 || (region.X1 % w) != 0 || (region.Y1 % h) != 0
+		|| ((region.X2 + 1) % w) != 0 || ((region.Y2 + 1) % h) != 0) {
+		invalidateScreenChars();
+		return;
+	}
+	int col1 = region.X1 / w;
+	int row1 = region.Y1 / h;
+	int col2 = std::min((region.X2 + 1) / w, (int)screenCharCols) - 1;
+	int row2 = std::min((region.Y2 + 1) / h, (int)screenCharRows) - 1;
+	int dc = moveX / w;
+	int dr = moveY / h;
+	// walk against the direction of movement, so source cells are read before being overwritten
+	int rowStep = dr > 0 ? -1 : 1;
+	int colStep = dc > 0 ? -1 : 1;
+	for (int r = dr > 0 ? row2 : row1; r >= row1 && r <= row2; r += rowStep) {
+		for (int c = dc > 0 ? col2 : col1; c >= col1 && c <= col2; c += colStep) {
+			auto &cell = screenChars[r * screenCharCols + c];
+			int sr = r - dr;
+			int sc = c - dc;
+			if (sr >= row1 && sr <= row2 && sc >= col1 && sc <= col2) {
+				cell = screenChars[sr * screenCharCols + sc];
+			} else {
+				cell.generation = 0;
+			}
+		}
+	}
+}
+
 // Copy the AGON font data (system font) from Flash to RAM
 //
 void copy_font() {
 	memcpy(FONT_AGON_DATA, FONT_AGON_BITMAP, sizeof(FONT_AGON_BITMAP));
+	invalidateGlyphIndex();
 }
 
 // Redefine a character in the system font
@@ -341,6 +539,7 @@ void copy_font() {
 //
 void redefineCharacter(uint8_t c, uint8_t * data) {
 	memcpy(&FONT_AGON_DATA[c * 8], data, 8);
+	invalidateGlyphIndex();
 }
 
 std::shared_ptr<fabgl::FontInfo> createFontFromBuffer(uint16_t bufferId, uint8_t width, uint8_t height, uint8_t ascent, uint8_t flags) {
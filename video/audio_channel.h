@@ -1,6 +1,7 @@
 #ifndef AUDIO_CHANNEL_H
 #define AUDIO_CHANNEL_H
 
+#include <atomic>
 #include <memory>
 #include <unordered_map>
 #include <mutex>
@@ -9,9 +10,14 @@
 #include "agon.h"
 #include "types.h"
 #include "envelopes/types.h"
+#include "spsc_queue.h"
+#include "block_waveform_generator.h"
 
 extern fabgl::SoundGenerator *soundGenerator; 	// audio handling sub-system
 extern std::mutex soundGeneratorMutex;			// mutex for sound generator
+extern TaskHandle_t audioTask;					// audio driver task, woken when a command is queued
+
+#define AUDIO_NO_DEADLINE		UINT64_MAX		// channel needs no attention until it is changed
 
 enum class AudioState : uint8_t {	// Audio channel state
 	Idle = 0,				// currently idle/silent
@@ -22,7 +28,38 @@ enum class AudioState : uint8_t {	// Audio channel state
 	Abort					// aborting a note
 };
 
+enum class AudioCommandType : uint8_t {	// Commands queued by the VDU processor for the audio task
+	PlayNote = 0,
+	Volume,
+	Frequency,
+	Duration,
+	Waveform,
+	VolumeEnvelope,
+	FrequencyEnvelope,
+	SampleRate,
+	DutyCycle,
+	Seek,
+	Abort,
+	GeneratorSampleRate,	// rebuild the sound generator, rather than change a channel
+	GeneratorVolume,		// set the sound generator's master volume
+};
+
+struct AudioCommand {
+	AudioCommandType	type;
+	uint8_t				channel;
+	uint8_t				volume;
+	uint16_t			frequency;
+	int32_t				value;		// duration, position, sample rate, duty cycle or waveform type
+	void *				object;		// new waveform or envelope, owned by the command until it is applied
+};
+
+extern SPSCQueue<AudioCommand, AUDIO_COMMAND_QUEUE_SIZE> audioCommands;
+bool queueAudioCommand(const AudioCommand & command);
+
 // The audio channel class
+// Public setters are called by the VDU processor. They never touch the playing state, but instead
+// queue a command for the audio task, and return the status that command will have.
+// Everything else is only used by the audio task
 //
 class AudioChannel {
 	public:
@@ -39,30 +76,56 @@ class AudioChannel {
 		uint8_t		setSampleRate(uint16_t sampleRate);
 		uint8_t		setDutyCycle(uint8_t dutyCycle);
 		uint8_t		setParameter(uint8_t parameter, uint16_t value);
-		void		attachSoundGenerator();
-		void		detachSoundGenerator();
 		uint8_t		seekTo(uint32_t position);
-		void		loop(uint64_t now);
+		uint8_t		goIdle();
 		uint8_t		channel() { return _channel; }
-		void		goIdle();
-		std::unique_lock<std::mutex> lock() { return std::unique_lock<std::mutex>(_channelMutex); }
+
+		void		apply(const AudioCommand & command, uint64_t now);
+		uint64_t	loop(uint64_t now);
+		void		attachSoundGenerator();
+		void		detachSoundGenerator();
 	private:
+		bool		_queue(AudioCommand command);
+		AudioState	_expectedState();
+		BlockWaveformGenerator *getSampleWaveform(uint16_t sampleId, AudioChannel *channelRef);
+
+		void		_playNote(uint8_t volume, uint16_t frequency, int32_t duration);
+		void		_setWaveform(BlockWaveformGenerator * waveform, uint8_t waveformType);
+		void		_setVolume(uint8_t volume, uint64_t now);
+		void		_setFrequency(uint16_t frequency);
+		void		_setDuration(int32_t duration);
 		uint8_t		_seekTo(uint32_t position);
 		void		_goIdle();
-		WaveformGenerator *getSampleWaveform(uint16_t sampleId, AudioChannel *channelRef);
+		void		_publish();
 		uint8_t		_getVolume(uint32_t elapsed);
 		uint16_t	_getFrequency(uint32_t elapsed);
 		bool		_isReleasing(uint32_t elapsed);
 		bool		_isFinished(uint32_t elapsed);
+		uint32_t	_nextChange(uint32_t elapsed);
 		uint8_t		_channel;
+
+		// VDU processor side - what the channel will look like once its queued commands are applied
+		uint8_t		_commandVolume;
+		uint16_t	_commandFrequency;
+		uint8_t		_commandWaveformType;
+		bool		_hasWaveform;
+		bool		_hasVolumeEnvelope;
+		bool		_hasFrequencyEnvelope;
+		AudioState	_commandState;
+		uint32_t	_issued;				// commands queued for this channel
+
+		// Published by the audio task
+		std::atomic<AudioState>	_state;
+		std::atomic<uint8_t>	_status;	// active and indefinite status bits
+		std::atomic<uint32_t>	_applied;	// commands applied to this channel
+
+		// Audio task side
 		uint8_t		_volume;
 		uint16_t	_frequency;
 		int32_t		_duration;
 		uint64_t	_startTime;
 		uint8_t		_waveformType;
-		AudioState	_state;
-		std::unique_ptr<WaveformGenerator>	_waveform;
-		std::mutex							_channelMutex;
+		std::unique_ptr<BlockWaveformGenerator>	_waveform;
 		std::unique_ptr<VolumeEnvelope>		_volumeEnvelope;
 		std::unique_ptr<FrequencyEnvelope>	_frequencyEnvelope;
 };
@@ -71,93 +134,87 @@ class AudioChannel {
 #include "enhanced_samples_generator.h"
 extern std::unordered_map<uint16_t, std::shared_ptr<AudioSample>, std::hash<uint16_t>, std::equal_to<uint16_t>, psram_allocator<std::pair<const uint16_t, std::shared_ptr<AudioSample>>>> samples;
 
-AudioChannel::AudioChannel(uint8_t channel) : _waveform(nullptr), _channel(channel), _state(AudioState::Idle), _volume(64), _frequency(750), _duration(-1) {
+AudioChannel::AudioChannel(uint8_t channel) : _channel(channel),
+	_commandVolume(64), _commandFrequency(750), _commandWaveformType(AUDIO_WAVE_DEFAULT),
+	_hasWaveform(false), _hasVolumeEnvelope(false), _hasFrequencyEnvelope(false),
+	_commandState(AudioState::Idle), _issued(0),
+	_state(AudioState::Idle), _status(0), _applied(0),
+	_volume(64), _frequency(750), _duration(-1), _startTime(0), _waveformType(AUDIO_WAVE_DEFAULT), _waveform(nullptr)
+{
 	debug_log("AudioChannel: init %d\n\r", channel);
-	setWaveform(AUDIO_WAVE_DEFAULT);
-	debug_log("free mem: %d\n\r", heap_caps_get_free_size(MALLOC_CAP_8BIT));
 }
 
 AudioChannel::~AudioChannel() {
 	debug_log("AudioChannel: deiniting %d\n\r", channel());
-	auto lock = std::unique_lock<std::mutex>(_channelMutex);
 	detachSoundGenerator();
 	debug_log("AudioChannel: deinit %d\n\r", channel());
 }
 
-void AudioChannel::goIdle() {
-	debug_log("AudioChannel: abort %d\n\r", channel());
-	auto lock = std::unique_lock<std::mutex>(_channelMutex);
-	if (this->_waveform) {
-		this->_waveform->enable(false);
+// Queue a command for this channel, dropping it if the queue is full
+bool AudioChannel::_queue(AudioCommand command) {
+	command.channel = _channel;
+	if (!queueAudioCommand(command)) {
+		return false;
 	}
-	this->_state = AudioState::Idle;
+	_issued++;
+	return true;
 }
 
-// expects the lock to already be held
-void AudioChannel::_goIdle() {
+// The state the channel will be in once the audio task has applied everything queued for it
+// With nothing outstanding that's simply the audio task's state, otherwise it's what our commands predicted
+AudioState AudioChannel::_expectedState() {
+	if (_applied.load(std::memory_order_acquire) == _issued) {
+		_commandState = _state.load(std::memory_order_relaxed);
+	}
+	return _commandState;
+}
+
+uint8_t AudioChannel::goIdle() {
 	debug_log("AudioChannel: abort %d\n\r", channel());
-	if (this->_waveform) {
-		this->_waveform->enable(false);
+	if (!_queue({ AudioCommandType::Abort })) {
+		return 0;
 	}
-	this->_state = AudioState::Idle;
+	_commandState = AudioState::Idle;
+	return 1;
 }
 
 uint8_t AudioChannel::playNote(uint8_t volume, uint16_t frequency, int32_t duration) {
-	auto lock = std::unique_lock<std::mutex>(_channelMutex);
-	if (!this->_waveform) {
+	if (!_hasWaveform) {
 		debug_log("AudioChannel: no waveform on channel %d\n\r", channel());
 		return 0;
 	}
-	if (this->_waveformType == AUDIO_WAVE_SAMPLE && this->_volume == 0 && this->_state != AudioState::Idle) {
-		// we're playing a silenced sample, so we're free to play a new note, so abort
-		this->_goIdle();
+	auto state = _expectedState();
+	if (_commandWaveformType == AUDIO_WAVE_SAMPLE && _commandVolume == 0) {
+		// a silenced sample will be aborted, so we're free to play a new note
+		state = AudioState::Idle;
 	}
-	switch (this->_state) {
+	switch (state) {
 		case AudioState::Idle:
 		case AudioState::Release:
-			this->_volume = volume;
-			this->_frequency = frequency;
-			this->_duration = duration == 65535 ? -1 : duration;
-			if (this->_duration == 0 && this->_waveformType == AUDIO_WAVE_SAMPLE) {
-				// zero duration means play whole sample
-				// NB this can only work out sample duration based on sample provided
-				// so if sample data is streaming in an explicit length should be used instead
-				this->_duration = ((EnhancedSamplesGenerator *)&*_waveform)->getDuration(frequency);
-				if (this->_volumeEnvelope) {
-					// subtract the "release" time from the duration
-					this->_duration -= this->_volumeEnvelope->getRelease();
-				}
-				if (this->_duration < 0) {
-					this->_duration = 1;
-				}
+			if (!_queue({ AudioCommandType::PlayNote, 0, volume, frequency, duration })) {
+				return 0;
 			}
-			this->_state = AudioState::Pending;
-			debug_log("AudioChannel: playNote %d,%d,%d,%d\n\r", channel(), volume, frequency, this->_duration);
+			_commandVolume = volume;
+			_commandFrequency = frequency;
+			_commandState = AudioState::Pending;
 			return 1;
 	}
 	return 0;
 }
 
 uint8_t AudioChannel::getStatus() {
-	auto lock = std::unique_lock<std::mutex>(_channelMutex);
-	uint8_t status = 0;
-	if (this->_waveform && this->_waveform->enabled()) {
-		status |= AUDIO_STATUS_ACTIVE;
-		if (this->_duration == -1) {
-			status |= AUDIO_STATUS_INDEFINITE;
-		}
-	}
-	switch (this->_state) {
+	uint8_t status = _status.load(std::memory_order_acquire);
+	switch (_expectedState()) {
 		case AudioState::Pending:
 		case AudioState::Playing:
 		case AudioState::PlayLoop:
 			status |= AUDIO_STATUS_PLAYING;
 			break;
 	}
-	if (this->_volumeEnvelope) {
+	if (_hasVolumeEnvelope) {
 		status |= AUDIO_STATUS_HAS_VOLUME_ENVELOPE;
 	}
-	if (this->_frequencyEnvelope) {
+	if (_hasFrequencyEnvelope) {
 		status |= AUDIO_STATUS_HAS_FREQUENCY_ENVELOPE;
 	}
 
@@ -165,7 +222,7 @@ uint8_t AudioChannel::getStatus() {
 	return status;
 }
 
-WaveformGenerator *AudioChannel::getSampleWaveform(uint16_t sampleId, AudioChannel *channelRef) {
+BlockWaveformGenerator *AudioChannel::getSampleWaveform(uint16_t sampleId, AudioChannel *channelRef) {
 	if (samples.find(sampleId) != samples.end()) {
 		auto sample = samples.at(sampleId);
 		// if (sample->channels.find(_channel) != sample->channels.end()) {
@@ -190,27 +247,26 @@ WaveformGenerator *AudioChannel::getSampleWaveform(uint16_t sampleId, AudioChann
 }
 
 uint8_t AudioChannel::setWaveform(int8_t waveformType, uint16_t sampleId) {
-	auto lock = std::unique_lock<std::mutex>(_channelMutex);
-	WaveformGenerator *newWaveform = nullptr;
+	BlockWaveformGenerator *newWaveform = nullptr;
 
 	switch (waveformType) {
 		case AUDIO_WAVE_SAWTOOTH:
-			newWaveform = new SawtoothWaveformGenerator();
+			newWaveform = new BlockSawtoothGenerator();
 			break;
 		case AUDIO_WAVE_SQUARE:
-			newWaveform = new SquareWaveformGenerator();
+			newWaveform = new BlockSquareGenerator();
 			break;
 		case AUDIO_WAVE_SINE:
-			newWaveform = new SineWaveformGenerator();
+			newWaveform = new BlockSineGenerator();
 			break;
 		case AUDIO_WAVE_TRIANGLE:
-			newWaveform = new TriangleWaveformGenerator();
+			newWaveform = new BlockTriangleGenerator();
 			break;
 		case AUDIO_WAVE_NOISE:
-			newWaveform = new NoiseWaveformGenerator();
+			newWaveform = new BlockNoiseGenerator();
 			break;
 		case AUDIO_WAVE_VICNOISE:
-			newWaveform = new VICNoiseGenerator();
+			newWaveform = new BlockWaveformSource<VICNoiseGenerator>();
 			break;
 		case AUDIO_WAVE_SAMPLE:
 			// Buffer-based sample playback
@@ -233,19 +289,13 @@ uint8_t AudioChannel::setWaveform(int8_t waveformType, uint16_t sampleId) {
 
 	if (newWaveform != nullptr) {
 		debug_log("AudioChannel: setWaveform %d on channel %d\n\r", waveformType, channel());
-		if (this->_state != AudioState::Idle) {
-			debug_log("AudioChannel: aborting current playback\n\r");
-			// some kind of playback is happening, so abort any current task delay to allow playback to end
-			this->_goIdle();
-		}
-		if (this->_waveform != nullptr) {
-			debug_log("AudioChannel: detaching old waveform\n\r");
-			detachSoundGenerator();
+		// the waveform is created here, as samples belong to the VDU processor, but is swapped in by the audio task
+		if (!_queue({ AudioCommandType::Waveform, 0, 0, 0, waveformType, newWaveform })) {
+			return 0;
 		}
-		this->_waveform.reset(newWaveform);
-		_waveformType = waveformType;
-		attachSoundGenerator();
-		debug_log("AudioChannel: setWaveform %d done on channel %d\n\r", waveformType, channel());
+		_hasWaveform = true;
+		_commandWaveformType = waveformType;
+		_commandState = AudioState::Idle;
 		return 1;
 	}
 	// waveform not changed, so return a failure
@@ -253,159 +303,118 @@ uint8_t AudioChannel::setWaveform(int8_t waveformType, uint16_t sampleId) {
 }
 
 uint8_t AudioChannel::setVolume(uint8_t volume) {
-	auto lock = std::unique_lock<std::mutex>(_channelMutex);
 	debug_log("AudioChannel: setVolume %d on channel %d\n\r", volume, channel());
 	if (volume == 255) {
-		return this->_volume;
+		return _commandVolume;
 	}
 	if (volume > 127) {
 		volume = 127;
 	}
+	if (!_hasWaveform) {
+		return 255;
+	}
 
-	if (this->_waveform) {
-		switch (this->_state) {
-			case AudioState::Idle:
-				if (volume > 0) {
-					// new note playback
-					this->_volume = volume;
-					this->_duration = -1;	// indefinite duration
-					this->_state = AudioState::Pending;
-				}
-				break;
-			case AudioState::PlayLoop:
-				// we are looping, so an envelope may be active
-				if (volume == 0) {
-					// silence whilst looping always stops playback - curtail duration
-					this->_duration = millis() - this->_startTime;
-					// if there's a volume envelope, just allow release to happen, otherwise...
-					if (!this->_volumeEnvelope) {
-						this->_volume = 0;
-					}
-				} else {
-					// Change base volume level, so next loop iteration will use it
-					this->_volume = volume;
-				}
-				break;
-			case AudioState::Pending:
-				// Set level so next loop will pick up the new volume
-				this->_volume = volume;
-				break;
-			case AudioState::Release:
-				// Set level so next loop will pick up the new volume
-				this->_volume = volume;
-				if (!this->_volumeEnvelope) {
-					// No volume envelope, so set volume immediately
-					this->_waveform->setVolume(volume);
-				}
-				break;
-			default:
-				// All other states we'll set volume immediately
-				this->_volume = volume;
-				this->_waveform->setVolume(volume);
-				if (volume == 0 && this->_waveformType != AUDIO_WAVE_SAMPLE) {
-					// we're going silent, so abort any current playback
-					this->_goIdle();
-				}
-				break;
-		}
-		return this->_volume;
+	// work out what the audio task will do with this volume, so we can report it now
+	auto state = _expectedState();
+	auto newVolume = _commandVolume;
+	auto newState = state;
+	switch (state) {
+		case AudioState::Idle:
+			if (volume > 0) {
+				newVolume = volume;
+				newState = AudioState::Pending;
+			}
+			break;
+		case AudioState::PlayLoop:
+			if (volume > 0 || !_hasVolumeEnvelope) {
+				newVolume = volume;
+			}
+			break;
+		case AudioState::Pending:
+		case AudioState::Release:
+			newVolume = volume;
+			break;
+		default:
+			newVolume = volume;
+			if (volume == 0 && _commandWaveformType != AUDIO_WAVE_SAMPLE) {
+				newState = AudioState::Idle;
+			}
+			break;
+	}
+	if (!_queue({ AudioCommandType::Volume, 0, volume })) {
+		return 255;
 	}
-	return 255;
+	_commandVolume = newVolume;
+	_commandState = newState;
+	return _commandVolume;
 }
 
 uint8_t AudioChannel::setFrequency(uint16_t frequency) {
-	auto lock = std::unique_lock<std::mutex>(_channelMutex);
 	debug_log("AudioChannel: setFrequency %d on channel %d\n\r", frequency, channel());
-	this->_frequency = frequency;
-
-	if (this->_waveform) {
-		switch (this->_state) {
-			case AudioState::Pending:
-				// Do nothing as next loop will pick up the new frequency
-				break;
-			case AudioState::Release:
-			case AudioState::PlayLoop:
-				// we are looping - only change frequency if we don't have a frequency envelope
-				if (!this->_frequencyEnvelope) {
-					this->_waveform->setFrequency(frequency);
-				}
-			default:
-				this->_waveform->setFrequency(frequency);
-		}
-		return 1;
+	if (!_hasWaveform || !_queue({ AudioCommandType::Frequency, 0, 0, frequency })) {
+		return 0;
 	}
-	return 0;
+	_commandFrequency = frequency;
+	return 1;
 }
 
 uint8_t AudioChannel::setDuration(int32_t duration) {
-	auto lock = std::unique_lock<std::mutex>(_channelMutex);
 	debug_log("AudioChannel: setDuration %d on channel %d\n\r", duration, channel());
 	if (duration == 0xFFFFFF) {
 		duration = -1;
 	}
-	this->_duration = duration;
-
-	if (this->_waveform) {
-		switch (this->_state) {
-			case AudioState::Idle:
-				// kick off a new note playback
-				this->_state = AudioState::Pending;
-				break;
-			case AudioState::Playing:
-				this->_goIdle();
-				break;
-			default:
-				// any other state we should be looping so it will just get picked up
-				break;
-		}
-		return 1;
+	if (!_hasWaveform) {
+		return 0;
 	}
-	return 0;
+	auto state = _expectedState();
+	if (!_queue({ AudioCommandType::Duration, 0, 0, 0, duration })) {
+		return 0;
+	}
+	switch (state) {
+		case AudioState::Idle:
+			_commandState = AudioState::Pending;
+			break;
+		case AudioState::Playing:
+			_commandState = AudioState::Idle;
+			break;
+	}
+	return 1;
 }
 
 uint8_t AudioChannel::setVolumeEnvelope(std::unique_ptr<VolumeEnvelope> envelope) {
-	auto lock = std::unique_lock<std::mutex>(_channelMutex);
-	this->_volumeEnvelope = std::move(envelope);
-	if (envelope && this->_state == AudioState::Playing) {
-		// swap to looping
-		this->_goIdle();
-		this->_state = AudioState::PlayLoop;
+	bool hasEnvelope = envelope != nullptr;
+	if (!_queue({ AudioCommandType::VolumeEnvelope, 0, 0, 0, 0, envelope.release() })) {
+		return 0;
 	}
+	_hasVolumeEnvelope = hasEnvelope;
 	return 1;
 }
 
 uint8_t AudioChannel::setFrequencyEnvelope(std::unique_ptr<FrequencyEnvelope> envelope) {
-	auto lock = std::unique_lock<std::mutex>(_channelMutex);
-	this->_frequencyEnvelope = std::move(envelope);
-	if (envelope && this->_state == AudioState::Playing) {
-		// swap to looping
-		this->_goIdle();
-		this->_state = AudioState::PlayLoop;
+	bool hasEnvelope = envelope != nullptr;
+	if (!_queue({ AudioCommandType::FrequencyEnvelope, 0, 0, 0, 0, envelope.release() })) {
+		return 0;
 	}
+	_hasFrequencyEnvelope = hasEnvelope;
 	return 1;
 }
 
 uint8_t AudioChannel::setSampleRate(uint16_t sampleRate) {
-	auto lock = std::unique_lock<std::mutex>(_channelMutex);
-	if (this->_waveform) {
-		this->_waveform->setSampleRate(sampleRate);
+	if (_hasWaveform && _queue({ AudioCommandType::SampleRate, 0, 0, 0, sampleRate })) {
 		return 1;
 	}
 	return 0;
 }
 
 uint8_t AudioChannel::setDutyCycle(uint8_t dutyCycle) {
-	auto lock = std::unique_lock<std::mutex>(_channelMutex);
-	if (this->_waveform && this->_waveformType == AUDIO_WAVE_SQUARE) {
-		((SquareWaveformGenerator *)&*_waveform)->setDutyCycle(dutyCycle);
+	if (_hasWaveform && _commandWaveformType == AUDIO_WAVE_SQUARE && _queue({ AudioCommandType::DutyCycle, 0, 0, 0, dutyCycle })) {
 		return 1;
 	}
 	return 0;
 }
 
 uint8_t AudioChannel::setParameter(uint8_t parameter, uint16_t value) {
-	// Don't lock the mutex here - the functions it calls must lock it
-	if (this->_waveform) {
+	if (_hasWaveform) {
 		bool use16Bit = parameter & AUDIO_PARAM_16BIT;
 		auto param = parameter & AUDIO_PARAM_MASK;
 		switch (param) {
@@ -417,7 +426,7 @@ uint8_t AudioChannel::setParameter(uint8_t parameter, uint16_t value) {
 			}	break;
 			case AUDIO_PARAM_FREQUENCY: {
 				if (!use16Bit) {
-					value = _frequency & 0xFF00 | value & 0x00FF;
+					value = _commandFrequency & 0xFF00 | value & 0x00FF;
 				}
 				return setFrequency(value);
 			}	break;
@@ -426,7 +435,220 @@ uint8_t AudioChannel::setParameter(uint8_t parameter, uint16_t value) {
 	return 0;
 }
 
-// caller must hold channel lock
+uint8_t AudioChannel::seekTo(uint32_t position) {
+	if (_commandWaveformType == AUDIO_WAVE_SAMPLE && _queue({ AudioCommandType::Seek, 0, 0, 0, (int32_t)position })) {
+		return 1;
+	}
+	return 0;
+}
+
+// Apply a command queued by the VDU processor
+//
+void AudioChannel::apply(const AudioCommand & command, uint64_t now) {
+	switch (command.type) {
+		case AudioCommandType::PlayNote:
+			_playNote(command.volume, command.frequency, command.value);
+			break;
+		case AudioCommandType::Volume:
+			_setVolume(command.volume, now);
+			break;
+		case AudioCommandType::Frequency:
+			_setFrequency(command.frequency);
+			break;
+		case AudioCommandType::Duration:
+			_setDuration(command.value);
+			break;
+		case AudioCommandType::Waveform:
+			_setWaveform((BlockWaveformGenerator *)command.object, command.value);
+			break;
+		case AudioCommandType::VolumeEnvelope:
+			_volumeEnvelope.reset((VolumeEnvelope *)command.object);
+			break;
+		case AudioCommandType::FrequencyEnvelope:
+			_frequencyEnvelope.reset((FrequencyEnvelope *)command.object);
+			break;
+		case AudioCommandType::SampleRate:
+			if (_waveform) {
+				_waveform->setSampleRate(command.value);
+			}
+			break;
+		case AudioCommandType::DutyCycle:
+			if (_waveform && _waveformType == AUDIO_WAVE_SQUARE) {
+				((BlockSquareGenerator *)&*_waveform)->setDutyCycle(command.value);
+			}
+			break;
+		case AudioCommandType::Seek:
+			_seekTo(command.value);
+			break;
+		case AudioCommandType::Abort:
+			_goIdle();
+			break;
+		default:
+			break;
+	}
+	_publish();
+	_applied.fetch_add(1, std::memory_order_release);
+}
+
+// Publish the status bits only the audio task knows
+void AudioChannel::_publish() {
+	uint8_t status = 0;
+	if (this->_waveform && this->_waveform->enabled()) {
+		status |= AUDIO_STATUS_ACTIVE;
+		if (this->_duration == -1) {
+			status |= AUDIO_STATUS_INDEFINITE;
+		}
+	}
+	_status.store(status, std::memory_order_release);
+}
+
+void AudioChannel::_goIdle() {
+	debug_log("AudioChannel: abort %d\n\r", channel());
+	if (this->_waveform) {
+		this->_waveform->enable(false);
+	}
+	this->_state = AudioState::Idle;
+}
+
+void AudioChannel::_playNote(uint8_t volume, uint16_t frequency, int32_t duration) {
+	if (this->_waveformType == AUDIO_WAVE_SAMPLE && this->_volume == 0 && this->_state != AudioState::Idle) {
+		// we're playing a silenced sample, so we're free to play a new note, so abort
+		this->_goIdle();
+	}
+	switch (this->_state) {
+		case AudioState::Idle:
+		case AudioState::Release:
+			this->_volume = volume;
+			this->_frequency = frequency;
+			this->_duration = duration == 65535 ? -1 : duration;
+			if (this->_duration == 0 && this->_waveformType == AUDIO_WAVE_SAMPLE) {
+				// zero duration means play whole sample
+				// NB this can only work out sample duration based on sample provided
+				// so if sample data is streaming in an explicit length should be used instead
+				this->_duration = ((EnhancedSamplesGenerator *)&*_waveform)->getDuration(frequency);
+				if (this->_volumeEnvelope) {
+					// subtract the "release" time from the duration
+					this->_duration -= this->_volumeEnvelope->getRelease();
+				}
+				if (this->_duration < 0) {
+					this->_duration = 1;
+				}
+			}
+			this->_state = AudioState::Pending;
+			debug_log("AudioChannel: playNote %d,%d,%d,%d\n\r", channel(), volume, frequency, this->_duration);
+			break;
+		default:
+			debug_log("AudioChannel: channel %d busy, note dropped\n\r", channel());
+			break;
+	}
+}
+
+void AudioChannel::_setWaveform(BlockWaveformGenerator * waveform, uint8_t waveformType) {
+	if (this->_state != AudioState::Idle) {
+		debug_log("AudioChannel: aborting current playback\n\r");
+		// some kind of playback is happening, so abort any current task delay to allow playback to end
+		this->_goIdle();
+	}
+	if (this->_waveform != nullptr) {
+		debug_log("AudioChannel: detaching old waveform\n\r");
+		detachSoundGenerator();
+	}
+	this->_waveform.reset(waveform);
+	_waveformType = waveformType;
+	attachSoundGenerator();
+	debug_log("AudioChannel: setWaveform %d done on channel %d\n\r", waveformType, channel());
+}
+
+void AudioChannel::_setVolume(uint8_t volume, uint64_t now) {
+	if (!this->_waveform) {
+		return;
+	}
+	switch (this->_state) {
+		case AudioState::Idle:
+			if (volume > 0) {
+				// new note playback
+				this->_volume = volume;
+				this->_duration = -1;	// indefinite duration
+				this->_state = AudioState::Pending;
+			}
+			break;
+		case AudioState::PlayLoop:
+			// we are looping, so an envelope may be active
+			if (volume == 0) {
+				// silence whilst looping always stops playback - curtail duration
+				this->_duration = now - this->_startTime;
+				// if there's a volume envelope, just allow release to happen, otherwise...
+				if (!this->_volumeEnvelope) {
+					this->_volume = 0;
+				}
+			} else {
+				// Change base volume level, so next loop iteration will use it
+				this->_volume = volume;
+			}
+			break;
+		case AudioState::Pending:
+			// Set level so next loop will pick up the new volume
+			this->_volume = volume;
+			break;
+		case AudioState::Release:
+			// Set level so next loop will pick up the new volume
+			this->_volume = volume;
+			if (!this->_volumeEnvelope) {
+				// No volume envelope, so set volume immediately
+				this->_waveform->setVolume(volume);
+			}
+			break;
+		default:
+			// All other states we'll set volume immediately
+			this->_volume = volume;
+			this->_waveform->setVolume(volume);
+			if (volume == 0 && this->_waveformType != AUDIO_WAVE_SAMPLE) {
+				// we're going silent, so abort any current playback
+				this->_goIdle();
+			}
+			break;
+	}
+}
+
+void AudioChannel::_setFrequency(uint16_t frequency) {
+	this->_frequency = frequency;
+
+	if (this->_waveform) {
+		switch (this->_state) {
+			case AudioState::Pending:
+				// Do nothing as next loop will pick up the new frequency
+				break;
+			case AudioState::Release:
+			case AudioState::PlayLoop:
+				// we are looping - only change frequency if we don't have a frequency envelope
+				if (!this->_frequencyEnvelope) {
+					this->_waveform->setFrequency(frequency);
+				}
+			default:
+				this->_waveform->setFrequency(frequency);
+		}
+	}
+}
+
+void AudioChannel::_setDuration(int32_t duration) {
+	this->_duration = duration;
+
+	if (this->_waveform) {
+		switch (this->_state) {
+			case AudioState::Idle:
+				// kick off a new note playback
+				this->_state = AudioState::Pending;
+				break;
+			case AudioState::Playing:
+				this->_goIdle();
+				break;
+			default:
+				// any other state we should be looping so it will just get picked up
+				break;
+		}
+	}
+}
+
 void AudioChannel::attachSoundGenerator() {
 	if (this->_waveform) {
 		auto lock = std::unique_lock<std::mutex>(soundGeneratorMutex);
@@ -434,7 +656,6 @@ void AudioChannel::attachSoundGenerator() {
 	}
 }
 
-// caller must hold channel lock
 void AudioChannel::detachSoundGenerator() {
 	if (this->_waveform) {
 		auto lock = std::unique_lock<std::mutex>(soundGeneratorMutex);
@@ -443,7 +664,6 @@ void AudioChannel::detachSoundGenerator() {
 	this->_state = AudioState::Idle;
 }
 
-// caller must hold channel lock
 uint8_t AudioChannel::_seekTo(uint32_t position) {
 	if (this->_waveformType == AUDIO_WAVE_SAMPLE) {
 		((EnhancedSamplesGenerator *)&*_waveform)->seekTo(position);
@@ -452,12 +672,6 @@ uint8_t AudioChannel::_seekTo(uint32_t position) {
 	return 0;
 }
 
-uint8_t AudioChannel::seekTo(uint32_t position) {
-	auto lock = std::unique_lock<std::mutex>(_channelMutex);
-	return _seekTo(position);
-}
-
-// caller must hold channel lock
 uint8_t AudioChannel::_getVolume(uint32_t elapsed) {
 	if (this->_volumeEnvelope) {
 		return this->_volumeEnvelope->getVolume(this->_volume, elapsed, this->_duration);
@@ -465,7 +679,6 @@ uint8_t AudioChannel::_getVolume(uint32_t elapsed) {
 	return this->_volume;
 }
 
-// caller must hold channel lock
 uint16_t AudioChannel::_getFrequency(uint32_t elapsed) {
 	if (this->_frequencyEnvelope) {
 		return this->_frequencyEnvelope->getFrequency(this->_frequency, elapsed, this->_duration);
@@ -473,7 +686,6 @@ uint16_t AudioChannel::_getFrequency(uint32_t elapsed) {
 	return this->_frequency;
 }
 
-// caller must hold channel lock
 bool AudioChannel::_isReleasing(uint32_t elapsed) {
 	if (this->_volumeEnvelope) {
 		return this->_volumeEnvelope->isReleasing(elapsed, this->_duration);
@@ -484,7 +696,6 @@ bool AudioChannel::_isReleasing(uint32_t elapsed) {
 	return elapsed >= this->_duration;
 }
 
-// caller must hold channel lock
 bool AudioChannel::_isFinished(uint32_t elapsed) {
 	if (this->_volumeEnvelope) {
 		return this->_volumeEnvelope->isFinished(elapsed, this->_duration);
@@ -495,9 +706,24 @@ bool AudioChannel::_isFinished(uint32_t elapsed) {
 	return (elapsed >= this->_duration);
 }
 
-void AudioChannel::loop(uint64_t now) {
-	auto lock = std::unique_lock<std::mutex>(_channelMutex);
+// Time after elapsed at which the channel's envelopes next need an update
+uint32_t AudioChannel::_nextChange(uint32_t elapsed) {
+	uint32_t next = ENVELOPE_NO_CHANGE;
+	if (this->_volumeEnvelope) {
+		next = this->_volumeEnvelope->nextChange(elapsed, this->_duration);
+	} else if (this->_duration >= 0) {
+		// without a volume envelope the note ends with its duration
+		next = std::max<uint32_t>(this->_duration, elapsed + 1);
+	}
+	if (this->_frequencyEnvelope) {
+		next = std::min(next, this->_frequencyEnvelope->nextChange(elapsed, this->_duration));
+	}
+	return next;
+}
 
+// Update the channel, returning the time at which it next needs updating
+//
+uint64_t AudioChannel::loop(uint64_t now) {
 	switch (this->_state) {
 		case AudioState::Pending:
 			debug_log("AudioChannel: play %d,%d,%d,%d\n\r", channel(), this->_volume, this->_frequency, this->_duration);
@@ -507,6 +733,8 @@ void AudioChannel::loop(uint64_t now) {
 			this->_waveform->setVolume(this->_getVolume(0));
 			this->_seekTo(0);
 			this->_waveform->setFrequency(this->_getFrequency(0));
+			// don't play anything left rendered from the last note
+			this->_waveform->startNote();
 			this->_waveform->enable(true);
 			// if we have an envelope then we loop, otherwise just delay for duration
 			if (this->_volumeEnvelope || this->_frequencyEnvelope) {
@@ -535,20 +763,12 @@ void AudioChannel::loop(uint64_t now) {
 			break;
 
 		// loop and release states used for envelopes
-		case AudioState::PlayLoop: {
-			uint32_t elapsed = now - this->_startTime;
-			if (_isReleasing(elapsed)) {
+		case AudioState::PlayLoop:
+			if (_isReleasing(now - this->_startTime)) {
 				debug_log("AudioChannel: releasing %d...\n\r", channel());
 				this->_state = AudioState::Release;
 			}
-			// update volume and frequency as appropriate
-			if (this->_volumeEnvelope)
-				this->_waveform->setVolume(this->_getVolume(elapsed));
-			if (this->_frequencyEnvelope)
-				this->_waveform->setFrequency(this->_getFrequency(elapsed));
-			break;
-		}
-
+			// fall through, as a release may already have finished by the time it starts
 		case AudioState::Release: {
 			uint32_t elapsed = now - this->_startTime;
 			// update volume and frequency as appropriate
@@ -557,7 +777,7 @@ void AudioChannel::loop(uint64_t now) {
 			if (this->_frequencyEnvelope)
 				this->_waveform->setFrequency(this->_getFrequency(elapsed));
 
-			if (_isFinished(elapsed)) {
+			if (this->_state == AudioState::Release && _isFinished(elapsed)) {
 				this->_waveform->enable(false);
 				debug_log("AudioChannel: end (released %d)\n\r", channel());
 				this->_state = AudioState::Idle;
@@ -574,6 +794,21 @@ void AudioChannel::loop(uint64_t now) {
 		case AudioState::Idle:
 			break;
 	}
+
+	_publish();
+	switch (this->_state) {
+		case AudioState::Playing:
+			// simple playback only needs to stop at the end of its duration
+			return this->_duration >= 0 ? this->_startTime + this->_duration : AUDIO_NO_DEADLINE;
+		case AudioState::PlayLoop:
+		case AudioState::Release: {
+			// wake when an envelope next changes, rather than every millisecond
+			auto next = _nextChange(now - this->_startTime);
+			return next == ENVELOPE_NO_CHANGE ? AUDIO_NO_DEADLINE : this->_startTime + next;
+		}
+		default:
+			return AUDIO_NO_DEADLINE;
+	}
 }
 
 #endif // AUDIO_CHANNEL_H
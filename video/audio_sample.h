@@ -3,19 +3,46 @@
 
 #include <memory>
 #include <unordered_map>
+#include <vector>
 
 #include "types.h"
 #include "buffers.h"
 #include "audio_channel.h"
 #include "buffer_stream.h"
 
+// Number of samples decoded at a time from 16-bit and ADPCM sample data
+#define SAMPLE_DECODE_BLOCK		32
+// ADPCM decoder state is recorded at this interval of samples, so seeking only decodes from the nearest one
+#define ADPCM_SEEK_INTERVAL		256
+
+// IMA ADPCM decoder state
+struct AdpcmState {
+	int16_t			predictor = 0;
+	uint8_t			stepIndex = 0;
+};
+
+// Playback position within a sample
+// Caches the current block's data, so reading a sample needs no block lookup or shared_ptr copy.
+// The blocks themselves are kept alive by the sample, which its player holds for the whole of playback
+//
+struct AudioSamplePosition {
+	const uint8_t *	data = nullptr;		// Next byte of sample data in the current block
+	const uint8_t *	end = nullptr;		// End of the current block
+	uint32_t		nextBlock = 0;		// Index of the block to move on to
+
+	// Samples decoded ahead from formats that aren't 8-bit
+	int8_t			decoded[SAMPLE_DECODE_BLOCK];
+	uint8_t			decodedIndex = 0;	// Next decoded sample to return
+	uint8_t			decodedCount = 0;	// Number of decoded samples available
+	AdpcmState		adpcm;				// ADPCM decoder state after the last decoded sample
+};
+
 struct AudioSample {
-	AudioSample(BufferVector streams, uint8_t format, uint32_t sampleRate = AUDIO_DEFAULT_SAMPLE_RATE, uint16_t frequency = 0) :
-		blocks(streams), format(format), sampleRate(sampleRate), baseFrequency(frequency) {}
+	AudioSample(BufferVector streams, uint8_t format, uint32_t sampleRate = AUDIO_DEFAULT_SAMPLE_RATE, uint16_t frequency = 0);
 	~AudioSample();
 
-	int8_t getSample(uint32_t & index, uint32_t & blockIndex);
-	void seekTo(uint32_t position, uint32_t & index, uint32_t & blockIndex, int32_t & repeatCount);
+	inline int8_t getSample(AudioSamplePosition & position);
+	void seekTo(uint32_t position, AudioSamplePosition & samplePosition, int32_t & repeatCount);
 	uint32_t getSize();
 
 	BufferVector	blocks;
@@ -24,9 +51,61 @@ struct AudioSample {
 	uint16_t		baseFrequency = 0;	// Base frequency of the sample
 	int32_t			repeatStart = 0;	// Start offset for repeat, in samples
 	int32_t			repeatLength = -1;	// Length of the repeat section in samples, -1 means to end of sample
+	uint8_t			signFlip;			// XORed with sample data to make it signed
+	std::vector<AdpcmState, psram_allocator<AdpcmState>> adpcmStates;	// ADPCM decoder state every ADPCM_SEEK_INTERVAL samples
 	// std::unordered_map<uint8_t, std::weak_ptr<AudioChannel>> channels;	// Channels playing this sample
+
+	inline bool nextBlock(AudioSamplePosition & position);
+	void seekToByte(uint32_t offset, AudioSamplePosition & position);
+	bool decodeBlock(AudioSamplePosition & position);
 };
 
+static const int16_t adpcmStepTable[89] = {
+	7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41, 45,
+	50, 55, 60, 66, 73, 80, 88, 97, 107, 118, 130, 143, 157, 173, 190, 209, 230, 253, 279, 307,
+	337, 371, 408, 449, 494, 544, 598, 658, 724, 796, 876, 963, 1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066,
+	2272, 2499, 2749, 3024, 3327, 3660, 4026, 4428, 4871, 5358, 5894, 6484, 7132, 7845, 8630, 9493, 10442, 11487, 12635, 13899,
+	15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767
+};
+
+static const int8_t adpcmIndexTable[8] = { -1, -1, -1, -1, 2, 4, 6, 8 };
+
+// Decode one 4-bit IMA ADPCM code, updating the decoder state
+static inline int16_t decodeAdpcm(AdpcmState & state, uint8_t code) {
+	int32_t step = adpcmStepTable[state.stepIndex];
+	int32_t diff = step >> 3;
+	if (code & 1) diff += step >> 2;
+	if (code & 2) diff += step >> 1;
+	if (code & 4) diff += step;
+	int32_t predictor = state.predictor + ((code & 8) ? -diff : diff);
+	state.predictor = predictor < -32768 ? -32768 : predictor > 32767 ? 32767 : predictor;
+	int32_t stepIndex = state.stepIndex + adpcmIndexTable[code & 7];
+	state.stepIndex = stepIndex < 0 ? 0 : stepIndex > 88 ? 88 : stepIndex;
+	return state.predictor;
+}
+
+AudioSample::AudioSample(BufferVector streams, uint8_t format, uint32_t sampleRate, uint16_t frequency) :
+	blocks(streams), format(format), sampleRate(sampleRate), baseFrequency(frequency),
+	signFlip(format == AUDIO_FORMAT_8BIT_UNSIGNED ? 0x80 : 0)
+{
+	if (format == AUDIO_FORMAT_ADPCM) {
+		// ADPCM can only be decoded from the start, so record the decoder state as we go to allow seeking
+		AdpcmState state;
+		uint32_t count = 0;
+		for (auto &block : blocks) {
+			auto data = block->getBuffer();
+			for (uint32_t i = 0; i < block->size(); i++) {
+				if (count % ADPCM_SEEK_INTERVAL == 0) {
+					adpcmStates.push_back(state);
+				}
+				decodeAdpcm(state, data[i] & 0x0F);
+				decodeAdpcm(state, data[i] >> 4);
+				count += 2;
+			}
+		}
+	}
+}
+
 AudioSample::~AudioSample() {
 	// iterate over channels
 	// for (auto &channelPair : this->channels) {
@@ -40,30 +119,66 @@ AudioSample::~AudioSample() {
 	// }
 }
 
-int8_t AudioSample::getSample(uint32_t & index, uint32_t & blockIndex) {
-	// get the next sample
-	if (blockIndex >= blocks.size()) {
+int8_t AudioSample::getSample(AudioSamplePosition & position) {
+	switch (format) {
+		case AUDIO_FORMAT_16BIT_SIGNED:
+		case AUDIO_FORMAT_ADPCM:
+			if (position.decodedIndex == position.decodedCount && !decodeBlock(position)) {
+				// we've reached the end of the sample, and haven't looped, so return 0 (silence)
+				return 0;
+			}
+			return position.decoded[position.decodedIndex++];
+	}
+
+	if (position.data == position.end && !nextBlock(position)) {
 		// we've reached the end of the sample, and haven't looped, so return 0 (silence)
 		return 0;
 	}
 
-	auto block = blocks[blockIndex];
-	int8_t sample = block->getBuffer()[index++];
+	return *position.data++ ^ signFlip;
+}
 
-	if (index >= block->size()) {
-		// block reached end, move to next block
-		index = 0;
-		blockIndex++;
+// Move on to the next block that has data, returning false at the end of the sample
+bool AudioSample::nextBlock(AudioSamplePosition & position) {
+	while (position.data == position.end) {
+		if (position.nextBlock >= blocks.size()) {
+			return false;
+		}
+		auto block = blocks[position.nextBlock++].get();
+		position.data = block->getBuffer();
+		position.end = position.data + block->size();
 	}
+	return true;
+}
 
-	if (format == AUDIO_FORMAT_8BIT_UNSIGNED) {
-		sample = sample - 128;
+// Decode the next block of 16-bit or ADPCM samples, returning false if there are none left
+bool AudioSample::decodeBlock(AudioSamplePosition & position) {
+	uint8_t count = 0;
+	if (format == AUDIO_FORMAT_16BIT_SIGNED) {
+		// little-endian, rounded to the nearest 8 bit value
+		while (count < SAMPLE_DECODE_BLOCK) {
+			if (position.data == position.end && !nextBlock(position)) break;
+			uint8_t low = *position.data++;
+			if (position.data == position.end && !nextBlock(position)) break;
+			int32_t sample = (int16_t)(low | (*position.data++ << 8));
+			sample = (sample + 0x80) >> 8;
+			position.decoded[count++] = sample > 127 ? 127 : sample;
+		}
+	} else {
+		// two samples per byte, low nibble first
+		while (count < SAMPLE_DECODE_BLOCK) {
+			if (position.data == position.end && !nextBlock(position)) break;
+			uint8_t code = *position.data++;
+			position.decoded[count++] = decodeAdpcm(position.adpcm, code & 0x0F) >> 8;
+			position.decoded[count++] = decodeAdpcm(position.adpcm, code >> 4) >> 8;
+		}
 	}
-
-	return sample;
+	position.decodedIndex = 0;
+	position.decodedCount = count;
+	return count > 0;
 }
 
-void AudioSample::seekTo(uint32_t position, uint32_t & index, uint32_t & blockIndex, int32_t & repeatCount) {
+void AudioSample::seekTo(uint32_t position, AudioSamplePosition & samplePosition, int32_t & repeatCount) {
 	// NB repeatCount calculation here can result in zero, or a negative number,
 	// or a number that's beyond the end of the sample, which is fine
 	// it just means that the sample will never loop
@@ -77,20 +192,66 @@ void AudioSample::seekTo(uint32_t position, uint32_t & index, uint32_t & blockIn
 		repeatCount = 0;
 	}
 
-	blockIndex = 0;
-	index = position;
+	samplePosition.decodedIndex = 0;
+	samplePosition.decodedCount = 0;
+	switch (format) {
+		case AUDIO_FORMAT_16BIT_SIGNED:
+			seekToByte(position * 2, samplePosition);
+			break;
+		case AUDIO_FORMAT_ADPCM: {
+			// start from the nearest recorded decoder state, and decode our way forward from there
+			auto checkpoint = position / ADPCM_SEEK_INTERVAL;
+			if (checkpoint >= adpcmStates.size()) {
+				seekToByte(getSize() / 2, samplePosition);
+				break;
+			}
+			samplePosition.adpcm = adpcmStates[checkpoint];
+			seekToByte(checkpoint * (ADPCM_SEEK_INTERVAL / 2), samplePosition);
+			auto skip = position % ADPCM_SEEK_INTERVAL;
+			while (skip > 0 && decodeBlock(samplePosition)) {
+				samplePosition.decodedIndex = skip < samplePosition.decodedCount ? skip : samplePosition.decodedCount;
+				skip -= samplePosition.decodedIndex;
+			}
+		}	break;
+		default:
+			seekToByte(position, samplePosition);
+			break;
+	}
+}
+
+// Point a position at a byte offset within the sample data
+void AudioSample::seekToByte(uint32_t offset, AudioSamplePosition & position) {
+	uint32_t blockIndex = 0;
+	uint32_t index = offset;
 	while (blockIndex < blocks.size() && index >= blocks[blockIndex]->size()) {
 		index -= blocks[blockIndex]->size();
 		blockIndex++;
 	}
+
+	if (blockIndex < blocks.size()) {
+		auto block = blocks[blockIndex].get();
+		position.data = block->getBuffer() + index;
+		position.end = block->getBuffer() + block->size();
+		position.nextBlock = blockIndex + 1;
+	} else {
+		position.data = nullptr;
+		position.end = nullptr;
+		position.nextBlock = blockIndex;
+	}
 }
 
 uint32_t AudioSample::getSize() {
-	uint32_t samples = 0;
-	for (auto block : blocks) {
-		samples += block->size();
+	uint32_t bytes = 0;
+	for (auto &block : blocks) {
+		bytes += block->size();
+	}
+	switch (format) {
+		case AUDIO_FORMAT_16BIT_SIGNED:
+			return bytes / 2;
+		case AUDIO_FORMAT_ADPCM:
+			return bytes * 2;
 	}
-	return samples;
+	return bytes;
 }
 
 #endif // AUDIO_SAMPLE_H
@@ -0,0 +1,286 @@
+#ifndef BLOCK_WAVEFORM_GENERATOR_H
+#define BLOCK_WAVEFORM_GENERATOR_H
+
+#include <algorithm>
+#include <cstring>
+#include <fabgl.h>
+
+// Number of output samples rendered at a time
+#define WAVEFORM_RENDER_BLOCK	16
+// Oscillator phase, holding 8 bits of waveform index and 11 bits of fraction
+#define OSCILLATOR_PHASE_MASK	0x7FFFF
+
+// Waveform generator that renders its output a block at a time
+// The sound generator still asks for one sample at a time, so these are served from the last block rendered.
+// Subclasses render full volume samples, and the volume is ramped linearly across each block,
+// so envelope steps between blocks don't click
+//
+class BlockWaveformGenerator : public WaveformGenerator {
+	public:
+		int getSample();
+
+		// Render the next n samples at full volume
+		virtual void render(int8_t * out, int n) = 0;
+
+		// Called as a note starts, after its initial volume and frequency are set
+		virtual void startNote();
+
+	protected:
+		// Drop anything rendered ahead, and start again at the current volume
+		void restartRender();
+
+	private:
+		int8_t		renderBuffer[WAVEFORM_RENDER_BLOCK];	// Output samples rendered ahead of getSample
+		int			renderIndex = WAVEFORM_RENDER_BLOCK;	// Next sample to return from renderBuffer
+		int32_t		renderGain = 0;							// Gain reached at the end of the last rendered block
+		int			renderCount = 0;						// Samples in the last rendered block, to count against the duration
+
+		void renderBlock();
+
+		static int32_t volumeGain(int volume);
+};
+
+int BlockWaveformGenerator::getSample() {
+	if (renderIndex == WAVEFORM_RENDER_BLOCK) {
+		renderBlock();
+	}
+	return renderBuffer[renderIndex++];
+}
+
+// Render the next block, scaled to the volume
+// A finite duration is counted down as each block is used up, and its last block is shortened to end with it
+void BlockWaveformGenerator::renderBlock() {
+	int remaining = duration();
+	if (remaining > 0) {
+		remaining = std::max(remaining - renderCount, 0);
+		setDuration(remaining);
+	}
+	if (remaining == 0) {
+		memset(renderBuffer, 0, WAVEFORM_RENDER_BLOCK);
+		renderIndex = 0;
+		renderCount = 0;
+		return;
+	}
+
+	render(renderBuffer, WAVEFORM_RENDER_BLOCK);
+
+	int32_t targetGain = volumeGain(volume());
+	if (targetGain == renderGain) {
+		for (auto i = 0; i < WAVEFORM_RENDER_BLOCK; i++) {
+			renderBuffer[i] = renderBuffer[i] * targetGain / 65536;
+		}
+	} else {
+		// Ramp the gain across the block
+		int32_t gainChange = targetGain - renderGain;
+		for (auto i = 0; i < WAVEFORM_RENDER_BLOCK; i++) {
+			int32_t gain = renderGain + gainChange * (i + 1) / WAVEFORM_RENDER_BLOCK;
+			renderBuffer[i] = renderBuffer[i] * gain / 65536;
+		}
+		renderGain = targetGain;
+	}
+
+	renderIndex = 0;
+	renderCount = WAVEFORM_RENDER_BLOCK;
+	if (remaining > 0 && remaining < WAVEFORM_RENDER_BLOCK) {
+		// move what's left of the duration to the end of the buffer, so the block is used up as it ends
+		renderIndex = WAVEFORM_RENDER_BLOCK - remaining;
+		renderCount = remaining;
+		memmove(renderBuffer + renderIndex, renderBuffer, remaining);
+	}
+}
+
+void BlockWaveformGenerator::startNote() {
+	restartRender();
+}
+
+void BlockWaveformGenerator::restartRender() {
+	renderIndex = WAVEFORM_RENDER_BLOCK;
+	renderCount = 0;
+	renderGain = volumeGain(volume());
+}
+
+// Volume / 127 in 16.16 fixed point
+// Rounded up, so that a steady volume scales a sample exactly as sample * volume / 127 would
+int32_t BlockWaveformGenerator::volumeGain(int volume) {
+	return (volume * 65536 + 126) / 127;
+}
+
+// Base for the simple waveforms, which step an 8-bit waveform index with an 8.11 fixed point phase accumulator,
+// as the vdp-gl generators do
+//
+class BlockOscillator : public BlockWaveformGenerator {
+	public:
+		void setFrequency(int value) {
+			frequency = value;
+			updatePhaseStep();
+		}
+
+		void setSampleRate(int value) {
+			WaveformGenerator::setSampleRate(value);
+			updatePhaseStep();
+		}
+
+	protected:
+		int			frequency = 0;
+		uint32_t	phase = 0;
+		uint32_t	phaseStep = 0;
+
+	private:
+		void updatePhaseStep() {
+			phaseStep = (((uint64_t)frequency * 256) << 11) / sampleRate();
+		}
+};
+
+// Square wave, high whilst the waveform index is up to the duty cycle
+//
+class BlockSquareGenerator : public BlockOscillator {
+	public:
+		void setDutyCycle(int value) {
+			dutyCycle = value;
+		}
+
+		void render(int8_t * out, int n) {
+			if (frequency == 0) {
+				memset(out, 0, n);
+				phase = 0;
+				return;
+			}
+			auto p = phase;
+			for (auto i = 0; i < n; i++) {
+				out[i] = ((p >> 11) & 0xFF) <= dutyCycle ? 127 : -127;
+				p += phaseStep;
+			}
+			phase = p & OSCILLATOR_PHASE_MASK;
+		}
+
+	private:
+		uint32_t	dutyCycle = 127;
+};
+
+static const int8_t blockSineTable[256] = {
+	0, 3, 6, 9, 12, 16, 19, 22, 25, 28, 31, 34, 37, 40, 43, 46,
+	49, 51, 54, 57, 60, 63, 65, 68, 71, 73, 76, 78, 81, 83, 85, 88,
+	90, 92, 94, 96, 98, 100, 102, 104, 106, 107, 109, 111, 112, 113, 115, 116,
+	117, 118, 120, 121, 122, 122, 123, 124, 125, 125, 126, 126, 126, 127, 127, 127,
+	127, 127, 127, 127, 126, 126, 126, 125, 125, 124, 123, 122, 122, 121, 120, 118,
+	117, 116, 115, 113, 112, 111, 109, 107, 106, 104, 102, 100, 98, 96, 94, 92,
+	90, 88, 85, 83, 81, 78, 76, 73, 71, 68, 65, 63, 60, 57, 54, 51,
+	49, 46, 43, 40, 37, 34, 31, 28, 25, 22, 19, 16, 12, 9, 6, 3,
+	0, -3, -6, -9, -12, -16, -19, -22, -25, -28, -31, -34, -37, -40, -43, -46,
+	-49, -51, -54, -57, -60, -63, -65, -68, -71, -73, -76, -78, -81, -83, -85, -88,
+	-90, -92, -94, -96, -98, -100, -102, -104, -106, -107, -109, -111, -112, -113, -115, -116,
+	-117, -118, -120, -121, -122, -122, -123, -124, -125, -125, -126, -126, -126, -127, -127, -127,
+	-127, -127, -127, -127, -126, -126, -126, -125, -125, -124, -123, -122, -122, -121, -120, -118,
+	-117, -116, -115, -113, -112, -111, -109, -107, -106, -104, -102, -100, -98, -96, -94, -92,
+	-90, -88, -85, -83, -81, -78, -76, -73, -71, -68, -65, -63, -60, -57, -54, -51,
+	-49, -46, -43, -40, -37, -34, -31, -28, -25, -22, -19, -16, -12, -9, -6, -3
+};
+
+// Sine wave, from a table of one cycle
+//
+class BlockSineGenerator : public BlockOscillator {
+	public:
+		void render(int8_t * out, int n) {
+			if (frequency == 0) {
+				memset(out, 0, n);
+				phase = 0;
+				return;
+			}
+			auto p = phase;
+			for (auto i = 0; i < n; i++) {
+				out[i] = blockSineTable[(p >> 11) & 0xFF];
+				p += phaseStep;
+			}
+			phase = p & OSCILLATOR_PHASE_MASK;
+		}
+};
+
+// Triangle wave, rising for the first half of the cycle and falling for the second
+//
+class BlockTriangleGenerator : public BlockOscillator {
+	public:
+		void render(int8_t * out, int n) {
+			if (frequency == 0) {
+				memset(out, 0, n);
+				phase = 0;
+				return;
+			}
+			auto p = phase;
+			for (auto i = 0; i < n; i++) {
+				int index = (p >> 11) & 0xFF;
+				out[i] = index < 128 ? index * 2 - 127 : 383 - index * 2;
+				p += phaseStep;
+			}
+			phase = p & OSCILLATOR_PHASE_MASK;
+		}
+};
+
+// Sawtooth wave, rising across the cycle
+//
+class BlockSawtoothGenerator : public BlockOscillator {
+	public:
+		void render(int8_t * out, int n) {
+			if (frequency == 0) {
+				memset(out, 0, n);
+				phase = 0;
+				return;
+			}
+			auto p = phase;
+			for (auto i = 0; i < n; i++) {
+				out[i] = (int)((p >> 11) & 0xFF) - 128;
+				p += phaseStep;
+			}
+			phase = p & OSCILLATOR_PHASE_MASK;
+		}
+};
+
+// White noise, from a 16-bit Galois LFSR as vdp-gl uses, which doesn't depend on the frequency
+//
+class BlockNoiseGenerator : public BlockWaveformGenerator {
+	public:
+		void setFrequency(int value) {}
+
+		void render(int8_t * out, int n) {
+			auto lfsr = noise;
+			for (auto i = 0; i < n; i++) {
+				lfsr = (lfsr >> 1) ^ (-(lfsr & 1) & 0xB400u);
+				out[i] = 127 - (lfsr >> 8);
+			}
+			noise = lfsr;
+		}
+
+	private:
+		uint16_t	noise = 0xFAB7;
+};
+
+// Block rendering for a vdp-gl waveform generator that has no block renderer of its own
+// The generator is kept at full volume, and called directly in a loop rather than through the sound generator
+//
+template <class Generator>
+class BlockWaveformSource : public BlockWaveformGenerator {
+	public:
+		BlockWaveformSource() {
+			_source.setVolume(127);
+			_source.enable(true);
+		}
+
+		void setFrequency(int value) {
+			_source.setFrequency(value);
+		}
+
+		void setSampleRate(int value) {
+			WaveformGenerator::setSampleRate(value);
+			_source.setSampleRate(value);
+		}
+
+		void render(int8_t * out, int n) {
+			for (auto i = 0; i < n; i++) {
+				out[i] = _source.getSample();
+			}
+		}
+
+	private:
+		Generator	_source;
+};
+
+#endif // BLOCK_WAVEFORM_GENERATOR_H
@@ -1,6 +1,7 @@
 #ifndef BUFFERS_H
 #define BUFFERS_H
 
+#include <algorithm>
 #include <memory>
 #include <vector>
 #include <unordered_map>
@@ -12,7 +13,121 @@
 #include "span.h"
 #include "types.h"
 
-using BufferVector = std::vector<std::shared_ptr<BufferStream>, psram_allocator<std::shared_ptr<BufferStream>>>;
+// Block lists up to this long are walked, rather than searched through the offset index
+#define BUFFER_LINEAR_SEARCH_BLOCKS	16
+
+// A list of buffer blocks, with a cumulative offset index
+// The index is rebuilt lazily after the block list changes, and extended in place as blocks are appended
+// Blocks can only be read through this class, so every change to the list goes through a method that keeps the index in step
+class BufferVector {
+	using BlockList = std::vector<std::shared_ptr<BufferStream>, psram_allocator<std::shared_ptr<BufferStream>>>;
+	public:
+		using value_type = BlockList::value_type;
+		using const_iterator = BlockList::const_iterator;
+
+		BufferVector() = default;
+		template <class InputIt>
+		BufferVector(InputIt first, InputIt last) : blocks(first, last) {}
+
+		size_t size() const { return blocks.size(); }
+		bool empty() const { return blocks.empty(); }
+		const value_type &operator[](size_t index) const { return blocks[index]; }
+		const value_type &front() const { return blocks.front(); }
+		const value_type &back() const { return blocks.back(); }
+		const_iterator begin() const { return blocks.begin(); }
+		const_iterator end() const { return blocks.end(); }
+
+		void push_back(const value_type &block) {
+			blocks.push_back(block);
+			appendToIndex();
+		}
+		void push_back(value_type &&block) {
+			blocks.push_back(std::move(block));
+			appendToIndex();
+		}
+		void clear() {
+			blocks.clear();
+			indexValid = false;
+		}
+		template <class InputIt>
+		void assign(InputIt first, InputIt last) {
+			blocks.assign(first, last);
+			indexValid = false;
+		}
+		template <class InputIt>
+		const_iterator insert(const_iterator position, InputIt first, InputIt last) {
+			auto result = blocks.insert(position, first, last);
+			indexValid = false;
+			return result;
+		}
+		const_iterator erase(const_iterator first, const_iterator last) {
+			auto result = blocks.erase(first, last);
+			indexValid = false;
+			return result;
+		}
+		void reverse() {
+			std::reverse(blocks.begin(), blocks.end());
+			indexValid = false;
+		}
+		void swap(BufferVector &other) {
+			blocks.swap(other.blocks);
+			offsets.swap(other.offsets);
+			std::swap(indexValid, other.indexValid);
+		}
+
+		// Total number of bytes across all blocks
+		uint32_t totalSize() const {
+			buildIndex();
+			return offsets.back();
+		}
+		// Offset of the start of a block from the start of the buffer
+		uint32_t blockStart(size_t blockIndex) const {
+			buildIndex();
+			return offsets[std::min(blockIndex, size())];
+		}
+		// Find the block containing the given offset from the start of the buffer
+		// Returns size() if the offset is past the end of the buffer
+		size_t findBlock(uint32_t position) const {
+			buildIndex();
+			// first block starting after our position, less one, skipping any empty blocks
+			auto next = offsets.begin() + 1;
+			if (blocks.size() <= BUFFER_LINEAR_SEARCH_BLOCKS) {
+				// short lists are quicker to scan than to search
+				while (next != offsets.end() && *next <= position) {
+					next++;
+				}
+			} else {
+				next = std::upper_bound(next, offsets.end(), position);
+			}
+			return next - offsets.begin() - 1;
+		}
+
+	private:
+		BlockList blocks;
+		// offsets[i] is the start of block i, with one extra entry holding the total size
+		mutable std::vector<uint32_t, psram_allocator<uint32_t>> offsets;
+		mutable bool indexValid = false;
+
+		void buildIndex() const {
+			if (indexValid) {
+				return;
+			}
+			offsets.resize(blocks.size() + 1);
+			uint32_t offset = 0;
+			for (size_t i = 0; i < blocks.size(); i++) {
+				offsets[i] = offset;
+				offset += blocks[i]->size();
+			}
+			offsets[blocks.size()] = offset;
+			indexValid = true;
+		}
+		void appendToIndex() {
+			if (indexValid) {
+				offsets.push_back(offsets.back() + blocks.back()->size());
+			}
+		}
+};
+
 std::unordered_map<uint16_t, BufferVector, std::hash<uint16_t>, std::equal_to<uint16_t>, psram_allocator<std::pair<const uint16_t, BufferVector>>> buffers;
 std::unordered_map<uint16_t, std::unordered_set<uint16_t>> callbackBuffers;
 
@@ -21,6 +136,50 @@ struct AdvancedOffset {
 	size_t blockIndex = 0;
 };
 
+// A single command recorded from a buffer call
+// Commands with fixed-length arguments are fully decoded, and can be dispatched without reading the buffer
+// Other commands are replayed from the buffer, and must finish at the recorded end position
+struct CachedCommand {
+	uint8_t command = 0;			// VDU command byte
+	uint8_t args[5] = {};			// Argument bytes (decoded commands only)
+	bool decoded = false;			// Whether the arguments were fully decoded
+	AdvancedOffset end;				// Stream position after this command
+};
+
+// Pre-decoded command list for a buffer, recorded the first time it is called
+struct CommandCache {
+	AdvancedOffset start;			// Stream position the commands were recorded from
+	std::vector<std::weak_ptr<BufferStream>, psram_allocator<std::weak_ptr<BufferStream>>> blocks;	// Blocks the commands were decoded from
+	std::vector<CachedCommand, psram_allocator<CachedCommand>> commands;
+	bool complete = false;			// Recording has finished
+	bool valid = true;				// Cleared if the underlying buffer data changes
+
+	bool matches(const BufferVector &buffer, const AdvancedOffset &offset) const {
+		if (offset.blockOffset != start.blockOffset || offset.blockIndex != start.blockIndex || buffer.size() != blocks.size()) {
+			return false;
+		}
+		for (size_t i = 0; i < blocks.size(); i++) {
+			if (!sameBlock(blocks[i], buffer[i])) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	bool usesBlock(const std::shared_ptr<BufferStream> &block) const {
+		return std::any_of(blocks.begin(), blocks.end(), [&block](const std::weak_ptr<BufferStream> &cached) {
+			return sameBlock(cached, block);
+		});
+	}
+
+	// Blocks are compared by owner rather than address, so a new block allocated where a freed one used to be won't match
+	static bool sameBlock(const std::weak_ptr<BufferStream> &cached, const std::shared_ptr<BufferStream> &block) {
+		return !cached.owner_before(block) && !block.owner_before(cached);
+	}
+};
+
+std::unordered_map<uint16_t, std::shared_ptr<CommandCache>, std::hash<uint16_t>, std::equal_to<uint16_t>, psram_allocator<std::pair<const uint16_t, std::shared_ptr<CommandCache>>>> commandCaches;
+
 typedef union {
 	struct {
 		uint8_t rows : 4;
@@ -55,6 +214,40 @@ int32_t resolveBufferId(int32_t bufferId, uint16_t currentId) {
 	return bufferId;
 }
 
+// Drop the command cache for a buffer
+void clearCommandCache(uint16_t bufferId) {
+	auto cacheIter = commandCaches.find(bufferId);
+	if (cacheIter != commandCaches.end()) {
+		cacheIter->second->valid = false;
+		commandCaches.erase(cacheIter);
+	}
+}
+
+// Drop all command caches
+void clearCommandCaches() {
+	for (auto &cache : commandCaches) {
+		cache.second->valid = false;
+	}
+	commandCaches.clear();
+}
+
+// Drop any command caches decoded from blocks in the given buffer
+// Must be called before the contents of a buffer are changed in-place, as blocks may be shared between buffers
+void invalidateCommandCaches(const BufferVector &buffer) {
+	for (auto cacheIter = commandCaches.begin(); cacheIter != commandCaches.end();) {
+		auto &cache = cacheIter->second;
+		bool usesBuffer = std::any_of(buffer.begin(), buffer.end(), [&cache](const std::shared_ptr<BufferStream> &block) {
+			return cache->usesBlock(block);
+		});
+		if (usesBuffer) {
+			cache->valid = false;
+			cacheIter = commandCaches.erase(cacheIter);
+		} else {
+			cacheIter++;
+		}
+	}
+}
+
 // Reverse values in a buffer
 void reverseValues(uint8_t * data, uint32_t length, uint16_t valueSize) {
 	// get last offset into buffer
@@ -195,6 +388,13 @@ void extractFormatInfo(uint8_t format, bool &isFixed, bool &is16Bit, int8_t &shi
 // Get the longest contiguous span at the given buffer offset. Updates the offset to the correct block index.
 // accepts a size to dictate the minimum span size, and will align offset if block didn't contain the required size of data
 tcb::span<uint8_t> getBufferSpan(const BufferVector &buffer, AdvancedOffset &offset, uint8_t size = 1) {
+	if (buffer.size() > BUFFER_LINEAR_SEARCH_BLOCKS && offset.blockIndex < buffer.size()
+		&& offset.blockOffset >= buffer[offset.blockIndex]->size()) {
+		// offset is beyond the current block, so use the index to jump to the block containing it
+		auto position = buffer.blockStart(offset.blockIndex) + offset.blockOffset;
+		offset.blockIndex = buffer.findBlock(position);
+		offset.blockOffset = position - buffer.blockStart(offset.blockIndex);
+	}
 	while (offset.blockIndex < buffer.size()) {
 		// check for available bytes in the current block
 		auto &block = buffer[offset.blockIndex];
@@ -25,9 +25,10 @@ extern void debug_log(const char * format, ...);		// Debug log function
 #define COMPRESSION_WINDOW_SIZE 256     // power of 2
 #define COMPRESSION_STRING_SIZE 16      // power of 2
 #define COMPRESSION_TYPE_TURBO  'T'     // TurboVega-style compression
+#define COMPRESSION_TYPE_LZ     'L'     // LZ4-style byte-aligned compression
 #define TEMP_BUFFER_SIZE        256
 
-#define COMPRESSION_OUTPUT_CHUNK_SIZE	1024 // used to extend temporary buffer
+#define COMPRESSION_HASH_BYTES  4       // bytes hashed at each window position (shortest string size)
 
 #pragma pack(push, 1)
 typedef struct {
@@ -52,9 +53,10 @@ typedef struct {
     uint32_t            input_count;
     uint32_t            output_count;
     uint8_t             window_data[COMPRESSION_WINDOW_SIZE];
+    uint8_t             window_hash[COMPRESSION_WINDOW_SIZE];  // hash of the bytes starting at each window index
     uint8_t             string_data[COMPRESSION_STRING_SIZE];
     uint8_t             temp_buffer[TEMP_BUFFER_SIZE];
-    uint8_t             out_byte;
+    uint32_t            out_code;
     uint8_t             out_bits;
 } CompressionData;
 
@@ -68,52 +70,49 @@ typedef struct {
     uint32_t            orig_size;
     uint8_t             window_data[COMPRESSION_WINDOW_SIZE];
     uint8_t             temp_buffer[TEMP_BUFFER_SIZE];
-    uint16_t            code;
+    uint32_t            code;
     uint8_t             code_bits;
 } DecompressionData;
 
+// Largest possible compressed size for the given original size, including the header
+// (every byte may need to be output as a 10-bit literal code)
+//
+uint32_t agon_max_compressed_size(uint32_t orig_size) {
+    return sizeof(CompressionFileHeader) + (orig_size * 10 + 7) / 8;
+}
+
 void agon_init_compression(CompressionData* cd, void* context, WriteCompressedByte write_fcn) {
     memset(cd, 0, sizeof(CompressionData));
     cd->context = context;
     cd->write_fcn = write_fcn;
 }
 
-void agon_write_compressed_bit(CompressionData* cd, uint8_t comp_bit) {
-    cd->out_byte = (cd->out_byte << 1) | comp_bit;
-    if (++(cd->out_bits) >= 8) {
-        (*cd->write_fcn)(cd, cd->out_byte);
-        cd->out_byte = 0;
-        cd->out_bits = 0;
+// Write the lowest code_bits bits of a code, flushing whole bytes as they become available
+//
+inline void agon_write_compressed_code(CompressionData* cd, uint32_t code, uint8_t code_bits) {
+    cd->out_code = (cd->out_code << code_bits) | code;
+    cd->out_bits += code_bits;
+    while (cd->out_bits >= 8) {
+        cd->out_bits -= 8;
+        (*cd->write_fcn)(cd, (uint8_t) (cd->out_code >> cd->out_bits));
     }
 }
 
+void agon_write_compressed_bit(CompressionData* cd, uint8_t comp_bit) {
+    agon_write_compressed_code(cd, comp_bit, 1);
+}
+
 void agon_write_compressed_byte(CompressionData* cd, uint8_t comp_byte) {
-    for (uint8_t bit = 0; bit < 8; bit++) {
-        agon_write_compressed_bit(cd, (comp_byte & 0x80) ? 1 : 0);
-        comp_byte <<= 1;
-    }
+    agon_write_compressed_code(cd, comp_byte, 8);
 }
 
 // Write compressed output to a temporary buffer
+// The buffer must have been allocated with agon_max_compressed_size bytes
 //
 static void local_write_compressed_byte(void* p_cd, uint8_t comp_byte) {
 	CompressionData* cd = (CompressionData*) p_cd;
-    uint8_t** pp_temp = (uint8_t**) cd->context;
-	uint8_t* p_temp = *pp_temp;
+	uint8_t* p_temp = *(uint8_t**) cd->context;
 	p_temp[cd->output_count++] = comp_byte;
-	if (!(cd->output_count & (COMPRESSION_OUTPUT_CHUNK_SIZE-1))) {
-		// extend the temporary buffer to make room for more output
-		auto new_size = cd->output_count + COMPRESSION_OUTPUT_CHUNK_SIZE;
-		uint8_t* p_temp2 = (uint8_t*) ps_malloc(new_size);
-		if (p_temp2) {
-			memcpy(p_temp2, p_temp, cd->output_count);
-			*pp_temp = p_temp2; // use new buffer pointer now
-		} else {
-			debug_log("bufferCompress: cannot allocate temporary buffer of %d bytes\n\r", new_size);
-			*pp_temp = NULL; // indicate failure
-		}
-		heap_caps_free(p_temp);
-	}
 }
 
 // Write decompressed output to a temporary buffer
@@ -129,6 +128,57 @@ static bool local_write_decompressed_byte(void* p_dd, uint8_t orig_data) {
     return true;
 }
 
+inline uint8_t agon_compression_hash(const uint8_t* data) {
+    uint32_t value = data[0] | (data[1] << 8) | (data[2] << 16) | (data[3] << 24);
+    return (uint8_t) ((value * 2654435761u) >> 24);
+}
+
+// Update the hashes of the window indexes whose first bytes include the given window index
+//
+void agon_update_window_hash(CompressionData* cd, uint32_t index) {
+    uint32_t first = index >= COMPRESSION_HASH_BYTES - 1 ? index - (COMPRESSION_HASH_BYTES - 1) : 0;
+    for (uint32_t start = first; start <= index && start + COMPRESSION_HASH_BYTES <= cd->window_size; start++) {
+        cd->window_hash[start] = agon_compression_hash(&cd->window_data[start]);
+    }
+}
+
+// Find the longest of the 16, 8 or 4 byte strings at the start of the string data in the window
+// Returns the match size, or 0 if none was found, with the lowest matching window index in match_index
+//
+uint8_t agon_find_match(CompressionData* cd, uint32_t& match_index) {
+    if (cd->window_size < COMPRESSION_HASH_BYTES) {
+        return 0;
+    }
+    // unwrap the string so it can be compared directly against the window
+    uint8_t string_data[COMPRESSION_STRING_SIZE];
+    uint32_t first_part = COMPRESSION_STRING_SIZE - cd->string_read_index;
+    memcpy(string_data, &cd->string_data[cd->string_read_index], first_part);
+    memcpy(&string_data[first_part], cd->string_data, cd->string_read_index);
+
+    // every match must start at an index whose hash matches the first bytes of the string
+    uint8_t hash = agon_compression_hash(string_data);
+    uint8_t match_size = 0;
+    const uint8_t* window_start = cd->window_data;
+    const uint8_t* candidate = cd->window_hash;
+    const uint8_t* candidates_end = cd->window_hash + cd->window_size - COMPRESSION_HASH_BYTES + 1;
+    while ((candidate = (const uint8_t*) memchr(candidate, hash, candidates_end - candidate))) {
+        uint32_t start = candidate++ - cd->window_hash;
+        uint32_t available = cd->window_size - start;
+        if (available >= 16 && !memcmp(window_start + start, string_data, 16)) {
+            match_index = start;
+            return 16;
+        }
+        if (match_size < 8 && available >= 8 && !memcmp(window_start + start, string_data, 8)) {
+            match_index = start;
+            match_size = 8;
+        } else if (match_size < 4 && !memcmp(window_start + start, string_data, 4)) {
+            match_index = start;
+            match_size = 4;
+        }
+    }
+    return match_size;
+}
+
 void agon_compress_byte(CompressionData* cd, uint8_t orig_byte) {
     // Add the new original byte to the string
     cd->string_data[cd->string_write_index++] = orig_byte;
@@ -140,107 +190,49 @@ void agon_compress_byte(CompressionData* cd, uint8_t orig_byte) {
     }
 
     if (cd->string_size >= 16) {
-        if (cd->window_size >= 16) {
-            // Determine whether the full string of 16 is in the window
-            for (uint32_t start = 0; start <= cd->window_size - 16; start++) {
-                uint32_t wi = start;
-                uint32_t si = cd->string_read_index;
-                uint8_t match = 1;
-                for (uint8_t i = 0; i < 16; i++) {
-                    if (cd->window_data[wi++] != cd->string_data[si++]) {
-                        match = 0;
-                        break;
-                    }
-                    wi &= (COMPRESSION_WINDOW_SIZE - 1);
-                    si &= (COMPRESSION_STRING_SIZE - 1);
-                }
-                if (match) {
-                    agon_write_compressed_bit(cd, 1); // Output first '1' of '11iiiiiiii'.
-                    agon_write_compressed_bit(cd, 1); // Output second '1' of '11iiiiiiii'.
-                    agon_write_compressed_byte(cd, (uint8_t) (start)); // Output window index
-                    cd->string_size = 0;
-                    return;
-                }
-            }
-        }
-
-        if (cd->window_size >= 8) {
-            // Determine whether the partial string of 8 is in the window
-            for (uint32_t start = 0; start <= cd->window_size - 8; start++) {
-                uint32_t wi = start;
-                uint32_t si = cd->string_read_index;
-                uint8_t match = 1;
-                for (uint8_t i = 0; i < 8; i++) {
-                    if (cd->window_data[wi++] != cd->string_data[si++]) {
-                        match = 0;
-                        break;
-                    }
-                    wi &= (COMPRESSION_WINDOW_SIZE - 1);
-                    si &= (COMPRESSION_STRING_SIZE - 1);
-                }
-                if (match) {
-                    agon_write_compressed_bit(cd, 1); // Output '1' of '10iiiiiiii'.
-                    agon_write_compressed_bit(cd, 0); // Output '0' of '10iiiiiiii'.
-                    agon_write_compressed_byte(cd, (uint8_t) (start)); // Output window index
-                    cd->string_size -= 8;
-                    cd->string_read_index = (cd->string_read_index + 8) & (COMPRESSION_STRING_SIZE - 1);
-                    return;
-                }
-            }
-        }
-            
-        if (cd->window_size >= 4) {
-            // Determine whether the partial string of 4 is in the window
-            for (uint32_t start = 0; start <= cd->window_size - 4; start++) {
-                uint32_t wi = start;
-                uint32_t si = cd->string_read_index;
-                uint8_t match = 1;
-                for (uint8_t i = 0; i < 4; i++) {
-                    if (cd->window_data[wi++] != cd->string_data[si++]) {
-                        match = 0;
-                        break;
-                    }
-                    wi &= (COMPRESSION_WINDOW_SIZE - 1);
-                    si &= (COMPRESSION_STRING_SIZE - 1);
-                }
-                if (match) {
-                    agon_write_compressed_bit(cd, 0); // Output '0' of '01iiiiiiii'.
-                    agon_write_compressed_bit(cd, 1); // Output '1' of '01iiiiiiii'.
-                    agon_write_compressed_byte(cd, (uint8_t) (start)); // Output window index
-                    cd->string_size -= 4;
-                    cd->string_read_index = (cd->string_read_index + 4) & (COMPRESSION_STRING_SIZE - 1);
-                    return;
-                }
-            }
+        uint32_t start;
+        switch (agon_find_match(cd, start)) {
+            case 16:
+                agon_write_compressed_code(cd, 0x300 | start, 10); // Output '11iiiiiiii'
+                cd->string_size = 0;
+                return;
+            case 8:
+                agon_write_compressed_code(cd, 0x200 | start, 10); // Output '10iiiiiiii'
+                cd->string_size -= 8;
+                cd->string_read_index = (cd->string_read_index + 8) & (COMPRESSION_STRING_SIZE - 1);
+                return;
+            case 4:
+                agon_write_compressed_code(cd, 0x100 | start, 10); // Output '01iiiiiiii'
+                cd->string_size -= 4;
+                cd->string_read_index = (cd->string_read_index + 4) & (COMPRESSION_STRING_SIZE - 1);
+                return;
         }
 
         // Need to make room in the string for the next original byte
         uint8_t old_byte = cd->string_data[cd->string_read_index++];
-        agon_write_compressed_bit(cd, 0); // Output '0' of '00xxxxxxxx'.
-        agon_write_compressed_bit(cd, 0); // Output '0' of '00xxxxxxxx'.
-        agon_write_compressed_byte(cd, (uint8_t) (old_byte)); // Output old original byte
+        agon_write_compressed_code(cd, old_byte, 10); // Output '00xxxxxxxx'
         cd->string_size -= 1;
         cd->string_read_index &= (COMPRESSION_STRING_SIZE - 1);
 
         // Add the old original byte to the window
-        cd->window_data[cd->window_write_index++] = old_byte;
+        auto index = cd->window_write_index++;
+        cd->window_data[index] = old_byte;
         cd->window_write_index &= (COMPRESSION_WINDOW_SIZE - 1);
         if (cd->window_size < COMPRESSION_WINDOW_SIZE) {
             (cd->window_size)++;
         }
+        agon_update_window_hash(cd, index);
     }
 }
 
 void agon_finish_compression(CompressionData* cd) {
     while (cd->string_size) {
-        agon_write_compressed_bit(cd, 0); // Output '0' of '00xxxxxxxx'.
-        agon_write_compressed_bit(cd, 0); // Output '0' of '00xxxxxxxx'.
-        agon_write_compressed_byte(cd, (uint8_t) (cd->string_data[cd->string_read_index++])); // Output orig byte
+        agon_write_compressed_code(cd, cd->string_data[cd->string_read_index++], 10); // Output '00xxxxxxxx'
         cd->string_size -= 1;
         cd->string_read_index &= (COMPRESSION_STRING_SIZE - 1);
     }
     if (cd->out_bits) {
-        (*cd->write_fcn)(cd, (cd->out_byte << (8 - cd->out_bits))); // Output final bits
+        (*cd->write_fcn)(cd, (uint8_t) (cd->out_code << (8 - cd->out_bits))); // Output final bits
     }
 }
 
@@ -252,57 +244,245 @@ void agon_init_decompression(DecompressionData* dd, void* context, WriteDecompre
 }
 
 void agon_decompress_byte(DecompressionData* dd, uint8_t comp_byte) {
-    for (uint8_t bit = 0; bit < 8; bit++) {
-        dd->code = (dd->code << 1) | ((comp_byte & 0x80) ? 1 : 0);
-        comp_byte <<= 1;
-        if (++(dd->code_bits) >= 10) {
-            // Interpret the incoming code
-            uint16_t command = (dd->code >> 8);
-            uint8_t value = (uint8_t)dd->code;
-            dd->code = 0;
-            dd->code_bits = 0;
-            uint8_t size;
-
-            switch (command)
-            {
-            case 0: // value is copy of original byte
-                // Add the new decompressed byte to the window
-                dd->window_data[dd->window_write_index++] = value;
-                dd->window_write_index &= (COMPRESSION_WINDOW_SIZE - 1);
-                if (dd->window_size < COMPRESSION_WINDOW_SIZE) {
-                    (dd->window_size)++;
-                }
-                (*(dd->write_fcn))(dd, value);
-                continue;
-
-            case 1: // value is index to string of 4 bytes
-                size = 4;
-                break;
-
-            case 2: // value is index to string of 8 bytes
-                size = 8;
-                break;
-
-            case 3: // value is index to string of 16 bytes
-                size = 16;
-                break;
+    dd->code = (dd->code << 8) | comp_byte;
+    dd->code_bits += 8;
+    while (dd->code_bits >= 10) {
+        // Interpret the next incoming code
+        dd->code_bits -= 10;
+        uint16_t command = (dd->code >> (dd->code_bits + 8)) & 3;
+        uint8_t value = (uint8_t) (dd->code >> dd->code_bits);
+        uint8_t size;
+
+        switch (command)
+        {
+        case 0: // value is copy of original byte
+            // Add the new decompressed byte to the window
+            dd->window_data[dd->window_write_index++] = value;
+            dd->window_write_index &= (COMPRESSION_WINDOW_SIZE - 1);
+            if (dd->window_size < COMPRESSION_WINDOW_SIZE) {
+                (dd->window_size)++;
             }
+            (*(dd->write_fcn))(dd, value);
+            continue;
+
+        case 1: // value is index to string of 4 bytes
+            size = 4;
+            break;
+
+        case 2: // value is index to string of 8 bytes
+            size = 8;
+            break;
+
+        default: // value is index to string of 16 bytes
+            size = 16;
+            break;
+        }
+
+        // Extract a byte string from the window
+        uint32_t wi = value;
+        for (uint8_t si = 0; si < size; si++) {
+            uint8_t out_byte = dd->window_data[wi++];
+            wi &= (COMPRESSION_WINDOW_SIZE - 1);
+            if (!(*(dd->write_fcn))(dd, out_byte)) {
+                // decompression has overflowed the output buffer
+                debug_log("Decompression overflow\n\r");
+                dd->code_bits = 0;
+                return;
+            };
+        }
+    }
+}
+
+// LZ4-style byte-aligned compression
+//
+// The compressed data is a series of sequences, each of which is:
+//   token byte:  llllmmmm
+//   [extra literal length bytes, if llll is 15]
+//   literal bytes
+//   match offset (16-bit little-endian, 1 to 65535 bytes back from the current output position)
+//   [extra match length bytes, if mmmm is 15]
+// The literal length is llll, and the match length is mmmm + 4.
+// Extra length bytes are added to the length, with a byte of 255 meaning another byte follows.
+// The final sequence has literals only, and ends the compressed data.
+//
+// Note: Worst case, the output will be slightly LARGER than the input (by about 1 byte in 255).
+
+#define LZ_MIN_MATCH            4       // shortest match that can be encoded
+#define LZ_MAX_OFFSET           65535   // furthest back a match can start
+#define LZ_HASH_BITS            12      // size of the match finder hash table
+#define LZ_HASH_SIZE            (1 << LZ_HASH_BITS)
+#define LZ_SKIP_TRIGGER         5       // misses before the match search starts to skip ahead
+
+// Largest possible compressed size for the given original size, including the header
+//
+uint32_t agon_lz_max_compressed_size(uint32_t orig_size) {
+    return sizeof(CompressionFileHeader) + orig_size + orig_size / 255 + 16;
+}
+
+inline uint32_t agon_lz_read32(const uint8_t* p) {
+    uint32_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+inline uint32_t agon_lz_hash(uint32_t value) {
+    return (value * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+inline uint8_t* agon_lz_write_length(uint8_t* op, uint32_t length) {
+    while (length >= 255) {
+        *op++ = 255;
+        length -= 255;
+    }
+    *op++ = (uint8_t) length;
+    return op;
+}
+
+// Write a sequence of literals, followed by a match (if match_length is non-zero)
+//
+uint8_t* agon_lz_write_sequence(uint8_t* op, const uint8_t* literals, uint32_t literal_length, uint32_t offset, uint32_t match_length) {
+    uint8_t* token = op++;
+    if (literal_length >= 15) {
+        *token = 15 << 4;
+        op = agon_lz_write_length(op, literal_length - 15);
+    } else {
+        *token = literal_length << 4;
+    }
+    memcpy(op, literals, literal_length);
+    op += literal_length;
+    if (match_length) {
+        *op++ = (uint8_t) offset;
+        *op++ = (uint8_t) (offset >> 8);
+        match_length -= LZ_MIN_MATCH;
+        if (match_length >= 15) {
+            *token |= 15;
+            op = agon_lz_write_length(op, match_length - 15);
+        } else {
+            *token |= match_length;
+        }
+    }
+    return op;
+}
+
+// Compress src_size bytes from src into dst, which must have room for agon_lz_max_compressed_size bytes (less the header)
+// hash_table must have room for LZ_HASH_SIZE entries
+// Returns the number of bytes written to dst
+//
+uint32_t agon_lz_compress(const uint8_t* src, uint32_t src_size, uint8_t* dst, uint32_t* hash_table) {
+    uint8_t* op = dst;
+    uint32_t anchor = 0;
+    uint32_t ip = 0;
+    uint32_t misses = 0;
+
+    // positions are stored plus one, so zero means no entry
+    memset(hash_table, 0, LZ_HASH_SIZE * sizeof(uint32_t));
+
+    while (ip + LZ_MIN_MATCH <= src_size) {
+        uint32_t sequence = agon_lz_read32(src + ip);
+        uint32_t hash = agon_lz_hash(sequence);
+        uint32_t ref = hash_table[hash];
+        hash_table[hash] = ip + 1;
+
+        if (ref == 0 || ip - (ref - 1) > LZ_MAX_OFFSET || agon_lz_read32(src + ref - 1) != sequence) {
+            // no match here, so skip ahead faster the longer we go without finding one
+            ip += 1 + (misses++ >> LZ_SKIP_TRIGGER);
+            continue;
+        }
+        ref--;
+        misses = 0;
 
-            // Extract a byte string from the window
-            uint8_t string_data[COMPRESSION_STRING_SIZE];
-            uint32_t wi = value;
-            for (uint8_t si = 0; si < size; si++) {
-                uint8_t out_byte = dd->window_data[wi++];
-                wi &= (COMPRESSION_WINDOW_SIZE - 1);
-                string_data[si] = out_byte;
-                if (!(*(dd->write_fcn))(dd, out_byte)) {
-                    // decompression has overflowed the output buffer
-                    debug_log("Decompression overflow\n\r");
-                    return;
-                };
+        // extend the match backwards into pending literals, and then forwards
+        while (ip > anchor && ref > 0 && src[ip - 1] == src[ref - 1]) {
+            ip--;
+            ref--;
+        }
+        uint32_t match_length = LZ_MIN_MATCH;
+        while (ip + match_length < src_size && src[ref + match_length] == src[ip + match_length]) {
+            match_length++;
+        }
+
+        op = agon_lz_write_sequence(op, src + anchor, ip - anchor, ip - ref, match_length);
+        ip += match_length;
+        anchor = ip;
+        if (ip >= 2 && ip + LZ_MIN_MATCH <= src_size) {
+            // prime the table with a position from within the match
+            hash_table[agon_lz_hash(agon_lz_read32(src + ip - 2))] = ip - 1;
+        }
+    }
+
+    // remaining bytes are output as literals
+    op = agon_lz_write_sequence(op, src + anchor, src_size - anchor, 0, 0);
+    return op - dst;
+}
+
+inline bool agon_lz_read_length(const uint8_t*& ip, const uint8_t* ip_end, uint32_t& length) {
+    uint8_t extra;
+    do {
+        if (ip >= ip_end) {
+            return false;
+        }
+        extra = *ip++;
+        length += extra;
+    } while (extra == 255);
+    return true;
+}
+
+// Decompress src_size bytes from src into dst, which has room for dst_size bytes
+// Returns the number of bytes written to dst, stopping early if the data is invalid or overflows dst
+//
+uint32_t agon_lz_decompress(const uint8_t* src, uint32_t src_size, uint8_t* dst, uint32_t dst_size) {
+    const uint8_t* ip = src;
+    const uint8_t* ip_end = src + src_size;
+    uint8_t* op = dst;
+    uint8_t* op_end = dst + dst_size;
+
+    while (ip < ip_end) {
+        uint8_t token = *ip++;
+
+        // copy literals
+        uint32_t length = token >> 4;
+        if (length == 15 && !agon_lz_read_length(ip, ip_end, length)) {
+            break;
+        }
+        if (length > (uint32_t) (ip_end - ip) || length > (uint32_t) (op_end - op)) {
+            debug_log("Decompression overflow\n\r");
+            break;
+        }
+        memcpy(op, ip, length);
+        ip += length;
+        op += length;
+        if (ip >= ip_end) {
+            // final sequence has no match
+            break;
+        }
+
+        // copy match
+        if (ip_end - ip < 2) {
+            break;
+        }
+        uint32_t offset = ip[0] | (ip[1] << 8);
+        ip += 2;
+        length = token & 15;
+        if (length == 15 && !agon_lz_read_length(ip, ip_end, length)) {
+            break;
+        }
+        length += LZ_MIN_MATCH;
+        if (offset == 0 || offset > (uint32_t) (op - dst) || length > (uint32_t) (op_end - op)) {
+            debug_log("Decompression overflow\n\r");
+            break;
+        }
+        const uint8_t* match = op - offset;
+        if (offset >= length) {
+            memcpy(op, match, length);
+            op += length;
+        } else {
+            // overlapping match repeats the most recent bytes
+            while (length--) {
+                *op++ = *match++;
             }
         }
     }
+    return op - dst;
 }
 
 #endif // COMPRESSION_H
@@ -146,8 +146,8 @@ class Context {
 		// Font management functions
 		const fabgl::FontInfo * getFont();
 		void changeFont(std::shared_ptr<fabgl::FontInfo> newFont, std::shared_ptr<BufferStream> fontData, uint8_t flags);
-		bool cmpChar(uint8_t * c1, uint8_t *c2, uint8_t len);
 		char getScreenChar(Point p);
+		void trackScreenChar(Point p, uint8_t c, bool drawnAsGlyph);
 		inline void setCharacterOverwrite(bool overwrite);		// TODO integrate into setActiveCursor?
 		inline std::shared_ptr<Bitmap> getBitmapFromChar(uint8_t c) {
 			return getBitmap(charToBitmap[c]);
@@ -170,16 +170,19 @@ class Context {
 		void plotRectangle();
 		void plotParallelogram();
 		void plotCircle(bool filled);
+		void plotEllipse(bool filled);
 		void plotArc();
 		void plotSegment();
 		void plotSector();
 		void plotCopyMove(uint8_t mode);
 		void plotPath(uint8_t mode, uint8_t lastMode);
 		void plotBitmap(uint8_t mode);
+		void plotFloodFill(bool toForeground);
 
 		void clearViewport(ViewportType viewport);
 		void scrollRegion(Rect * region, uint8_t direction, int16_t movement);
 
+		int16_t scanHFind(int16_t x, int16_t y, int16_t end, RGB888 colour, int8_t direction, bool findMatch);
 		uint16_t scanH(int16_t x, int16_t y, RGB888 colour, int8_t direction);
 		uint16_t scanHToMatch(int16_t x, int16_t y, RGB888 colour, int8_t direction);
 
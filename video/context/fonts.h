@@ -66,15 +66,10 @@ void Context::changeFont(std::shared_ptr<fabgl::FontInfo> newFont, std::shared_p
 	}
 }
 
-bool Context::cmpChar(uint8_t * c1, uint8_t *c2, uint8_t len) {
-	for (uint8_t i = 0; i < len; i++) {
-		if (*c1++ != *c2++) {
-			return false;
-		}
-	}
-	return true;
-}
-
+// Try and match a character at a given screen position
+// Characters recorded in the shadow character grid are returned directly,
+// otherwise the cell is read back from the screen and looked up in the font's glyph index
+//
 char Context::getScreenChar(Point p) {
 	auto fontPtr = getFont();
 	if (fontPtr->flags & FONTINFOFLAGS_VARWIDTH) {
@@ -91,51 +86,70 @@ char Context::getScreenChar(Point p) {
 	}
 	if (ttxtMode) {
 		return ttxt_instance.get_screen_char(p.X, p.Y);
-	} else {
-		waitPlotCompletion();
-		uint8_t charWidthBytes = (fontWidth + 7) / 8;
-		uint8_t charSize = charWidthBytes * fontHeight;
-		uint8_t	charData[charSize];
-		uint8_t R = tbg.R;
-		uint8_t G = tbg.G;
-		uint8_t B = tbg.B;
-
-		// Now scan the screen and get the 8 byte pixel representation in charData
-		//
-		for (uint8_t y = 0; y < fontHeight; y++) {
-			uint8_t readByte = 0;
-			for (uint8_t x = 0; x < fontWidth; x++) {
-				if ((x % 8) == 0) {
-					readByte = 0;
-				}
-				RGB888 pixel = canvas->getPixel(p.X + x, p.Y + y);
-				if (!(pixel.R == R && pixel.G == G && pixel.B == B)) {
-					readByte |= (0x80 >> (x % 8));
-				}
-				if ((x % 8) == 7) {
-					charData[(y * charWidthBytes) + (x / 8)] = readByte;
-				}
-			}
-			charData[((y + 1) * charWidthBytes) - 1] = readByte;
-		}
+	}
+
+	auto cell = getScreenCharCell(p.X, p.Y, fontWidth, fontHeight, false);
+	if (cell && cell->generation == screenCharGeneration && cell->glyphGeneration == glyphGeneration
+		&& cell->font == fontPtr && cell->bg == tbg) {
+		return canonicalGlyph(fontPtr, cell->c);
+	}
+
+	waitPlotCompletion();
+	uint8_t charWidthBytes = (fontWidth + 7) / 8;
+	uint8_t charData[charWidthBytes * fontHeight];
+	RGB888 pixels[fontWidth];
 
-		// Finally try and match with the character set array
-		// starts at space character (32) and goes beyond the normal ASCII range
-		// Character checked is ANDed with 0xFF, so we check 32-255 then 0-31
-		// thus allowing characters 0-31 to be checked after conventional characters
-		// as by default those characters are the same as space
-		//
-		for (auto i = 32; i <= (255 + 31); i++) {
-			uint8_t c = i & 0xFF;
-			if (cmpChar(charData, getCharPtr(font, c), charSize)) {
-				debug_log("getScreenChar: matched character %d\n\r", c);
-				return c;
+	// Now read the screen a row at a time, and get the 1bpp representation in charData
+	//
+	for (uint8_t y = 0; y < fontHeight; y++) {
+		_VGAController->readScreen(Rect(p.X, p.Y + y, p.X + fontWidth - 1, p.Y + y), pixels);
+		uint8_t * row = &charData[y * charWidthBytes];
+		memset(row, 0, charWidthBytes);
+		for (uint8_t x = 0; x < fontWidth; x++) {
+			if (!(pixels[x] == tbg)) {
+				row[x >> 3] |= (0x80 >> (x & 7));
 			}
 		}
 	}
+
+	// Finally try and match with the character set
+	// the glyph index returns the same character as checking 32-255 then 0-31 in turn,
+	// as by default characters 0-31 are the same as space
+	//
+	auto c = findGlyph(fontPtr, charData);
+	if (c >= 0) {
+		debug_log("getScreenChar: matched character %d\n\r", c);
+		return c;
+	}
 	return 0;
 }
 
+// Track a character drawn by text plotting in the shadow character grid
+// Only opaque glyphs drawn in the text viewport at cell-aligned positions can be recorded,
+// anything else marks the cells it touched as stale
+//
+void Context::trackScreenChar(Point p, uint8_t c, bool drawnAsGlyph) {
+	auto fontPtr = getFont();
+	auto cell = getScreenCharCell(p.X, p.Y, fontPtr->width, fontPtr->height, true);
+	if (!cell) {
+		// not aligned to the grid, so may have drawn over several cells
+		invalidateScreenChars();
+		return;
+	}
+	bool insideViewport = p.X >= textViewport.X1 && p.Y >= textViewport.Y1
+		&& p.X + fontPtr->width - 1 <= textViewport.X2 && p.Y + fontPtr->height - 1 <= textViewport.Y2;
+	if (drawnAsGlyph && textCursorActive() && tpo.mode == fabgl::PaintMode::Set && !tpo.NOT && !tpo.swapFGBG
+		&& insideViewport && !isDoubleBuffered()) {
+		cell->generation = screenCharGeneration;
+		cell->glyphGeneration = glyphGeneration;
+		cell->font = fontPtr;
+		cell->bg = tbg;
+		cell->c = c;
+	} else {
+		cell->generation = 0;
+	}
+}
+
 // Set character overwrite mode (background fill)
 //
 inline void Context::setCharacterOverwrite(bool overwrite) {
@@ -201,6 +201,73 @@ void Context::plotCircle(bool filled) {
 	}
 }
 
+// Ellipse plot
+// BBC BASIC style - points are the centre, a point level with the centre giving the X radius,
+// and the top (or bottom) of the ellipse, whose X offset from the centre shears the ellipse
+// Rows are worked out with an integer incremental scan, and each row is output as horizontal spans
+//
+void Context::plotEllipse(bool filled) {
+	struct EllipseRow {
+		int16_t left;
+		int16_t right;
+	};
+
+	int32_t a = abs(p2.X - p3.X);
+	int32_t dyTop = p1.Y - p3.Y;
+	int32_t b = abs(dyTop);
+	int32_t shear = p1.X - p3.X;
+	debug_log("plotEllipse: centre (%d,%d), radii %d,%d, shear %d\n\r", p3.X, p3.Y, a, b, shear);
+
+	// half-width of each row from the centre outwards, rounded to the nearest pixel
+	// x is the largest value where (x - 0.5)^2 / a^2 + dy^2 / b^2 <= 1
+	std::vector<EllipseRow, psram_allocator<EllipseRow>> rows(2 * b + 1);
+	int64_t a2 = (int64_t)a * a;
+	int64_t b2 = (int64_t)b * b;
+	int64_t x = a;
+	for (int32_t dy = 0; dy <= b; dy++) {
+		int64_t limit = 4 * (a2 * b2 - a2 * dy * dy);
+		while (x > 0 && (2 * x - 1) * (2 * x - 1) * b2 > limit) {
+			x--;
+		}
+		for (int32_t row : { b - dy, b + dy }) {
+			// shear the row in proportion to its distance from the centre, rounding to the nearest pixel
+			int32_t offset = 0;
+			if (b) {
+				int32_t n = shear * (row - b) * (dyTop > 0 ? 2 : -2) + b;
+				offset = n >= 0 ? n / (2 * b) : -((2 * b - 1 - n) / (2 * b));
+			}
+			rows[row] = { (int16_t)(p3.X + offset - x), (int16_t)(p3.X + offset + x) };
+		}
+	}
+
+	for (int32_t row = 0; row <= 2 * b; row++) {
+		int16_t y = p3.Y + row - b;
+		if (y < graphicsViewport.Y1 || y > graphicsViewport.Y2) {
+			continue;
+		}
+		auto &r = rows[row];
+		if (filled) {
+			canvas->fillRectangle(r.left, y, r.right, y);
+			continue;
+		}
+		// extend each edge inwards to meet the edges of neighbouring rows, so the outline has no gaps
+		int16_t leftEnd = r.left;
+		int16_t rightStart = r.right;
+		for (int32_t n : { row - 1, row + 1 }) {
+			if (n >= 0 && n <= 2 * b) {
+				leftEnd = std::max<int16_t>(leftEnd, rows[n].left - 1);
+				rightStart = std::min<int16_t>(rightStart, rows[n].right + 1);
+			}
+		}
+		leftEnd = std::min(leftEnd, r.right);
+		rightStart = std::max<int16_t>(rightStart, leftEnd + 1);
+		canvas->fillRectangle(r.left, y, leftEnd, y);
+		if (rightStart <= r.right) {
+			canvas->fillRectangle(rightStart, y, r.right, y);
+		}
+	}
+}
+
 // Arc plot
 void Context::plotArc() {
 	debug_log("plotArc: (%d,%d) -> (%d,%d), (%d,%d)\n\r", p3.X, p3.Y, p2.X, p2.Y, p1.X, p1.Y);
@@ -339,6 +406,94 @@ void Context::plotBitmap(uint8_t mode) {
 	plottingText = false;
 }
 
+// Flood fill from the current point
+// Fills pixels that are the background colour (toForeground false) or not the foreground colour (toForeground true)
+// Screen rows are read once each into a bitmask of fillable pixels, which is cleared as spans are filled,
+// so paint modes such as invert can't cause areas to be filled twice
+//
+void Context::plotFloodFill(bool toForeground) {
+	struct FillSpan {
+		int16_t y;
+		int16_t x1;
+		int16_t x2;
+	};
+
+	Rect region = graphicsViewport.intersection(Rect(0, 0, canvasW - 1, canvasH - 1));
+	if (!region.contains(p1)) {
+		return;
+	}
+	int width = region.width();
+	int height = region.height();
+	int rowWords = (width + 31) / 32;
+	auto matchColour = toForeground ? gfg : gbg;
+
+	auto fillable = make_unique_psram_array<uint32_t>(rowWords * height);
+	auto rowLoaded = make_unique_psram_array<bool>(height);
+	auto rowPixels = make_unique_psram_array<RGB888>(width);
+	if (!fillable || !rowLoaded || !rowPixels) {
+		debug_log("plotFloodFill: cannot allocate fill buffers\n\r");
+		return;
+	}
+	memset(rowLoaded.get(), 0, height);
+	std::vector<FillSpan, psram_allocator<FillSpan>> spans;
+
+	// screen must be up to date before we read it
+	canvas->waitCompletion(false);
+
+	// get the fillable bits for a row, reading it from the screen the first time it's used
+	auto getRow = [&](int y) {
+		auto row = &fillable[y * rowWords];
+		if (!rowLoaded[y]) {
+			_VGAController->readScreen(Rect(region.X1, region.Y1 + y, region.X2, region.Y1 + y), rowPixels.get());
+			memset(row, 0, rowWords * sizeof(uint32_t));
+			for (int x = 0; x < width; x++) {
+				if ((rowPixels[x] == matchColour) != toForeground) {
+					row[x >> 5] |= 1u << (x & 31);
+				}
+			}
+			rowLoaded[y] = true;
+		}
+		return row;
+	};
+	auto isFillable = [](const uint32_t * row, int x) {
+		return (row[x >> 5] >> (x & 31)) & 1;
+	};
+
+	spans.push_back({ (int16_t)(p1.Y - region.Y1), (int16_t)(p1.X - region.X1), (int16_t)(p1.X - region.X1) });
+	while (!spans.empty()) {
+		auto span = spans.back();
+		spans.pop_back();
+		if (span.y < 0 || span.y >= height) {
+			continue;
+		}
+		auto row = getRow(span.y);
+		int x = span.x1;
+		while (x <= span.x2) {
+			if (!isFillable(row, x)) {
+				x++;
+				continue;
+			}
+			// extend the span as far as it goes in each direction
+			int left = x;
+			while (left > 0 && isFillable(row, left - 1)) {
+				left--;
+			}
+			int right = x;
+			while (right < width - 1 && isFillable(row, right + 1)) {
+				right++;
+			}
+			for (int i = left; i <= right; i++) {
+				row[i >> 5] &= ~(1u << (i & 31));
+			}
+			canvas->fillRectangle(region.X1 + left, region.Y1 + span.y, region.X1 + right, region.Y1 + span.y);
+			// check the rows above and below this span
+			spans.push_back({ (int16_t)(span.y - 1), (int16_t)left, (int16_t)right });
+			spans.push_back({ (int16_t)(span.y + 1), (int16_t)left, (int16_t)right });
+			x = right + 1;
+		}
+	}
+}
+
 
 // Clear a viewport
 //
@@ -346,6 +501,7 @@ void Context::clearViewport(ViewportType type) {
 	if (ttxtMode) {
 		ttxt_instance.cls();
 	} else {
+		invalidateScreenChars();
 		canvas->fillRectangle(*getViewport(type));
 	}
 }
@@ -412,6 +568,7 @@ void Context::scrollRegion(Rect * region, uint8_t direction, int16_t movement) {
 				}
 			}
 			canvas->scroll(movement * moveX, movement * moveY);
+			scrollScreenChars(*region, movement * moveX, movement * moveY);
 		}
 	}
 	if (textCursorActive()) {
@@ -425,22 +582,107 @@ void Context::scrollRegion(Rect * region, uint8_t direction, int16_t movement) {
 }
 
 
+// Scan a framebuffer row for the first pixel whose match state is findMatch, as scanHFind
+// Where the target is a single native pixel value, the row is compared a 32-bit word of pixels at a time,
+// skipping words that are all the target colour (or have none of it, when looking for a match)
+// bits is the size of a native pixel, or 0 if pixels don't pack evenly into words
+template <int bits, typename PixelMatches>
+int16_t scanRowFind(const uint8_t * row, int16_t x, int16_t end, int8_t direction, bool findMatch, bool usePattern, uint32_t pixel, PixelMatches pixelMatches) {
+	constexpr int perWord = bits ? 32 / bits : 1;
+	constexpr uint32_t lows = bits ? 0xFFFFFFFF / ((1ull << bits) - 1) : 0;
+	constexpr uint32_t highs = lows << (bits ? bits - 1 : 0);
+	auto words = (const uint32_t *) row;
+	uint32_t pattern = lows * pixel;
+	usePattern = usePattern && bits;
+
+	while (x != end) {
+		int16_t wordStart = x & ~(perWord - 1);
+		if (usePattern && x == (direction > 0 ? wordStart : wordStart + perWord - 1) && abs(end - x) >= perWord) {
+			// XOR leaves a zero field for each pixel that is the target colour
+			uint32_t diff = words[wordStart / perWord] ^ pattern;
+			bool anyMatch = ((diff - lows) & ~diff & highs) != 0;
+			if (findMatch ? !anyMatch : diff == 0) {
+				x += direction * perWord;
+				continue;
+			}
+		}
+		if (pixelMatches(x) == findMatch) {
+			return x;
+		}
+		x += direction;
+	}
+	return end;
+}
+
+// Horizontal scan from x towards (but not including) end, for the first pixel that matches
+// (or if findMatch is false, doesn't match) the given colour
+// The colour is converted to the native pixel format once, and compared directly against the framebuffer row.
+// Rows off the screen are read from the screen in chunks instead
+// returns x coordinate of the pixel found, or end if there was none
+int16_t Context::scanHFind(int16_t x, int16_t y, int16_t end, RGB888 colour, int8_t direction, bool findMatch) {
+	canvas->waitCompletion(false);
+
+	auto depth = getVGAColourDepth();
+	if (y >= 0 && y < canvas->getHeight()) {
+		auto row = _VGAController->getScanline(y);
+		if (depth == 64) {
+			// colours that can't be displayed won't be found on screen
+			uint8_t index = (colour.R >> 6) << 4 | (colour.G >> 6) << 2 | (colour.B >> 6);
+			if (colourLookup[index] != colour) {
+				return findMatch ? end : x;
+			}
+			uint8_t raw = _VGAController->createRawPixel(RGB222(colour.R >> 6, colour.G >> 6, colour.B >> 6));
+			return scanRowFind<8>(row, x, end, direction, findMatch, true, raw, [&](int16_t px) { return VGA_PIXELINROW(row, px) == raw; });
+		}
+
+		// Paletted modes may have the colour at more than one palette index
+		bool matches[16] = {};
+		int matchCount = 0;
+		uint8_t index = 0;
+		for (uint8_t i = 0; i < depth && i < 16; i++) {
+			if (colourLookup[palette[i]] == colour) {
+				matches[i] = true;
+				matchCount++;
+				index = i;
+			}
+		}
+		if (matchCount == 0) {
+			return findMatch ? end : x;
+		}
+		switch (depth) {
+			case  2: return scanRowFind<1>(row, x, end, direction, findMatch, matchCount == 1, index, [&](int16_t px) { return matches[VGA2_GETPIXELINROW(row, px)]; });
+			case  4: return scanRowFind<2>(row, x, end, direction, findMatch, matchCount == 1, index, [&](int16_t px) { return matches[VGA4_GETPIXELINROW(row, px)]; });
+			case  8: return scanRowFind<0>(row, x, end, direction, findMatch, false, index, [&](int16_t px) { return matches[VGA8_GETPIXELINROW(row, px)]; });
+			case 16: return scanRowFind<4>(row, x, end, direction, findMatch, matchCount == 1, index, [&](int16_t px) { return matches[VGA16_GETPIXELINROW(row, px)]; });
+		}
+	}
+
+	constexpr int chunkSize = 32;
+	RGB888 pixels[chunkSize];
+
+	while (x != end) {
+		// read the next chunk of the row, stopping short of the end point
+		int count = std::min(chunkSize, abs(end - x));
+		int16_t first = direction > 0 ? x : x - count + 1;
+		_VGAController->readScreen(Rect(first, y, first + count - 1, y), pixels);
+		int i = direction > 0 ? 0 : count - 1;
+		for (int n = 0; n < count; n++, i += direction, x += direction) {
+			if ((pixels[i] == colour) == findMatch) {
+				return x;
+			}
+		}
+	}
+	return end;
+}
+
 // Horizontal scan until we find a pixel not non-equalto given colour
 // returns x coordinate for the last pixel before the match
 uint16_t Context::scanH(int16_t x, int16_t y, RGB888 colour, int8_t direction = 1) {
 	uint16_t w = direction > 0 ? canvas->getWidth() - 1 : 0;
 	if (x < 0 || x >= canvas->getWidth()) return x;
 
-	while (x != w) {
-		RGB888 pixel = canvas->getPixel(x, y);
-		if (pixel == colour) {
-			x += direction;
-		} else {
-			return x - direction;
-		}
-	}
-
-	return w;
+	auto found = scanHFind(x, y, w, colour, direction, false);
+	return found == w ? w : found - direction;
 }
 
 // Horizontal scan until we find a pixel matching the given colour
@@ -449,15 +691,8 @@ uint16_t Context::scanHToMatch(int16_t x, int16_t y, RGB888 colour, int8_t direc
 	uint16_t w = direction > 0 ? canvas->getWidth() - 1 : 0;
 	if (x < 0 || x >= canvas->getWidth()) return x;
 
-	while (x != w) {
-		RGB888 pixel = canvas->getPixel(x, y);
-		if (pixel == colour) {
-			return x - direction;
-		}
-		x += direction;
-	}
-
-	return w;
+	auto found = scanHFind(x, y, w, colour, direction, true);
+	return found == w ? w : found - direction;
 }
 
 
@@ -645,6 +880,7 @@ bool IRAM_ATTR Context::plot(int16_t x, int16_t y, uint8_t command) {
 
 	// if (mode != 0 && mode != 4) {
 	if (mode & 0x03) {
+		invalidateScreenChars();
 		switch (operation) {
 			case 0x00:	// line
 				plotLine(false, false, false, false);
@@ -698,8 +934,12 @@ bool IRAM_ATTR Context::plot(int16_t x, int16_t y, uint8_t command) {
 				fillHorizontalLine(false, false, gfg);
 				break;
 			case 0x80:	// flood to non-bg
+				setGraphicsFill(mode);
+				plotFloodFill(false);
+				break;
 			case 0x88:	// flood to fg
-				debug_log("plot flood fill not implemented\n\r");
+				setGraphicsFill(mode);
+				plotFloodFill(true);
 				break;
 			case 0x90:	// circle outline
 				plotCircle(false);
@@ -723,9 +963,13 @@ bool IRAM_ATTR Context::plot(int16_t x, int16_t y, uint8_t command) {
 				plotCopyMove(mode);
 				break;
 			case 0xC0:	// ellipse outline
+				// fab-gl's ellipse isn't compatible with BBC BASIC, so we use our own
+				setGraphicsFill(mode);
+				plotEllipse(false);
+				break;
 			case 0xC8:	// ellipse fill
-				// fab-gl's ellipse isn't compatible with BBC BASIC
-				debug_log("plot ellipse not implemented\n\r");
+				setGraphicsFill(mode);
+				plotEllipse(true);
 				break;
 			case 0xD8:	// plot path (unassigned on Acorn and other BBC BASIC versions)
 				plotPath(mode, lastPlotCommand & 0x03);
@@ -755,6 +999,7 @@ void Context::plotPending(int16_t peeked) {
 	// Currently pending plot commands can only be flagged for path drawing
 	// In future we may need to check the lastPlotCommand here
 	if (peeked == -1 || peeked != 25) {
+		invalidateScreenChars();
 		plotPath(0, lastPlotCommand & 0x03);
 	}
 }
@@ -789,9 +1034,14 @@ void Context::plotString(const std::string& s) {
 			auto bitmap = getBitmapFromChar(c);
 			if (bitmap) {
 				canvas->drawBitmap(activeCursor->X, activeCursor->Y + font->height - bitmap->height, bitmap.get());
+				if (bitmap->width != font->width || bitmap->height != font->height) {
+					// bitmap isn't the size of a cell, so may have drawn over its neighbours
+					invalidateScreenChars();
+				}
 			} else {
 				canvas->drawChar(activeCursor->X, activeCursor->Y, c);
 			}
+			trackScreenChar(*activeCursor, c, !bitmap);
 		}
 		if (!cursorBehaviour.xHold) {
 			cursorRight(cursorBehaviour.scrollProtect);
@@ -808,6 +1058,7 @@ void Context::plotBackspace() {
 	} else {
 		canvas->setBrushColor(textCursorActive() ? tbg : gbg);
 		canvas->fillRectangle(activeCursor->X, activeCursor->Y, activeCursor->X + getFont()->width - 1, activeCursor->Y + getFont()->height - 1);
+		trackScreenChar(*activeCursor, ' ', false);
 		plottingText = false;
 	}
 }
@@ -817,6 +1068,7 @@ void Context::plotBackspace() {
 void Context::drawBitmap(uint16_t x, uint16_t y, bool compensateHeight, bool forceSet) {
 	auto bitmap = getBitmap(currentBitmap);
 	if (bitmap) {
+		invalidateScreenChars();
 		if (forceSet) {
 			auto options = getPaintOptions(fabgl::PaintMode::Set, gpofg);
 			canvas->setPaintOptions(options);
@@ -959,6 +1211,7 @@ void Context::reset() {
 	setAffineTransform(255, -1);
 	resetFonts();
 	resetTextCursor();
+	resetScreenChars();
 }
 
 // Activate the context, setting up canvas as required
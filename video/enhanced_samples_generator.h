@@ -7,17 +7,22 @@
 #include <fabgl.h>
 
 #include "audio_sample.h"
+#include "block_waveform_generator.h"
 #include "types.h"
 
+// Sample position is a 32.32 fixed point value, so pitch stays accurate over long samples
+#define SAMPLE_PHASE_BITS		32
+#define SAMPLE_PHASE_ONE		((int64_t)1 << SAMPLE_PHASE_BITS)
+
 // Enhanced samples generator
 //
-class EnhancedSamplesGenerator : public WaveformGenerator {
+class EnhancedSamplesGenerator : public BlockWaveformGenerator {
 	public:
 		EnhancedSamplesGenerator(std::shared_ptr<AudioSample> sample);
 
 		void setFrequency(int value);
 		void setSampleRate(int value);
-		int getSample();
+		void render(int8_t * out, int n);
 
 		int getDuration(uint16_t frequency);
 
@@ -25,8 +30,7 @@ class EnhancedSamplesGenerator : public WaveformGenerator {
 	private:
 		std::shared_ptr<AudioSample> _sample;
 
-		uint32_t	index;				// Current index inside the current sample block
-		uint32_t	blockIndex;			// Current index into the sample data blocks
+		AudioSamplePosition	position;	// Current position in the sample data
 		int32_t		repeatCount;		// Sample count when repeating
 		// TODO consider whether repeatStart and repeatLength may need to be here
 		// which would allow for per-channel repeat settings
@@ -34,50 +38,50 @@ class EnhancedSamplesGenerator : public WaveformGenerator {
 		int			frequency;
 		int			previousSample;
 		int			currentSample;
-		double		samplesPerGet;
-		double		fractionalSampleOffset;
+		int64_t		phaseStep;			// Samples to advance per get, in 32.32 fixed point
+		int64_t		phase;				// Position between previousSample and currentSample, in 32.32 fixed point
 
+		void loopTo(uint32_t position);
 		double calculateSamplerate(uint16_t frequency);
 		int8_t getNextSample();
 };
 
 EnhancedSamplesGenerator::EnhancedSamplesGenerator(std::shared_ptr<AudioSample> sample)
-	: _sample(sample), repeatCount(0), index(0), blockIndex(0), frequency(0), previousSample(0), currentSample(0), samplesPerGet(1.0), fractionalSampleOffset(0.0)
+	: _sample(sample), repeatCount(0), frequency(0), previousSample(0), currentSample(0), phaseStep(SAMPLE_PHASE_ONE), phase(0)
 {}
 
 void EnhancedSamplesGenerator::setFrequency(int value) {
 	frequency = value;
-	samplesPerGet = calculateSamplerate(value);
+	phaseStep = calculateSamplerate(value) * SAMPLE_PHASE_ONE;
 }
 
 void EnhancedSamplesGenerator::setSampleRate(int value) {
 	WaveformGenerator::setSampleRate(value);
-	samplesPerGet = calculateSamplerate(frequency);
+	phaseStep = calculateSamplerate(frequency) * SAMPLE_PHASE_ONE;
 }
 
-int EnhancedSamplesGenerator::getSample() {
-	if (duration() == 0) {
-		return 0;
-	}
-
-	// if we've moved far enough along, read the next sample
-	while (fractionalSampleOffset >= 1.0) {
-		previousSample = currentSample;
-		currentSample = getNextSample();
-		fractionalSampleOffset = fractionalSampleOffset - 1.0;
+void EnhancedSamplesGenerator::render(int8_t * out, int n) {
+	for (auto i = 0; i < n; i++) {
+		// if we've moved far enough along, read the next sample
+		// NB looping resets the phase, which can leave it negative here
+		while (phase >= SAMPLE_PHASE_ONE) {
+			previousSample = currentSample;
+			currentSample = getNextSample();
+			phase -= SAMPLE_PHASE_ONE;
+		}
+
+		// Interpolate between the samples to reduce aliasing, using a 16 bit fraction
+		int32_t fraction = phase >> (SAMPLE_PHASE_BITS - 16);
+		int32_t sample = (currentSample * fraction) + (previousSample * (65536 - fraction));
+		// Round towards zero
+		sample = sample < 0 ? -(-sample >> 16) : sample >> 16;
+		// A negative phase after looping extrapolates, which can overshoot an 8 bit sample
+		sample = sample > 127 ? 127 : sample < -128 ? -128 : sample;
+
+		phase += phaseStep;
+
+		out[i] = sample;
 	}
-
-	 // Interpolate between the samples to reduce aliasing
-	int sample = currentSample * fractionalSampleOffset + previousSample * (1.0-fractionalSampleOffset);
-
-	fractionalSampleOffset = fractionalSampleOffset + samplesPerGet;
-
-	// process volume
-	sample = sample * volume() / 127;
-
-	decDuration();
-
-	return sample;
 }
 
 int EnhancedSamplesGenerator::getDuration(uint16_t frequency) {
@@ -88,12 +92,18 @@ int EnhancedSamplesGenerator::getDuration(uint16_t frequency) {
 }
 
 void EnhancedSamplesGenerator::seekTo(uint32_t position) {
-	_sample->seekTo(position, index, blockIndex, repeatCount);
+	// drop anything rendered from the old position
+	restartRender();
+	loopTo(position);
+}
+
+void EnhancedSamplesGenerator::loopTo(uint32_t position) {
+	_sample->seekTo(position, this->position, repeatCount);
 
 	// prepare our fractional sample data for playback
-	fractionalSampleOffset = 0.0;
-	previousSample = _sample->getSample(index, blockIndex);
-	currentSample = _sample->getSample(index, blockIndex);
+	phase = 0;
+	previousSample = _sample->getSample(this->position);
+	currentSample = _sample->getSample(this->position);
 }
 
 double EnhancedSamplesGenerator::calculateSamplerate(uint16_t frequency) {
@@ -103,13 +113,13 @@ double EnhancedSamplesGenerator::calculateSamplerate(uint16_t frequency) {
 }
 
 int8_t EnhancedSamplesGenerator::getNextSample() {
-	auto sample = _sample->getSample(index, blockIndex);
+	auto sample = _sample->getSample(position);
 
 	// looping magic
 	repeatCount--;
 	if (repeatCount == 0) {
-		// we've reached the end of the repeat section, so loop back
-		seekTo(_sample->repeatStart);
+		// we've reached the end of the repeat section, so loop back, keeping the rest of the block being rendered
+		loopTo(_sample->repeatStart);
 	}
 
 	return sample;
@@ -7,6 +7,8 @@
 #ifndef ENVELOPE_ADSR_H
 #define ENVELOPE_ADSR_H
 
+#include <algorithm>
+
 #include "./types.h"
 
 class ADSRVolumeEnvelope : public VolumeEnvelope {
@@ -15,6 +17,7 @@ class ADSRVolumeEnvelope : public VolumeEnvelope {
 		uint8_t getVolume(uint8_t baseVolume, uint32_t elapsed, int32_t duration);
 		bool isReleasing(uint32_t elapsed, int32_t duration);
 		bool isFinished(uint32_t elapsed, int32_t duration);
+		uint32_t nextChange(uint32_t elapsed, int32_t duration);
 		uint32_t getRelease() {
 			return this->_release;
 		}
@@ -77,4 +80,24 @@ bool ADSRVolumeEnvelope::isFinished(uint32_t elapsed, int32_t duration) {
 	return (elapsed >= duration + this->_release);
 }
 
+uint32_t ADSRVolumeEnvelope::nextChange(uint32_t elapsed, int32_t duration) {
+	// attack, decay and release ramps change every millisecond, and sustain holds until release
+	uint32_t minDuration = this->_attack + this->_decay;
+	if (elapsed < minDuration) {
+		return elapsed + 1;
+	}
+	if (duration < 0) {
+		// sustain until the note is stopped
+		return ENVELOPE_NO_CHANGE;
+	}
+	uint32_t releaseStart = std::max<uint32_t>(duration, minDuration);
+	if (elapsed < releaseStart) {
+		return releaseStart;
+	}
+	if (elapsed < releaseStart + this->_release) {
+		return elapsed + 1;
+	}
+	return ENVELOPE_NO_CHANGE;
+}
+
 #endif // ENVELOPE_ADSR_H
@@ -7,6 +7,7 @@
 #ifndef ENVELOPE_FREQUENCY_H
 #define ENVELOPE_FREQUENCY_H
 
+#include <algorithm>
 #include <memory>
 #include <vector>
 
@@ -17,16 +18,24 @@ struct FrequencyStepPhase {
 	uint16_t number;		// number of steps
 };
 
+struct FrequencyStepBoundary {
+	uint32_t step;			// first step of the phase, counted from the start of the envelope
+	int32_t adjustment;		// total frequency adjustment at the start of the phase
+	int16_t stepAdjustment;	// change of frequency per step within the phase
+};
+
 class SteppedFrequencyEnvelope : public FrequencyEnvelope {
 	public:
 		SteppedFrequencyEnvelope(std::shared_ptr<std::vector<FrequencyStepPhase>> phases, uint16_t stepLength, bool repeats, bool cumulative, bool restrict);
 		uint16_t getFrequency(uint16_t baseFrequency, uint32_t elapsed, int32_t duration);
 		bool isFinished(uint32_t elapsed, int32_t duration);
+		uint32_t nextChange(uint32_t elapsed, int32_t duration);
 	private:
-		std::shared_ptr<std::vector<FrequencyStepPhase>> _phases;
+		std::vector<FrequencyStepBoundary> _boundaries;
+		size_t _cursor;			// boundary of the phase last looked up, as time normally moves forwards
 		uint16_t _stepLength;
 		uint32_t _totalSteps;
-		uint32_t _totalAdjustment;
+		int32_t _totalAdjustment;
 		uint32_t _totalLength;
 		bool _repeats;
 		bool _cumulative;
@@ -34,17 +43,19 @@ class SteppedFrequencyEnvelope : public FrequencyEnvelope {
 };
 
 SteppedFrequencyEnvelope::SteppedFrequencyEnvelope(std::shared_ptr<std::vector<FrequencyStepPhase>> phases, uint16_t stepLength, bool repeats, bool cumulative, bool restrict)
-	: _phases(phases), _stepLength(stepLength), _repeats(repeats), _cumulative(cumulative), _restrict(restrict)
+	: _cursor(0), _stepLength(stepLength), _repeats(repeats), _cumulative(cumulative), _restrict(restrict)
 {
 	_totalSteps = 0;
-	_totalLength = 0;
 	_totalAdjustment = 0;
 
-	for (auto phase : *this->_phases) {
+	// precompute where each phase starts, so a lookup doesn't have to walk the phases before it
+	_boundaries.reserve(phases->size());
+	for (auto &phase : *phases) {
+		_boundaries.push_back(FrequencyStepBoundary { _totalSteps, _totalAdjustment, phase.adjustment });
 		_totalSteps += phase.number;
-		_totalLength += phase.number * _stepLength;
 		_totalAdjustment += (phase.number * phase.adjustment);
 	}
+	_totalLength = _totalSteps * _stepLength;
 
 	debug_log("audioDriver: SteppedFrequencyEnvelope: totalSteps=%d, totalAdjustment=%d\n\r", this->_totalSteps, this->_totalAdjustment);
 	debug_log("audioDriver: SteppedFrequencyEnvelope: stepLength=%d, repeats=%d, restricts=%d, totalLength=%d\n\r", this->_stepLength, this->_repeats, this->_restrict, _totalLength);
@@ -53,6 +64,10 @@ SteppedFrequencyEnvelope::SteppedFrequencyEnvelope(std::shared_ptr<std::vector<F
 uint16_t SteppedFrequencyEnvelope::getFrequency(uint16_t baseFrequency, uint32_t elapsed, int32_t duration) {
 	// returns frequency for the given elapsed time
 	// a duration of -1 means we're playing forever
+	if (this->_totalLength == 0) {
+		// no steps, so nothing to adjust
+		return baseFrequency;
+	}
 	auto currentStep = (elapsed / this->_stepLength) % this->_totalSteps;
 	auto loopCount = elapsed / this->_totalLength;
 
@@ -61,22 +76,22 @@ uint16_t SteppedFrequencyEnvelope::getFrequency(uint16_t baseFrequency, uint32_t
 		return baseFrequency + this->_totalAdjustment;
 	}
 
-	// otherwise we need to calculate the frequency
-	int32_t frequency = baseFrequency;
-
-	if (_cumulative) {
-		frequency += (loopCount * _totalAdjustment);
+	// find the phase holding our step, last phase whose start is at or before it
+	// time usually moves forward, so step on from the last phase found, only searching when we've gone back
+	if (currentStep < _boundaries[_cursor].step) {
+		auto next = std::upper_bound(_boundaries.begin(), _boundaries.end(), currentStep,
+			[](uint32_t step, const FrequencyStepBoundary &boundary) { return step < boundary.step; });
+		_cursor = (next - _boundaries.begin()) - 1;
+	}
+	while (_cursor + 1 < _boundaries.size() && _boundaries[_cursor + 1].step <= currentStep) {
+		_cursor++;
 	}
+	auto &boundary = _boundaries[_cursor];
 
-	for (auto phase : *this->_phases) {
-		if (currentStep < phase.number) {
-			frequency += (currentStep * phase.adjustment);
-			break;
-		} else {
-			frequency += (phase.number * phase.adjustment);
-		}
+	int32_t frequency = baseFrequency + boundary.adjustment + ((currentStep - boundary.step) * boundary.stepAdjustment);
 
-		currentStep -= phase.number;
+	if (_cumulative) {
+		frequency += (loopCount * _totalAdjustment);
 	}
 
 	if (_restrict) {
@@ -99,4 +114,12 @@ bool SteppedFrequencyEnvelope::isFinished(uint32_t elapsed, int32_t duration) {
 	return elapsed >= _totalLength;
 }
 
+uint32_t SteppedFrequencyEnvelope::nextChange(uint32_t elapsed, int32_t duration) {
+	if (this->_totalLength == 0 || isFinished(elapsed, duration)) {
+		return ENVELOPE_NO_CHANGE;
+	}
+	// frequency only changes at step boundaries
+	return ((elapsed / this->_stepLength) + 1) * this->_stepLength;
+}
+
 #endif // ENVELOPE_FREQUENCY_H
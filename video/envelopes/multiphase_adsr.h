@@ -7,6 +7,7 @@
 #ifndef ENVELOPE_MULTIPHASE_ADSR_H
 #define ENVELOPE_MULTIPHASE_ADSR_H
 
+#include <algorithm>
 #include <memory>
 #include <vector>
 #include <Arduino.h>
@@ -18,20 +19,33 @@ struct VolumeSubPhase {
 	uint16_t duration;		// number of steps
 };
 
+struct VolumeSubPhaseStart {
+	uint32_t start;			// time the sub-phase starts, relative to the start of its phase
+	uint16_t duration;
+	uint8_t level;
+};
+
 class MultiphaseADSREnvelope : public VolumeEnvelope {
 	public:
 		MultiphaseADSREnvelope(std::shared_ptr<std::vector<VolumeSubPhase>> attack, std::shared_ptr<std::vector<VolumeSubPhase>> sustain, std::shared_ptr<std::vector<VolumeSubPhase>> release);
 		uint8_t		getVolume(uint8_t baseVolume, uint32_t elapsed, int32_t duration);
 		bool		isReleasing(uint32_t elapsed, int32_t duration);
 		bool 		isFinished(uint32_t elapsed, int32_t duration);
+		uint32_t	nextChange(uint32_t elapsed, int32_t duration);
 		uint32_t	getRelease() {
 			return _releaseDuration;
 		};
 	private:
 		uint8_t		getTargetVolume(uint8_t baseVolume, uint8_t level);
-		std::shared_ptr<std::vector<VolumeSubPhase>> _attack;
-		std::shared_ptr<std::vector<VolumeSubPhase>> _sustain;
-		std::shared_ptr<std::vector<VolumeSubPhase>> _release;
+		uint8_t		getSubPhaseVolume(const std::vector<VolumeSubPhaseStart> &subPhases, size_t &cursor, uint32_t pos, uint8_t baseVolume, uint8_t startVolume);
+		uint8_t		rampVolume(int32_t pos, int32_t length, uint8_t startVolume, uint8_t endVolume);
+		uint32_t	setSubPhases(std::vector<VolumeSubPhaseStart> &subPhases, const std::vector<VolumeSubPhase> &source);
+		std::vector<VolumeSubPhaseStart> _attack;
+		std::vector<VolumeSubPhaseStart> _sustain;
+		std::vector<VolumeSubPhaseStart> _release;
+		size_t		_attackCursor = 0;		// sub-phases last looked up, as time normally moves forwards
+		size_t		_sustainCursor = 0;
+		size_t		_releaseCursor = 0;
 		uint32_t	_attackDuration;
 		uint32_t	_sustainDuration;
 		uint32_t	_releaseDuration;
@@ -43,108 +57,83 @@ class MultiphaseADSREnvelope : public VolumeEnvelope {
 };
 
 MultiphaseADSREnvelope::MultiphaseADSREnvelope(std::shared_ptr<std::vector<VolumeSubPhase>> attack, std::shared_ptr<std::vector<VolumeSubPhase>> sustain, std::shared_ptr<std::vector<VolumeSubPhase>> release)
-	: _attack(attack), _sustain(sustain), _release(release)
 {
-	_attackDuration = 0;
-	// add durations from attack subphases to attackDuration
-	for (const auto& subPhase : *_attack) {
-		_attackDuration += subPhase.duration;
-	}
-	_sustainSubphases = _sustain->size();
-	_sustainDuration = 0;
-	for (const auto& subPhase : *_sustain) {
-		_sustainDuration += subPhase.duration;
-	}
-	_releaseDuration = 0;
-	for (const auto& subPhase : *_release) {
-		_releaseDuration += subPhase.duration;
-	}
+	// precompute when each sub-phase starts, so a lookup doesn't have to walk the sub-phases before it
+	_attackDuration = setSubPhases(_attack, *attack);
+	_sustainSubphases = sustain->size();
+	_sustainDuration = setSubPhases(_sustain, *sustain);
+	_releaseDuration = setSubPhases(_release, *release);
 	_attackLevel = 127;
 	// set attackLevel to last level from attack vector, if there are values
-	if (!_attack->empty()) {
-		_attackLevel = _attack->back().level;
+	if (!_attack.empty()) {
+		_attackLevel = _attack.back().level;
 	}
 	_sustainLevel = 127;
-	if (!_sustain->empty()) {
-		_sustainLevel = _sustain->back().level;
+	if (!_sustain.empty()) {
+		_sustainLevel = _sustain.back().level;
 	}
 	_releaseLevel = 0;
-	if (!_release->empty()) {
-		_releaseLevel = _release->back().level;
+	if (!_release.empty()) {
+		_releaseLevel = _release.back().level;
 	}
-	_sustainLoops = false;
-	// loop over our sustain entries, and if we have any non-zero duration values set sustainLoops to true
-	for (const auto& subPhase : *_sustain) {
-		if (subPhase.duration > 0) {
-			_sustainLoops = true;
-			break;
-		}
-	}
-	debug_log("MultiphaseADSREnvelope created with %d attack, %d sustain, %d release phases\n\r", _attack->size(), _sustain->size(), _release->size());
+	// if any of our sustain entries have a non-zero duration then sustain loops
+	_sustainLoops = _sustainDuration > 0;
+	debug_log("MultiphaseADSREnvelope created with %d attack, %d sustain, %d release phases\n\r", _attack.size(), _sustain.size(), _release.size());
 	debug_log("  attackDuration %d, sustainDuration %d, releaseDuration %d\n\r", _attackDuration, _sustainDuration, _releaseDuration);
 	debug_log("  attackLevel %d, sustainLevel %d, releaseLevel %d\n\r", _attackLevel, _sustainLevel, _releaseLevel);
-	for (auto subPhase : *this->_attack) {
+	for (auto &subPhase : _attack) {
 		debug_log("  level %d, duration %d\n\r", subPhase.level, subPhase.duration);
 	}
 }
 
+// Fill in sub-phase start times, returning the total duration of the phase
+uint32_t MultiphaseADSREnvelope::setSubPhases(std::vector<VolumeSubPhaseStart> &subPhases, const std::vector<VolumeSubPhase> &source) {
+	uint32_t start = 0;
+	subPhases.reserve(source.size());
+	for (const auto& subPhase : source) {
+		subPhases.push_back(VolumeSubPhaseStart { start, subPhase.duration, subPhase.level });
+		start += subPhase.duration;
+	}
+	return start;
+}
+
 uint8_t MultiphaseADSREnvelope::getVolume(uint8_t baseVolume, uint32_t elapsed, int32_t duration) {
-	auto subPhasePos = elapsed;
-	uint32_t pos = 0;
-	uint8_t startVolume = 0;
-	// work out what sub-phase we're on, based on our elapsed time
-	if (subPhasePos < _attackDuration) {
+	if (elapsed < _attackDuration) {
 		// we're in an attack sub-phase
-		for (const auto& subPhase : *this->_attack) {
-			if (subPhasePos < subPhase.duration) {
-				// we're inside this sub-phase
-				return map(subPhasePos, 0, subPhase.duration, startVolume, getTargetVolume(baseVolume, subPhase.level));
-			}
-			subPhasePos -= subPhase.duration;
-			startVolume = getTargetVolume(baseVolume, subPhase.level);
-		}
-	} else {
-		startVolume = getTargetVolume(baseVolume, _attackLevel);
+		return getSubPhaseVolume(_attack, _attackCursor, elapsed, baseVolume, 0);
 	}
-	subPhasePos -= _attackDuration;
-	pos += _attackDuration;
-
+	uint32_t subPhasePos = elapsed - _attackDuration;
+	uint8_t startVolume = getTargetVolume(baseVolume, _attackLevel);
 	auto sustainVolume = getTargetVolume(baseVolume, _sustainLevel);
+
 	if (_sustainLoops) {
-		// if we have sustain data, and it's not just zero duration, then loop around it
-		while (pos < duration) {
-			// short-cut looping sub-phases if we can for complete loops
-			if (subPhasePos > _sustainDuration) {
-				subPhasePos -= _sustainDuration;
-				pos += _sustainDuration;
-				startVolume = sustainVolume;
-			} else {
-				for (auto subPhase : *this->_sustain) {
-					if (subPhasePos < subPhase.duration) {
-						// we're in this sub-phase
-						return map(subPhasePos, 0, subPhase.duration, startVolume, getTargetVolume(baseVolume, subPhase.level));
-					}
-					subPhasePos -= subPhase.duration;
-					pos += subPhase.duration;
-					startVolume = getTargetVolume(baseVolume, subPhase.level);
-				}
-			}
+		// sustain loops around, and a loop that starts before the end of our duration plays out in full
+		// a duration of -1 compares as the longest possible duration, so loops forever
+		uint64_t end = (uint32_t)duration;
+		uint32_t loop = subPhasePos / _sustainDuration;
+		if (_attackDuration + (uint64_t)loop * _sustainDuration < end) {
+			return getSubPhaseVolume(_sustain, _sustainCursor, subPhasePos % _sustainDuration, baseVolume, loop == 0 ? startVolume : sustainVolume);
+		}
+		// release starts at the end of the first loop that reaches our duration
+		uint32_t loops = _attackDuration < end ? (end - _attackDuration + _sustainDuration - 1) / _sustainDuration : 0;
+		subPhasePos -= loops * _sustainDuration;
+		if (loops > 0) {
+			startVolume = sustainVolume;
 		}
-	} else if (elapsed < duration) {
+	} else if (elapsed < (uint32_t)duration) {
 		// non-looping sustain - so we're spreading time between the phases, if there are any
 		if (_sustainSubphases <= 1) {
-			return map(subPhasePos, 0, duration - _attackDuration, startVolume, sustainVolume);
+			return rampVolume(subPhasePos, duration - _attackDuration, startVolume, sustainVolume);
 		}
 		int phaseDuration = (duration - _attackDuration) / _sustainSubphases;
-		for (auto subPhase : *this->_sustain) {
-			if (subPhasePos < phaseDuration) {
-				// we're in this subphase
-				return map(subPhasePos, 0, phaseDuration, startVolume, getTargetVolume(baseVolume, subPhase.level));
+		uint32_t subPhase = phaseDuration > 0 ? subPhasePos / phaseDuration : _sustainSubphases;
+		if (subPhase < _sustainSubphases) {
+			if (subPhase > 0) {
+				startVolume = getTargetVolume(baseVolume, _sustain[subPhase - 1].level);
 			}
-			subPhasePos -= phaseDuration;
-			startVolume = getTargetVolume(baseVolume, subPhase.level);
+			return rampVolume(subPhasePos % phaseDuration, phaseDuration, startVolume, getTargetVolume(baseVolume, _sustain[subPhase].level));
 		}
-		return startVolume;
+		return sustainVolume;
 	} else {
 		// end of sustain reached for non-looping sustain, so adjust our subPhasePos to our time within release
 		subPhasePos = elapsed - duration;
@@ -152,17 +141,41 @@ uint8_t MultiphaseADSREnvelope::getVolume(uint8_t baseVolume, uint32_t elapsed,
 	}
 
 	// work out our release phase volume
-	for (auto subPhase : *this->_release) {
-		if (subPhasePos < subPhase.duration) {
-			return map(subPhasePos, 0, subPhase.duration, startVolume, getTargetVolume(baseVolume, subPhase.level));
-		}
-		subPhasePos -= subPhase.duration;
-		startVolume = getTargetVolume(baseVolume, subPhase.level);
+	if (subPhasePos < _releaseDuration) {
+		return getSubPhaseVolume(_release, _releaseCursor, subPhasePos, baseVolume, startVolume);
 	}
 
 	return 0;
 }
 
+// Volume at a position within a phase, ramping from the level of the previous sub-phase
+// startVolume is where the first sub-phase ramps from, and pos must be inside the phase
+uint8_t MultiphaseADSREnvelope::getSubPhaseVolume(const std::vector<VolumeSubPhaseStart> &subPhases, size_t &cursor, uint32_t pos, uint8_t baseVolume, uint8_t startVolume) {
+	// find the last sub-phase starting at or before pos, which skips over any zero length sub-phases
+	// time usually moves forward, so step on from the last sub-phase found, only searching when we've gone back
+	if (pos < subPhases[cursor].start) {
+		auto next = std::upper_bound(subPhases.begin(), subPhases.end(), pos,
+			[](uint32_t pos, const VolumeSubPhaseStart &subPhase) { return pos < subPhase.start; });
+		cursor = (next - subPhases.begin()) - 1;
+	}
+	while (cursor + 1 < subPhases.size() && subPhases[cursor + 1].start <= pos) {
+		cursor++;
+	}
+	auto &subPhase = subPhases[cursor];
+	if (cursor > 0) {
+		startVolume = getTargetVolume(baseVolume, subPhases[cursor - 1].level);
+	}
+	return rampVolume(pos - subPhase.start, subPhase.duration, startVolume, getTargetVolume(baseVolume, subPhase.level));
+}
+
+// Linear interpolation from startVolume to endVolume, as pos goes from 0 to length
+uint8_t MultiphaseADSREnvelope::rampVolume(int32_t pos, int32_t length, uint8_t startVolume, uint8_t endVolume) {
+	if (length == 0) {
+		return endVolume;
+	}
+	return startVolume + (pos * (endVolume - startVolume)) / length;
+}
+
 bool MultiphaseADSREnvelope::isReleasing(uint32_t elapsed, int32_t duration) {
 	if (duration < 0) return false;
 	auto minDuration = this->_attackDuration;
@@ -178,16 +191,25 @@ bool MultiphaseADSREnvelope::isFinished(uint32_t elapsed, int32_t duration) {
 	if (duration < 0) return false;
 
 	// we're finished if we have reached the end of sustain and then end of release
-	auto minDuration = _attackDuration + _sustainDuration;
-	if (_sustainDuration != 0) {
-		while ((minDuration + _sustainDuration) <= duration) {
-			minDuration += _sustainDuration;
-		}
-	}
+	// sustain always plays through at least once
+	uint32_t end = std::max<uint32_t>(duration, _attackDuration + _sustainDuration);
 
-	if (duration < minDuration) duration = minDuration;
+	return (elapsed >= end + this->_releaseDuration);
+}
 
-	return (elapsed >= duration + this->_releaseDuration);
+uint32_t MultiphaseADSREnvelope::nextChange(uint32_t elapsed, int32_t duration) {
+	if (duration >= 0 && !_sustainLoops && _sustainSubphases > 1 && elapsed >= _attackDuration && elapsed < (uint32_t)duration) {
+		// a non-looping sustain holds its final level from the end of its last sub-phase until release
+		uint32_t phaseDuration = (duration - _attackDuration) / _sustainSubphases;
+		if (elapsed >= _attackDuration + (phaseDuration * _sustainSubphases)) {
+			return duration;
+		}
+	}
+	if (isFinished(elapsed, duration)) {
+		return ENVELOPE_NO_CHANGE;
+	}
+	// otherwise we're ramping between sub-phase levels, which changes every millisecond
+	return elapsed + 1;
 }
 
 uint8_t MultiphaseADSREnvelope::getTargetVolume(uint8_t baseVolume, uint8_t level) {
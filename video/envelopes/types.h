@@ -8,19 +8,29 @@
 #define ENVELOPE_TYPES_H
 
 #include <memory>
+#include <stdint.h>
+
+// Returned by nextChange when an envelope will not change again by itself
+#define ENVELOPE_NO_CHANGE	UINT32_MAX
 
 class VolumeEnvelope {
 	public:
+		virtual ~VolumeEnvelope() = default;
 		virtual uint8_t getVolume(uint8_t baseVolume, uint32_t elapsed, int32_t duration) = 0;
 		virtual bool isReleasing(uint32_t elapsed, int32_t duration) = 0;
 		virtual bool isFinished(uint32_t elapsed, int32_t duration) = 0;
 		virtual uint32_t getRelease() = 0;
+		// Time after elapsed at which the volume, or whether the envelope is releasing or finished, may next change
+		virtual uint32_t nextChange(uint32_t elapsed, int32_t duration) = 0;
 };
 
 class FrequencyEnvelope {
 	public:
+		virtual ~FrequencyEnvelope() = default;
 		virtual uint16_t getFrequency(uint16_t baseFrequency, uint32_t elapsed, int32_t duration) = 0;
 		virtual bool isFinished(uint32_t elapsed, int32_t duration) = 0;
+		// Time after elapsed at which the frequency, or whether the envelope is finished, may next change
+		virtual uint32_t nextChange(uint32_t elapsed, int32_t duration) = 0;
 };
 
 #endif // ENVELOPE_TYPES_H
@@ -10,6 +10,7 @@
 
 class MultiBufferStream : public Stream {
 	public:
+		MultiBufferStream() {};
 		MultiBufferStream(BufferVector buffers);
 		int available();
 		int read();
@@ -23,6 +24,8 @@ class MultiBufferStream : public Stream {
 		void seekTo(uint32_t position, size_t bufferIndex = 0);
 		uint32_t size();
 		const BufferVector &tellBuffer(uint32_t &blockOffset, size_t &blockIndex);
+		void rebind(const BufferVector &newBuffers);
+		void release();
 	private:
 		BufferVector buffers;
 		BufferStream * getBuffer();
@@ -83,33 +86,23 @@ void MultiBufferStream::rewind(size_t bufferIndex) {
 }
 
 void MultiBufferStream::seekTo(uint32_t position, size_t bufferIndex) {
-	// find the buffer that contains the position we want
-	// keeping track of an offset into the whole buffer
-	auto offset = position;
-	for (auto i = bufferIndex; i < buffers.size(); i++) {
-		auto &stream = buffers[i];
-		auto bufferSize = stream->size();
-		if (offset < bufferSize) {
-			// this is the buffer we want
-			currentBufferIndex = i;
-			stream->seekTo(offset);
-			return;
-		}
-		// reduce the offset by the size of this buffer, as position wasn't there
-		offset -= bufferSize;
+	if (bufferIndex < buffers.size() && position < buffers[bufferIndex]->size()) {
+		// position is within the given buffer
+		currentBufferIndex = bufferIndex;
+		buffers[bufferIndex]->seekTo(position);
+		return;
+	}
+	// use the block index to find the buffer that contains the position we want
+	// if we've gone past the end of the buffers this will leave us past the end of the last buffer
+	auto offset = buffers.blockStart(bufferIndex) + position;
+	currentBufferIndex = buffers.findBlock(offset);
+	if (currentBufferIndex < buffers.size()) {
+		buffers[currentBufferIndex]->seekTo(offset - buffers.blockStart(currentBufferIndex));
 	}
-
-	// if we get here, we've gone past the end of the buffers
-	// so just seek past the end of the last buffer
-	currentBufferIndex = buffers.size();
 }
 
 uint32_t MultiBufferStream::size() {
-	uint32_t totalSize = 0;
-	for (auto &buffer : buffers) {
-		totalSize += buffer->size();
-	}
-	return totalSize;
+	return buffers.totalSize();
 }
 
 const BufferVector &MultiBufferStream::tellBuffer(uint32_t &blockOffset, size_t &blockIndex) {
@@ -119,6 +112,20 @@ const BufferVector &MultiBufferStream::tellBuffer(uint32_t &blockOffset, size_t
 	return buffers;
 }
 
+// Point this stream at a new set of blocks, and rewind it
+// Re-uses the existing block list storage, so will not allocate if the list has capacity
+void MultiBufferStream::rebind(const BufferVector &newBuffers) {
+	// copying keeps the block index of the source buffer
+	buffers = newBuffers;
+	rewind();
+}
+
+// Drop all block references held by this stream, keeping the list storage for re-use
+void MultiBufferStream::release() {
+	buffers.clear();
+	currentBufferIndex = 0;
+}
+
 inline BufferStream * MultiBufferStream::getBuffer() {
 	while (currentBufferIndex < buffers.size() && !buffers[currentBufferIndex]->available()) {
 		rewind(currentBufferIndex + 1);
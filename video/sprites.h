@@ -21,8 +21,10 @@ uint8_t			numsprites = 0;					// Number of sprites on stage
 uint8_t			current_sprite = 0;				// Current sprite number
 Sprite			sprites[MAX_SPRITES];			// Sprite object storage
 
-// track which sprites may be using a bitmap
+// reverse index of which sprites are using a bitmap, with one entry per frame using it
 std::unordered_map<uint16_t, std::vector<uint8_t, psram_allocator<uint8_t>>> bitmapUsers;
+// bitmap IDs used by each sprite's frames, in frame order
+std::vector<uint16_t, psram_allocator<uint16_t>> spriteFrameIds[MAX_SPRITES];
 
 std::unordered_map<uint16_t, fabgl::Cursor> cursors;	// Storage for our cursors
 uint16_t		mCursor = MOUSE_DEFAULT_CURSOR;	// Mouse cursor
@@ -88,6 +90,9 @@ void resetBitmaps() {
 	bitmaps.clear();
 	// this will only be used after resetting sprites, so we can clear the bitmapUsers list
 	bitmapUsers.clear();
+	for (auto &frameIds : spriteFrameIds) {
+		frameIds.clear();
+	}
 	cursors.clear();
 	if (!setMouseCursor()) {
 		setMouseCursor(MOUSE_DEFAULT_CURSOR);
@@ -106,21 +111,34 @@ inline uint8_t getCurrentSprite() {
 	return current_sprite;
 }
 
+// Remove one entry for a sprite from a bitmap's users list
+//
+void removeBitmapUser(uint16_t bitmapId, uint8_t s) {
+	auto usersIter = bitmapUsers.find(bitmapId);
+	if (usersIter == bitmapUsers.end()) {
+		return;
+	}
+	auto &users = usersIter->second;
+	auto it = std::find(users.begin(), users.end(), s);
+	if (it != users.end()) {
+		users.erase(it);
+	}
+	if (users.empty()) {
+		bitmapUsers.erase(usersIter);
+	}
+}
+
 void clearSpriteFrames(uint8_t s = current_sprite) {
 	auto sprite = getSprite(s);
 	sprite->visible = false;
 	sprite->setFrame(0);
 	sprite->clearBitmaps();
-	// find all bitmaps used by this sprite and remove it from the list
-	for (auto bitmapUser : bitmapUsers) {
-		auto users = bitmapUser.second;
-		// remove all instances of this sprite from the users list
-		auto it = std::find(users.begin(), users.end(), s);
-		while (it != users.end()) {
-			users.erase(it);
-			it = std::find(users.begin(), users.end(), s);
-		}
+	// remove this sprite from the users list of each bitmap its frames used
+	auto &frameIds = spriteFrameIds[s];
+	for (auto bitmapId : frameIds) {
+		removeBitmapUser(bitmapId, s);
 	}
+	frameIds.clear();
 }
 
 void clearBitmap(uint16_t b) {
@@ -130,13 +148,17 @@ void clearBitmap(uint16_t b) {
 	bitmaps.erase(b);
 
 	// find all sprites that had used this bitmap and clear their frames
-	if (bitmapUsers.find(b) != bitmapUsers.end()) {
-		auto users = bitmapUsers[b];
+	auto usersIter = bitmapUsers.find(b);
+	if (usersIter != bitmapUsers.end()) {
+		auto users = std::move(usersIter->second);
+		bitmapUsers.erase(usersIter);
 		for (auto user : users) {
-			debug_log("clearBitmap: sprite %d can no longer use bitmap %d, so clearing sprite frames\n\r", user, b);
-			clearSpriteFrames(user);
+			// a sprite using the bitmap for several frames appears several times, but only needs clearing once
+			if (!spriteFrameIds[user].empty()) {
+				debug_log("clearBitmap: sprite %d can no longer use bitmap %d, so clearing sprite frames\n\r", user, b);
+				clearSpriteFrames(user);
+			}
 		}
-		bitmapUsers.erase(b);
 	}
 }
 
@@ -152,6 +174,7 @@ void addSpriteFrame(uint16_t bitmapId) {
 		return;
 	}
 	bitmapUsers[bitmapId].push_back(current_sprite);
+	spriteFrameIds[current_sprite].push_back(bitmapId);
 	sprite->addBitmap(bitmap.get());
 	if (bitmap->format == PixelFormat::Mask) {
 		sprite->hardware = 0;
@@ -170,30 +193,15 @@ void replaceSpriteFrame(uint16_t bitmapId) {
 		return;
 	}
 
-	// remove one instance of current_sprite from the bitmapUsers list for the shown frame
-	// first step is to work out the bitmap ID of the current frame
-	auto frameBitmap = sprite->frames[sprite->currentFrame];
-	auto oldBitmapId = -1;
-	for (auto bitmap : bitmaps) {
-		if (bitmap.second.get() == frameBitmap) {
-			oldBitmapId = bitmap.first;
-			break;
-		}
-	}
-
-	// if we found the old bitmap, remove one entry of the sprite from the bitmapUsers list
-	if (oldBitmapId != -1) {
-		auto users = bitmapUsers[oldBitmapId];
-		for (auto user : users) {
-			// remove only one copy of current_sprite from the users list, if it exists
-			auto it = std::find(users.begin(), users.end(), current_sprite);
-			if (it != users.end()) {
-				users.erase(it);
-				break;
-			}
-		}
+	auto &frameIds = spriteFrameIds[current_sprite];
+	if (sprite->currentFrame >= frameIds.size()) {
+		debug_log("replaceSpriteFrame: sprite %d has no frame to replace\n\r", current_sprite);
+		return;
 	}
 
+	// swap the shown frame's entry in the bitmapUsers list over to the new bitmap
+	removeBitmapUser(frameIds[sprite->currentFrame], current_sprite);
+	frameIds[sprite->currentFrame] = bitmapId;
 	sprite->frames[sprite->currentFrame] = bitmap.get();
 	bitmapUsers[bitmapId].push_back(current_sprite);
 
@@ -271,6 +279,36 @@ void moveSpriteBy(int x, int y) {
 	sprite->moveBy(x, y);
 }
 
+// Sprite batch update record, as stored in a buffer
+//
+struct __attribute__((packed)) SpriteUpdate {
+	uint8_t		sprite;					// Sprite number
+	uint8_t		flags;					// SPRITE_UPDATE_* flags for the changes to apply
+	int16_t		x;						// Position, or offset for SPRITE_UPDATE_MOVE_BY
+	int16_t		y;
+	uint8_t		frame;					// Frame number for SPRITE_UPDATE_FRAME
+};
+
+// Apply a batch update record to its sprite
+// The sprite does not need to be the current sprite, and current_sprite is not changed
+//
+void updateSprite(const SpriteUpdate &update) {
+	auto sprite = getSprite(update.sprite);
+	if (update.flags & SPRITE_UPDATE_MOVE_BY) {
+		sprite->moveBy(update.x, update.y);
+	} else if (update.flags & SPRITE_UPDATE_MOVE) {
+		sprite->moveTo(update.x, update.y);
+	}
+	if ((update.flags & SPRITE_UPDATE_FRAME) && update.frame < sprite->framesCount) {
+		sprite->setFrame(update.frame);
+	}
+	if (update.flags & SPRITE_UPDATE_HIDE) {
+		sprite->visible = 0;
+	} else if (update.flags & SPRITE_UPDATE_SHOW) {
+		sprite->visible = 1;
+	}
+}
+
 void refreshSprites() {
 	if (numsprites) {
 		_VGAController->refreshSprites();
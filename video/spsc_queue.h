@@ -0,0 +1,66 @@
+#ifndef SPSC_QUEUE_H
+#define SPSC_QUEUE_H
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+
+// Fixed size single-producer/single-consumer queue
+// One task may push and one other task may pop, without either of them taking a lock or waiting.
+// Size must be a power of two
+//
+template <typename T, size_t Size>
+class SPSCQueue {
+	static_assert(Size && (Size & (Size - 1)) == 0, "SPSCQueue size must be a power of two");
+
+	public:
+		// Producer side - returns false, and counts an overflow, if the queue is full
+		bool push(const T & item) {
+			auto head = _head.load(std::memory_order_relaxed);
+			auto tail = _tail.load(std::memory_order_acquire);
+			if (head - tail == Size) {
+				_overflows.fetch_add(1, std::memory_order_relaxed);
+				return false;
+			}
+			_items[head & (Size - 1)] = item;
+			_head.store(head + 1, std::memory_order_release);
+			if (head + 1 - tail > _highWater.load(std::memory_order_relaxed)) {
+				_highWater.store(head + 1 - tail, std::memory_order_relaxed);
+			}
+			return true;
+		}
+
+		// Consumer side - returns false if the queue is empty
+		bool pop(T & item) {
+			auto tail = _tail.load(std::memory_order_relaxed);
+			if (tail == _head.load(std::memory_order_acquire)) {
+				return false;
+			}
+			item = _items[tail & (Size - 1)];
+			_tail.store(tail + 1, std::memory_order_release);
+			return true;
+		}
+
+		// Diagnostics, readable from either side
+		size_t depth() const {
+			return _head.load(std::memory_order_acquire) - _tail.load(std::memory_order_acquire);
+		}
+		size_t highWater() const {
+			return _highWater.load(std::memory_order_relaxed);
+		}
+		uint32_t overflows() const {
+			return _overflows.load(std::memory_order_relaxed);
+		}
+		static constexpr size_t capacity() {
+			return Size;
+		}
+
+	private:
+		T					_items[Size];
+		std::atomic<size_t>	_head = { 0 };			// next slot to write, only written by the producer
+		std::atomic<size_t>	_tail = { 0 };			// next slot to read, only written by the consumer
+		std::atomic<size_t>	_highWater = { 0 };		// deepest the queue has been
+		std::atomic<uint32_t>	_overflows = { 0 };	// pushes dropped because the queue was full
+};
+
+#endif // SPSC_QUEUE_H
@@ -0,0 +1,297 @@
+#ifndef TILE_LAYERS_H
+#define TILE_LAYERS_H
+
+// Tile engine data, and rendering of tile layers into their layer buffers
+// Used by the layer commands in vdu_layers.h
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <vector>
+#include <fabgl.h>
+
+#include "buffer_stream.h"
+
+// Size of a 256 tile bank, and of its flipped tile variants
+#define TILEBANK_SIZE			(256 * 64)
+#define TILEBANK_VARIANTS_SIZE	(3 * 256 * 64)
+
+struct TileBank {
+	void * data = NULL;						// 256 tiles of 64 pixels each, unless the tiles are in a buffer
+	std::shared_ptr<BufferStream> source;	// Buffer whose storage holds the tiles, if adopted from one
+	uint8_t * ptr = NULL;					// The tiles, from either of the above
+	void * variantData = NULL;				// Flipped copies of the tiles
+	uint8_t * variants;						// Tiles flipped in X, Y, and XY, each 256 tiles of 64 bytes
+};
+
+struct Tile {
+	uint8_t	id;
+	uint8_t attribute;
+};
+
+struct TileMap {
+	struct Tile** tiles = NULL;				// Columns of tiles, indexed as tiles[x][y]
+	uint8_t height;
+	uint8_t width;
+	std::vector<uint16_t> dirtyTiles;		// Tiles changed since the layer was last rendered, as (x << 8) | y
+};
+
+struct TileLayer {
+	uint8_t height;
+	uint8_t width;
+	uint8_t sourceXPos;
+	uint8_t sourceYPos;
+	uint8_t xOffset;
+	uint8_t yOffset;
+	uint8_t attribute;
+	uint8_t backgroundColour = 0;			// Default the background colour of the layer to 0 (transparent)
+	uint8_t tileBank = 0;					// Tile bank the layer draws its tiles from
+	uint8_t priority = 0;					// Layers with a higher priority are composited on top
+	bool visible = true;					// Included when all layers are drawn together
+	bool initialised = false;
+	void * buffer = NULL;					// The offscreen buffer for the layer
+	uint8_t * ptr;							// A pointer to the buffer
+	Bitmap bitmap;							// Bitmap that points to the buffer
+	bool rendered = false;					// Layer buffer holds a render that can be updated incrementally
+	int renderedX = 0;						// Tile map pixel position of the last render
+	int renderedY = 0;
+};
+
+// Copy an 8 pixel tile row, using two word stores when both rows are word aligned
+//
+static inline void copyTileRow(uint8_t * dest, const uint8_t * source) {
+	if ((((uintptr_t)dest | (uintptr_t)source) & 3) == 0) {
+		((uint32_t *)dest)[0] = ((const uint32_t *)source)[0];
+		((uint32_t *)dest)[1] = ((const uint32_t *)source)[1];
+	} else {
+		memcpy(dest, source, 8);
+	}
+}
+
+// Draw the opaque pixels of a layer buffer row over a composite row. Both rows must be word aligned.
+// The alpha bits of each 4 pixel word are folded into a byte mask, so only partly transparent words pay for a merge.
+//
+static inline void mergeLayerRow(uint8_t * dest, const uint8_t * source, int width) {
+	auto d = (uint32_t *)dest;
+	auto s = (const uint32_t *)source;
+
+	for (auto n=0; n<width / 4; n++) {
+		uint32_t pixels = s[n];
+		uint32_t alpha = pixels & 0xC0C0C0C0;
+		if (alpha == 0) continue;
+		uint32_t mask = (((alpha >> 6) | (alpha >> 7)) & 0x01010101) * 0xFF;
+		d[n] = (d[n] & ~mask) | (pixels & mask);
+	}
+}
+
+inline const uint8_t * getTileRow(const TileBank &tileBank, uint8_t tileId, uint8_t tileAttribute, uint8_t line) {
+
+	// Attribute bit 1 flips the tile vertically, and bit 0 horizontally
+
+	uint8_t variant = tileAttribute & 0x03;
+	if (variant == 0) {
+		return tileBank.ptr + (tileId * 64) + (line * 8);
+	}
+	return tileBank.variants + ((((variant - 1) * 256) + tileId) * 64) + (line * 8);
+}
+
+void updateTileVariants(TileBank &tileBank, uint8_t tileId) {
+
+	// Regenerate the flipped copies of a tile, after its pixels have changed.
+	// Variant 1 is flipped in X, 2 in Y, and 3 in both, matching tile attribute bits 0 and 1.
+
+	const uint8_t * tile = tileBank.ptr + (tileId * 64);
+
+	for (auto variant=1; variant<4; variant++) {
+		uint8_t * dest = tileBank.variants + ((((variant - 1) * 256) + tileId) * 64);
+		for (auto y=0; y<8; y++) {
+			const uint8_t * source = tile + (((variant & 0x02) ? 7 - y : y) * 8);
+			for (auto x=0; x<8; x++) {
+				dest[(y * 8) + x] = source[(variant & 0x01) ? 7 - x : x];
+			}
+		}
+	}
+}
+
+void writeTileMapToLayerBuffer(TileLayer &tileLayer, const TileMap &tileMap, const TileBank &tileBank, int x0, int y0, int x1, int y1, int originX, int originY) {
+
+	// Render the rectangle (x0,y0) to (x1,y1) (exclusive) of a layer buffer from its tile map,
+	// where the top left of the layer buffer is at pixel (originX,originY) of the tile map.
+	// The tile map wraps around in both directions. Tile 0 is transparent.
+
+	int tileLayerPixelWidth = tileLayer.width * 8;
+	int tileMapPixelWidth = tileMap.width * 8;
+	int tileMapPixelHeight = tileMap.height * 8;
+
+	for (auto y=y0; y<y1; y++) {
+
+		int mapY = (originY + y) % tileMapPixelHeight;
+		uint8_t tileRow = mapY >> 3;
+		uint8_t tileLine = mapY & 7;
+		uint8_t * dest = tileLayer.ptr + (y * tileLayerPixelWidth);
+
+		int mapX = (originX + x0) % tileMapPixelWidth;
+
+		for (auto x=x0; x<x1;) {
+
+			Tile &tile = tileMap.tiles[mapX >> 3][tileRow];
+			int tileColumn = mapX & 7;
+			int count = std::min(8 - tileColumn, x1 - x);
+
+			if (tile.id == 0) {
+				memset(dest + x, 0, count);
+			} else {
+				const uint8_t * source = getTileRow(tileBank, tile.id, tile.attribute, tileLine);
+				if (count == 8) {
+					copyTileRow(dest + x, source);
+				} else {
+					memcpy(dest + x, source + tileColumn, count);
+				}
+			}
+
+			x += count;
+			mapX += count;
+			if (mapX == tileMapPixelWidth) {
+				mapX = 0;
+			}
+		}
+	}
+}
+
+void writeDirtyTileToLayerBuffer(TileLayer &tileLayer, const TileMap &tileMap, const TileBank &tileBank, uint8_t tileX, uint8_t tileY, int originX, int originY) {
+
+	// Re-render every place in a layer buffer that shows the given tile of its tile map.
+	// The tile map may be smaller than the layer, in which case a tile can appear more than once.
+
+	int tileLayerPixelWidth = tileLayer.width * 8;
+	int tileLayerPixelHeight = tileLayer.height * 8;
+	int tileMapPixelWidth = tileMap.width * 8;
+	int tileMapPixelHeight = tileMap.height * 8;
+
+	int startX = (((tileX * 8) - originX) % tileMapPixelWidth + tileMapPixelWidth) % tileMapPixelWidth;
+	int startY = (((tileY * 8) - originY) % tileMapPixelHeight + tileMapPixelHeight) % tileMapPixelHeight;
+
+	// A tile that wraps past the top or left edge is partly visible at a negative position
+	for (auto y=startY - tileMapPixelHeight; y<tileLayerPixelHeight; y+=tileMapPixelHeight) {
+		if (y + 8 <= 0) continue;
+		for (auto x=startX - tileMapPixelWidth; x<tileLayerPixelWidth; x+=tileMapPixelWidth) {
+			if (x + 8 <= 0) continue;
+			writeTileMapToLayerBuffer(tileLayer, tileMap, tileBank, std::max(x, 0), std::max(y, 0), std::min(x + 8, tileLayerPixelWidth), std::min(y + 8, tileLayerPixelHeight), originX, originY);
+		}
+	}
+}
+
+void shiftLayerBuffer(uint8_t * layerBuffer, int width, int height, int dx, int dy) {
+
+	// Move the rendered content of a layer buffer so that pixel (x+dx,y+dy) ends up at (x,y).
+	// Rows are walked against the direction of movement so that no source row is overwritten before it is read.
+
+	int count = width - abs(dx);
+	int sourceX = std::max(dx, 0);
+	int destX = std::max(-dx, 0);
+
+	if (dy >= 0) {
+		for (auto y=0; y<height - dy; y++) {
+			memmove(layerBuffer + (y * width) + destX, layerBuffer + ((y + dy) * width) + sourceX, count);
+		}
+	} else {
+		for (auto y=height - 1; y>=-dy; y--) {
+			memmove(layerBuffer + (y * width) + destX, layerBuffer + ((y + dy) * width) + sourceX, count);
+		}
+	}
+}
+
+void markTileDirty(TileLayer &tileLayer, TileMap &tileMap, uint8_t tileX, uint8_t tileY) {
+
+	// Nothing to track until the layer has been rendered
+	if (!tileLayer.rendered) return;
+
+	auto &dirtyTiles = tileMap.dirtyTiles;
+
+	// Once more tiles have changed than the layer can show, a full redraw is cheaper
+	if (dirtyTiles.size() >= (size_t)((tileLayer.width + 1) * (tileLayer.height + 1))) {
+		tileLayer.rendered = false;
+		dirtyTiles.clear();
+		return;
+	}
+	dirtyTiles.push_back((tileX << 8) | tileY);
+}
+
+void updateLayerBuffer(TileLayer &tileLayer, TileMap &tileMap, const TileBank &tileBank) {
+
+	// Bring a layer buffer up to date with its tile map and scroll position.
+	// The layer, its tile map, and its tile bank must all be initialised.
+
+	int layerBufferWidth = tileLayer.width * 8;
+	int layerBufferHeight = tileLayer.height * 8;
+
+	// Perform validation checks
+
+	uint8_t sourceXPos = tileLayer.sourceXPos < tileMap.width ? tileLayer.sourceXPos : 0;
+	uint8_t sourceYPos = tileLayer.sourceYPos < tileMap.height ? tileLayer.sourceYPos : 0;
+
+	// The layer buffer shows the tile map from this pixel position onwards
+
+	int tileMapPixelWidth = tileMap.width * 8;
+	int tileMapPixelHeight = tileMap.height * 8;
+	int originX = (sourceXPos * 8) + tileLayer.xOffset;
+	int originY = (sourceYPos * 8) + tileLayer.yOffset;
+
+	auto &dirtyTiles = tileMap.dirtyTiles;
+
+	if (tileLayer.rendered) {
+
+		// Work out how far the layer has scrolled since the last update. The tile map wraps,
+		// so take the shortest way round - the rendered content repeats every map width/height anyway.
+
+		int dx = originX - tileLayer.renderedX;
+		int dy = originY - tileLayer.renderedY;
+
+		if (dx > tileMapPixelWidth / 2) { dx -= tileMapPixelWidth; }
+		if (dx < -tileMapPixelWidth / 2) { dx += tileMapPixelWidth; }
+		if (dy > tileMapPixelHeight / 2) { dy -= tileMapPixelHeight; }
+		if (dy < -tileMapPixelHeight / 2) { dy += tileMapPixelHeight; }
+
+		if (abs(dx) >= layerBufferWidth || abs(dy) >= layerBufferHeight) {
+
+			// Scrolled too far for any existing content to be reused
+			tileLayer.rendered = false;
+
+		} else {
+
+			// Shift what has already been rendered, and only render the newly exposed columns and rows
+
+			if (dx != 0 || dy != 0) {
+				shiftLayerBuffer(tileLayer.ptr, layerBufferWidth, layerBufferHeight, dx, dy);
+			}
+			if (dx > 0) {
+				writeTileMapToLayerBuffer(tileLayer, tileMap, tileBank, layerBufferWidth - dx, 0, layerBufferWidth, layerBufferHeight, originX, originY);
+			} else if (dx < 0) {
+				writeTileMapToLayerBuffer(tileLayer, tileMap, tileBank, 0, 0, -dx, layerBufferHeight, originX, originY);
+			}
+			if (dy > 0) {
+				writeTileMapToLayerBuffer(tileLayer, tileMap, tileBank, 0, layerBufferHeight - dy, layerBufferWidth, layerBufferHeight, originX, originY);
+			} else if (dy < 0) {
+				writeTileMapToLayerBuffer(tileLayer, tileMap, tileBank, 0, 0, layerBufferWidth, -dy, originX, originY);
+			}
+
+			// Then redraw any tiles that have changed since the last update
+
+			for (auto dirtyTile : dirtyTiles) {
+				writeDirtyTileToLayerBuffer(tileLayer, tileMap, tileBank, dirtyTile >> 8, dirtyTile & 0xFF, originX, originY);
+			}
+		}
+	}
+
+	if (!tileLayer.rendered) {
+		writeTileMapToLayerBuffer(tileLayer, tileMap, tileBank, 0, 0, layerBufferWidth, layerBufferHeight, originX, originY);
+	}
+
+	tileLayer.rendered = true;
+	tileLayer.renderedX = originX;
+	tileLayer.renderedY = originY;
+	dirtyTiles.clear();
+}
+
+#endif // TILE_LAYERS_H
@@ -201,7 +201,7 @@ void VDUStreamProcessor::vdu_print(char c, bool usePeek) {
 			if (!byteAvailable()) {
 				break;
 			}
-			auto next = inputStream->peek();
+			auto next = peekByte_t();
 			if (next == 27) {
 				readByte();		// discard byte we have peeked
 				if (consoleMode) {
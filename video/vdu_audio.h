@@ -141,6 +141,7 @@ void VDUStreamProcessor::vdu_sys_audio() {
 					debug_log("Sample info: %d\n\r", bufferId);
 					debug_log("  samples count: %d\n\r", samples.size());
 					debug_log("  free mem: %d\n\r", heap_caps_get_free_size(MALLOC_CAP_8BIT));
+					debug_log("  audio queue: %d of %d, high water %d, overflows %d\n\r", audioCommands.depth(), audioCommands.capacity(), audioCommands.highWater(), audioCommands.overflows());
 					auto sample = samples[bufferId];
 					if (!sample) {
 						debug_log("  sample is null\n\r");
@@ -243,6 +243,12 @@ void IRAM_ATTR VDUStreamProcessor::vdu_sys_buffered() {
 			if (sourceBufferId == -1) return;
 			bufferDecompress(bufferId, sourceBufferId);
 		}	break;
+		case BUFFERED_COMPRESS_FORMAT: {
+			auto format = readByte_t(); if (format == -1) return;
+			auto sourceBufferId = readWord_t();
+			if (sourceBufferId == -1) return;
+			bufferCompress(bufferId, sourceBufferId, format);
+		}	break;
 		case BUFFERED_EXPAND_BITMAP: {
 			auto options = readByte_t(); if (options == -1) return;
 			auto sourceBufferId = readWord_t();
@@ -314,6 +320,7 @@ uint32_t VDUStreamProcessor::bufferWrite(uint16_t bufferId, uint32_t length) {
 		return remaining;
 	}
 
+	clearCommandCache(bufferId);
 	buffers[bufferId].push_back(std::move(bufferStream));
 	debug_log("bufferWrite: stored stream in buffer %d, length %d, %d streams stored\n\r", bufferId, length, buffers[bufferId].size());
 	return remaining;
@@ -354,16 +361,23 @@ void VDUStreamProcessor::bufferCall(uint16_t callBufferId, AdvancedOffset offset
 		bufferRemoveCallback(bufferId, 65535);
 		return;
 	}
-	auto &streams = bufferIter->second;
-	std::shared_ptr<Stream> callInputStream = make_shared_psram<MultiBufferStream>(streams);
+	auto callStream = getCallStream(bufferIter->second);
 	if (offset.blockOffset != 0 || offset.blockIndex != 0) {
-		auto multiBufferStream = (MultiBufferStream *)callInputStream.get();
-		multiBufferStream->seekTo(offset.blockOffset, offset.blockIndex);
+		callStream->seekTo(offset.blockOffset, offset.blockIndex);
 	}
+	std::shared_ptr<Stream> callInputStream = callStream;
 	// use the current VDUStreamProcessor, swapping out the stream
 	std::swap(id, callBufferId);
 	std::swap(inputStream, callInputStream);
-	processAllAvailable();
+	callDepth++;
+	if (isFeatureFlagSet(FEATUREFLAG_COMMAND_CACHE) && canUseCommandCache()) {
+		processCachedBuffer(bufferId, offset, bufferIter->second, callStream.get());
+	} else {
+		processAllAvailable();
+	}
+	callDepth--;
+	// drop the block references held by this call's stream
+	callStream->release();
 	// restore the original buffer id and stream
 	id = callBufferId;
 	inputStream = std::move(callInputStream);
@@ -374,8 +388,196 @@ void VDUStreamProcessor::bufferCall(uint16_t callBufferId, AdvancedOffset offset
 	}
 }
 
+// Get the pooled stream for the current call depth, bound to the given blocks
+// Streams are created on first use at a given depth, and re-used thereafter
+//
+std::shared_ptr<MultiBufferStream> VDUStreamProcessor::getCallStream(const BufferVector &streams) {
+	if (callStreamPool.size() <= callDepth) {
+		callStreamPool.push_back(make_shared_psram<MultiBufferStream>());
+	}
+	auto &callStream = callStreamPool[callDepth];
+	callStream->rebind(streams);
+	return callStream;
+}
+
+// Command caches can only be used when commands have no side-effects beyond their execution
+// such as echo, console or "printer" output of the command bytes
+//
+bool VDUStreamProcessor::canUseCommandCache() {
+	return commandsEnabled && !echoEnabled && !consoleMode && !printerOn;
+}
+
+// Process a buffer call, using (or recording) a decoded command cache for the buffer
+//
+void VDUStreamProcessor::processCachedBuffer(uint16_t bufferId, AdvancedOffset offset, const BufferVector &streams, MultiBufferStream * stream) {
+	auto cacheIter = commandCaches.find(bufferId);
+	if (cacheIter != commandCaches.end()) {
+		auto cache = cacheIter->second;
+		if (!cache->complete) {
+			// buffer is being recorded by an outer call, so just process it
+			processAllAvailable();
+			return;
+		}
+		if (cache->matches(streams, offset)) {
+			replayCommandCache(bufferId, std::move(cache), stream);
+			return;
+		}
+	}
+	recordCommandCache(bufferId, offset, streams, stream);
+}
+
+// Process a buffer call, recording each command into a new command cache
+// If execution leaves the buffer, or the buffer is changed, the recording is discarded
+//
+void VDUStreamProcessor::recordCommandCache(uint16_t bufferId, AdvancedOffset offset, const BufferVector &streams, MultiBufferStream * stream) {
+	auto cache = make_shared_psram<CommandCache>();
+	cache->start = offset;
+	for (const auto &block : streams) {
+		if (block->isWritable()) {
+			// writable buffers may be changed by output, so can't be cached
+			processAllAvailable();
+			return;
+		}
+		cache->blocks.push_back(block);
+	}
+	commandCaches[bufferId] = cache;
+	const auto callId = id;
+
+	while (byteAvailable()) {
+		if (!cache->valid || !canUseCommandCache() || cache->commands.size() >= COMMAND_CACHE_MAX_COMMANDS) {
+			cache->valid = false;
+			break;
+		}
+		CachedCommand command;
+		AdvancedOffset start;
+		stream->tellBuffer(start.blockOffset, start.blockIndex);
+		command.command = readByte();
+		command.decoded = decodeCachedCommand(command);
+		if (command.decoded) {
+			executeCachedCommand(command, peekByte_t(FAST_COMMS_TIMEOUT));
+		} else {
+			// process the command as normal, from the start of the command
+			stream->seekTo(start.blockOffset, start.blockIndex);
+			vdu(readByte());
+		}
+		if (id != callId) {
+			// execution has jumped to another buffer
+			cache->valid = false;
+			break;
+		}
+		stream->tellBuffer(command.end.blockOffset, command.end.blockIndex);
+		cache->commands.push_back(command);
+	}
+
+	if (cache->valid && id == callId && !byteAvailable()) {
+		cache->complete = true;
+		debug_log("recordCommandCache: buffer %d cached %d commands\n\r", bufferId, cache->commands.size());
+	} else {
+		auto cacheIter = commandCaches.find(bufferId);
+		if (cacheIter != commandCaches.end() && cacheIter->second == cache) {
+			commandCaches.erase(cacheIter);
+		}
+	}
+	// process anything left over after abandoning a recording
+	processAllAvailable();
+}
+
+// Process a buffer call from its decoded command cache
+// Decoded commands are dispatched directly, and the stream is only used for other commands
+// If a command leaves the stream anywhere other than its recorded end position we carry on uncached
+//
+void VDUStreamProcessor::replayCommandCache(uint16_t bufferId, std::shared_ptr<CommandCache> cache, MultiBufferStream * stream) {
+	auto &commands = cache->commands;
+	const auto callId = id;
+	bool inSync = true;
+
+	for (size_t i = 0; i < commands.size(); i++) {
+		auto &command = commands[i];
+		if (command.decoded) {
+			executeCachedCommand(command, i + 1 < commands.size() ? commands[i + 1].command : -1);
+			inSync = false;
+			continue;
+		}
+		if (!inSync) {
+			auto &previous = commands[i - 1].end;
+			stream->seekTo(previous.blockOffset, previous.blockIndex);
+		}
+		vdu(readByte());
+		AdvancedOffset end;
+		stream->tellBuffer(end.blockOffset, end.blockIndex);
+		if (id != callId || !cache->valid || !canUseCommandCache() || end.blockOffset != command.end.blockOffset || end.blockIndex != command.end.blockIndex) {
+			// execution diverged from our recording, so continue from wherever the stream now is
+			processAllAvailable();
+			return;
+		}
+		inSync = true;
+	}
+	if (!inSync) {
+		auto &last = commands.back().end;
+		stream->seekTo(last.blockOffset, last.blockIndex);
+	}
+}
+
+// Read the arguments for a command that can be cached in decoded form
+// Returns false if the command can't be decoded, or its arguments could not be read
+//
+bool VDUStreamProcessor::decodeCachedCommand(CachedCommand &command) {
+	uint8_t argCount = 0;
+	switch (command.command) {
+		case 0x11:	// COLOUR
+			argCount = 1;
+			break;
+		case 0x12:	// GCOL
+		case 0x1F:	// TAB(X,Y)
+			argCount = 2;
+			break;
+		case 0x1D:	// VDU 29
+			argCount = 4;
+			break;
+		case 0x19:	// PLOT
+			argCount = 5;
+			break;
+		default:
+			return false;
+	}
+	return readIntoBuffer(command.args, argCount) == 0;
+}
+
+// Execute a decoded command
+// next is the command byte that follows, or -1 if there is none
+//
+void VDUStreamProcessor::executeCachedCommand(const CachedCommand &command, int16_t next) {
+	auto args = command.args;
+	switch (command.command) {
+		case 0x11:	// COLOUR
+			context->setTextColour(args[0]);
+			break;
+		case 0x12:	// GCOL
+			context->setGraphicsColour(args[0], args[1]);
+			break;
+		case 0x19: {	// PLOT
+			if (ttxtMode) {
+				break;
+			}
+			auto x = (int16_t)(args[1] | (args[2] << 8));
+			auto y = (int16_t)(args[3] | (args[4] << 8));
+			if (context->plot(x, y, args[0])) {
+				// we have a pending plot command
+				context->plotPending(next);
+			}
+		}	break;
+		case 0x1D:	// VDU 29
+			context->setOrigin(args[0] | (args[1] << 8), args[2] | (args[3] << 8));
+			break;
+		case 0x1F:	// TAB(X,Y)
+			context->cursorTab(args[0], args[1]);
+			break;
+	}
+}
+
 void VDUStreamProcessor::bufferRemoveUsers(uint16_t bufferId) {
 	// remove all users of the given buffer
+	clearCommandCache(bufferId);
 	context->unmapBitmapFromChars(bufferId);
 	clearBitmap(bufferId);
 	clearFont(bufferId);
@@ -391,6 +593,7 @@ void VDUStreamProcessor::bufferClear(uint16_t bufferId) {
 	if (bufferId == 65535) {
 		buffers.clear();
 		matrixMetadata.clear();
+		clearCommandCaches();
 		resetBitmaps();
 		// TODO reset current bitmaps in all processors
 		context->setCurrentBitmap(BUFFERED_BITMAP_BASEID);
@@ -884,6 +1087,8 @@ void VDUStreamProcessor::bufferAdjust(uint16_t adjustBufferId) {
 		debug_log("bufferAdjust: invalid command, count, offset or operand value\n\r");
 		return;
 	}
+	invalidateCommandCaches(buffer);
+	invalidateGlyphIndex();
 
 	MultiBufferStream * instream = nullptr;
 	tcb::span<uint8_t> targetSpan;
@@ -1176,14 +1381,13 @@ void VDUStreamProcessor::bufferJump(uint16_t bufferId, AdvancedOffset offset) {
 		bufferRemoveCallback(bufferId, 65535);
 		return;
 	}
-	// replace our input stream with a new one
-	auto &streams = bufferIter->second;
-	auto multiBufferStream = make_shared_psram<MultiBufferStream>(streams);
+	// re-point our current call stream at the new buffer
+	auto instream = (MultiBufferStream *)inputStream.get();
+	instream->rebind(bufferIter->second);
 	if (offset.blockOffset != 0 || offset.blockIndex != 0) {
-		multiBufferStream->seekTo(offset.blockOffset, offset.blockIndex);
+		instream->seekTo(offset.blockOffset, offset.blockIndex);
 	}
 	id = bufferId;
-	inputStream = std::move(multiBufferStream);
 }
 
 // VDU 23, 0, &A0, bufferId; &0D, sourceBufferId; sourceBufferId; ...; 65535; : Copy blocks from buffers
@@ -1298,7 +1502,7 @@ void VDUStreamProcessor::bufferSplitInto(uint16_t bufferId, uint16_t length, tcb
 		if (iterate) {
 			bufferClear(targetId);
 		}
-		buffers[targetId].push_back(std::move(chunk));
+		buffers[targetId].push_back(chunk);
 		iterate = updateTarget(newBufferIds, targetIter, iterate);
 	}
 	debug_log("bufferSplitInto: split buffer %d into %d blocks of length %d\n\r", bufferId, chunks.size(), length);
@@ -1338,7 +1542,7 @@ void VDUStreamProcessor::bufferSplitByInto(uint16_t bufferId, uint16_t width, ui
 		// and re-jig into our chunks vector
 		auto chunkIndex = 0;
 		for (auto &chunk : rawchunks) {
-			chunks[chunkIndex].push_back(std::move(chunk));
+			chunks[chunkIndex].push_back(chunk);
 			chunkIndex++;
 			if (chunkIndex >= chunkCount) {
 				chunkIndex = 0;
@@ -1378,6 +1582,7 @@ void VDUStreamProcessor::bufferSpreadInto(uint16_t bufferId, tcb::span<uint16_t>
 	// swap the source buffer contents into a local vector so it can be iterated safely even if it's a target
 	BufferVector localBuffer;
 	localBuffer.swap(buffer);
+	clearCommandCache(bufferId);
 	if (!iterate) {
 		clearTargets(newBufferIds);
 	}
@@ -1406,7 +1611,8 @@ void VDUStreamProcessor::bufferReverseBlocks(uint16_t bufferId) {
 	if (bufferIter != buffers.end()) {
 		// reverse the order of the streams
 		auto &buffer = bufferIter->second;
-		std::reverse(buffer.begin(), buffer.end());
+		clearCommandCache(bufferId);
+		buffer.reverse();
 		debug_log("bufferReverseBlocks: reversed blocks in buffer %d\n\r", bufferId);
 	}
 }
@@ -1422,6 +1628,8 @@ void VDUStreamProcessor::bufferReverse(uint16_t bufferId, uint8_t options) {
 		return;
 	}
 	auto &buffer = bufferIter->second;
+	invalidateCommandCaches(buffer);
+	invalidateGlyphIndex();
 	bool use16Bit = options & REVERSE_16BIT;
 	bool use32Bit = options & REVERSE_32BIT;
 	bool useSize  = (options & REVERSE_SIZE) == REVERSE_SIZE;
@@ -1486,7 +1694,7 @@ void VDUStreamProcessor::bufferReverse(uint16_t bufferId, uint8_t options) {
 
 	if (reverseBlocks) {
 		// reverse the order of the streams
-		std::reverse(buffer.begin(), buffer.end());
+		buffer.reverse();
 		debug_log("bufferReverse: reversed blocks in buffer %d\n\r", bufferId);
 	}
 
@@ -1569,6 +1777,8 @@ void VDUStreamProcessor::bufferCopyAndConsolidate(uint16_t bufferId, tcb::span<c
 		buffer.push_back(std::move(bufferStream));
 	}
 
+	invalidateCommandCaches(buffer);
+	invalidateGlyphIndex();
 	auto destination = buffer.front()->getBuffer();
 
 	// loop thru buffer IDs
@@ -2030,6 +2240,85 @@ void VDUStreamProcessor::bufferMatrixManipulate(uint16_t bufferId, uint8_t comma
 }
 
 
+// Convert a float to 16.16 fixed point, saturating at the limits of the integer part
+//
+inline int32_t toFixed16(float value) {
+	constexpr float limit = 32767.0f * 65536.0f;
+	return (int32_t)fabgl::tclamp(value * 65536.0f, -limit, limit);
+}
+
+// Narrow [start, end) to the destination pixels x for which 0 <= position + x * step < limit
+//
+void clipTransformSpan(int64_t position, int64_t step, int64_t limit, int &start, int &end) {
+	// floor division, for possibly negative numerators
+	auto floorDiv = [](int64_t n, int64_t d) { return n >= 0 ? n / d : -((d - 1 - n) / d); };
+	int64_t first = start;
+	int64_t last = end - 1;
+	if (step == 0) {
+		if (position < 0 || position >= limit) {
+			last = first - 1;
+		}
+	} else if (step > 0) {
+		first = std::max(first, -floorDiv(position, step));
+		last = std::min(last, floorDiv(limit - 1 - position, step));
+	} else {
+		first = std::max(first, floorDiv(position - limit, -step) + 1);
+		last = std::min(last, floorDiv(position, -step));
+	}
+	start = first;
+	end = std::max(first, last + 1);
+}
+
+// Read a pixel from an RGBA2222 or RGBA8888 bitmap as 8-bit R, G, B and A channels
+//
+inline void getBitmapChannels(const Bitmap * bitmap, int x, int y, uint32_t * channels) {
+	auto index = y * bitmap->width + x;
+	if (bitmap->format == PixelFormat::RGBA8888) {
+		auto pixel = ((const RGBA8888 *)bitmap->data)[index];
+		channels[0] = pixel.R;
+		channels[1] = pixel.G;
+		channels[2] = pixel.B;
+		channels[3] = pixel.A;
+	} else {
+		auto pixel = ((const RGBA2222 *)bitmap->data)[index];
+		channels[0] = pixel.R * 85;
+		channels[1] = pixel.G * 85;
+		channels[2] = pixel.B * 85;
+		channels[3] = pixel.A * 85;
+	}
+}
+
+// Sample an RGBA2222 or RGBA8888 bitmap with bilinear filtering at a 16.16 fixed point position
+// Samples are taken relative to pixel centres, clamping at the bitmap edges
+//
+RGBA2222 sampleBitmapBilinear(const Bitmap * bitmap, int32_t u, int32_t v) {
+	u -= 0x8000;
+	v -= 0x8000;
+	int x0 = u >> 16;
+	int y0 = v >> 16;
+	uint32_t fx = (u >> 8) & 0xFF;
+	uint32_t fy = (v >> 8) & 0xFF;
+	int x1 = fabgl::imin(x0 + 1, bitmap->width - 1);
+	int y1 = fabgl::imin(y0 + 1, bitmap->height - 1);
+	x0 = fabgl::imax(x0, 0);
+	y0 = fabgl::imax(y0, 0);
+
+	uint32_t p00[4], p10[4], p01[4], p11[4];
+	getBitmapChannels(bitmap, x0, y0, p00);
+	getBitmapChannels(bitmap, x1, y0, p10);
+	getBitmapChannels(bitmap, x0, y1, p01);
+	getBitmapChannels(bitmap, x1, y1, p11);
+
+	uint8_t result[4];
+	for (int c = 0; c < 4; c++) {
+		uint32_t top = p00[c] * (256 - fx) + p10[c] * fx;
+		uint32_t bottom = p01[c] * (256 - fx) + p11[c] * fx;
+		// blend to an 8-bit value, then reduce to 2 bits
+		result[c] = (top * (256 - fy) + bottom * fy) >> 22;
+	}
+	return RGBA2222(result[0], result[1], result[2], result[3]);
+}
+
 // VDU 23, 0, &A0, bufferId; &28, options, transformBufferId; bitmapId; : Apply 2d affine transformation to bitmap
 // Apply an affine transformation to a bitmap, creating a new RGBA2222 format bitmap
 // Replaces the target buffer with the new bitmap, and creates a corresponding bitmap
@@ -2140,25 +2429,50 @@ void VDUStreamProcessor::bufferTransformBitmap(uint16_t bufferId, uint8_t option
 		return;
 	}
 
-	// iterate over our destination buffer, and apply the transformation to each pixel
+	// iterate over our destination buffer, stepping the source position along each row in 16.16 fixed point
+	// the source position for destination pixel (x, y) is inverse * (x + xOffset, y + yOffset, 1)
 	auto destination = (RGBA2222 *)bufferStream->getBuffer();
-	float pos[3] = {0.0f, 0.0f, 1.0f};
-	float srcPos[3] = {0.0f, 0.0f, 1.0f};
+	bool bilinear = (options & TRANSFORM_BITMAP_BILINEAR) && (bitmap->format == PixelFormat::RGBA2222 || bitmap->format == PixelFormat::RGBA8888);
+	auto srcPixels = (const RGBA2222 *)bitmap->data;
+	const int64_t srcWidthFixed = (int64_t)srcWidth << 16;
+	const int64_t srcHeightFixed = (int64_t)srcHeight << 16;
+	const int32_t du = toFixed16(inverse[0]);
+	const int32_t dv = toFixed16(inverse[3]);
 
 	debug_log("bufferTransformBitmap: width %d, height %d, xOffset %d, yOffset %d\n\r", width, height, xOffset, yOffset);
 
 	for (int y = 0; y < height; y++) {
-		for (int x = 0; x < width; x++) {
-			// calculate the source pixel
-			// NB we will need to adjust x,y here if we are auto-translating
-			pos[0] = (float)x + xOffset;
-			pos[1] = (float)y + yOffset;
-			dspm_mult_3x3x1_f32(inverse, pos, srcPos);
-			auto srcPixel = RGBA2222(0,0,0,0);
-			if (srcPos[0] >= 0.0f && srcPos[0] < srcWidthF && srcPos[1] >= 0.0f && srcPos[1] < srcHeightF) {
-				srcPixel = bitmap->getPixel2222((int)srcPos[0], (int)srcPos[1]);
+		auto row = destination + y * width;
+		float rowY = (float)(y + yOffset);
+		int64_t rowU = toFixed16(inverse[0] * xOffset + inverse[1] * rowY + inverse[2]);
+		int64_t rowV = toFixed16(inverse[3] * xOffset + inverse[4] * rowY + inverse[5]);
+
+		// clip the row to the span of destination pixels that land inside the source bitmap
+		int start = 0;
+		int end = width;
+		clipTransformSpan(rowU, du, srcWidthFixed, start, end);
+		clipTransformSpan(rowV, dv, srcHeightFixed, start, end);
+		if (start >= end) {
+			memset(row, 0, width);
+			continue;
+		}
+		memset(row, 0, start);
+		memset(row + end, 0, width - end);
+
+		int32_t u = rowU + (int64_t)start * du;
+		int32_t v = rowV + (int64_t)start * dv;
+		if (bilinear) {
+			for (int x = start; x < end; x++, u += du, v += dv) {
+				row[x] = sampleBitmapBilinear(bitmap.get(), u, v);
+			}
+		} else if (bitmap->format == PixelFormat::RGBA2222) {
+			for (int x = start; x < end; x++, u += du, v += dv) {
+				row[x] = srcPixels[(v >> 16) * srcWidth + (u >> 16)];
+			}
+		} else {
+			for (int x = start; x < end; x++, u += du, v += dv) {
+				row[x] = bitmap->getPixel2222(u >> 16, v >> 16);
 			}
-			destination[(int)y * width + (int)x] = srcPixel;
 		}
 	}
 
@@ -2388,6 +2702,8 @@ void VDUStreamProcessor::bufferReadFlag(uint16_t bufferId) {
 		debug_log("bufferReadFlag: buffer %d not found or offset %d out of range\n\r", bufferId, offset.blockOffset);
 		return;
 	}
+	invalidateCommandCaches(buffers[bufferId]);
+	invalidateGlyphIndex();
 
 	if (isFeatureFlagSet(flagId)) {
 		// flag exists, so write it to the buffer
@@ -2408,10 +2724,12 @@ void VDUStreamProcessor::bufferReadFlag(uint16_t bufferId) {
 }
 
 // VDU 23, 0, &A0, bufferId; &40, sourceBufferId; : Compress blocks from a buffer
+// VDU 23, 0, &A0, bufferId; &42, format, sourceBufferId; : Compress blocks from a buffer using a given format
 // Compress (blocks from) a buffer into a new buffer.
+// Format is the compression type from the header, either "T" (TurboVega, default) or "L" (LZ4-style)
 // Replaces the target buffer with the new one.
 //
-void VDUStreamProcessor::bufferCompress(uint16_t bufferId, uint16_t sourceBufferId) {
+void VDUStreamProcessor::bufferCompress(uint16_t bufferId, uint16_t sourceBufferId, uint8_t format) {
 	debug_log("Compressing into buffer %u\n\r", bufferId);
 
 	auto sourceBufferIter = buffers.find(sourceBufferId);
@@ -2419,9 +2737,19 @@ void VDUStreamProcessor::bufferCompress(uint16_t bufferId, uint16_t sourceBuffer
 		debug_log("bufferCompress: buffer %d not found\n\r", sourceBufferId);
 		return;
 	}
+	auto &sourceBuffer = sourceBufferIter->second;
+	if (format == COMPRESSION_TYPE_LZ) {
+		bufferCompressLZ(bufferId, sourceBuffer);
+		return;
+	}
+	if (format != COMPRESSION_TYPE_TURBO) {
+		debug_log("bufferCompress: unknown compression format %d\n\r", format);
+		return;
+	}
 
-	// create a temporary output buffer, which may be expanded during compression
-	uint8_t* p_temp = (uint8_t*) ps_malloc(COMPRESSION_OUTPUT_CHUNK_SIZE);
+	// create a temporary output buffer, large enough for the worst case output
+	auto temp_size = agon_max_compressed_size(sourceBuffer.totalSize());
+	uint8_t* p_temp = (uint8_t*) ps_malloc(temp_size);
 	if (p_temp) {
 		// prepare for doing compression
 		CompressionData cd;
@@ -2442,7 +2770,6 @@ void VDUStreamProcessor::bufferCompress(uint16_t bufferId, uint16_t sourceBuffer
 
 		// loop thru blocks stored against the source buffer ID
 		uint32_t orig_size = 0;
-		auto &sourceBuffer = sourceBufferIter->second;
 		for (const auto &block : sourceBuffer) {
 			// compress the block into our temporary buffer
 			auto bufferLength = block->size();
@@ -2463,6 +2790,7 @@ void VDUStreamProcessor::bufferCompress(uint16_t bufferId, uint16_t sourceBuffer
 		if (!bufferStream || !bufferStream->getBuffer()) {
 			// buffer couldn't be created
 			debug_log("bufferCompress: failed to create buffer %d\n\r", bufferId);
+			heap_caps_free(p_temp);
 			return;
 		}
 
@@ -2483,7 +2811,7 @@ void VDUStreamProcessor::bufferCompress(uint16_t bufferId, uint16_t sourceBuffer
 		debug_log("Compressed %u input bytes to %u output bytes (%u%%) at %08X\n\r",
 				cd.input_count, cd.output_count, pct, destination);
 	} else {
-		debug_log("bufferCompress: cannot allocate temporary buffer of %d bytes\n\r", COMPRESSION_OUTPUT_CHUNK_SIZE);
+		debug_log("bufferCompress: cannot allocate temporary buffer of %d bytes\n\r", temp_size);
 	}
 }
 
@@ -2512,11 +2840,18 @@ void VDUStreamProcessor::bufferDecompress(uint16_t bufferId, uint16_t sourceBuff
 	if (p_hdr->marker[0] != 'C' ||
 		p_hdr->marker[1] != 'm' ||
 		p_hdr->marker[2] != 'p' ||
-		p_hdr->type != COMPRESSION_TYPE_TURBO) {
+		(p_hdr->type != COMPRESSION_TYPE_TURBO && p_hdr->type != COMPRESSION_TYPE_LZ)) {
 		debug_log("bufferDecompress: header is invalid\n\r");
 		return;
 	}
 	auto orig_size = p_hdr->orig_size;
+	if (p_hdr->type == COMPRESSION_TYPE_LZ) {
+		bufferDecompressLZ(bufferId, sourceBuffer, orig_size);
+		#ifdef DEBUG
+		debug_log("Decompress took %u ms\n\r", millis() - start);
+		#endif
+		return;
+	}
 
 	debug_log("Decompressing into buffer %u\n\r", bufferId);
 
@@ -2571,6 +2906,75 @@ void VDUStreamProcessor::bufferDecompress(uint16_t bufferId, uint16_t sourceBuff
 	#endif
 }
 
+// Compress a buffer using the LZ4-style format
+// The source must be contiguous for matching, so is consolidated first if necessary
+//
+void VDUStreamProcessor::bufferCompressLZ(uint16_t bufferId, const BufferVector &sourceBuffer) {
+	auto source = consolidateBuffers(sourceBuffer);
+	uint32_t orig_size = source ? source->size() : 0;
+	if (!source && !sourceBuffer.empty()) {
+		debug_log("bufferCompress: failed to consolidate source buffer\n\r");
+		return;
+	}
+
+	auto temp_size = agon_lz_max_compressed_size(orig_size);
+	auto p_temp = make_unique_psram_array<uint8_t>(temp_size);
+	auto hash_table = make_unique_psram_array<uint32_t>(LZ_HASH_SIZE);
+	if (!p_temp || !hash_table) {
+		debug_log("bufferCompress: cannot allocate temporary buffer of %d bytes\n\r", temp_size);
+		return;
+	}
+
+	auto p_hdr = (CompressionFileHeader*) p_temp.get();
+	p_hdr->marker[0] = 'C';
+	p_hdr->marker[1] = 'm';
+	p_hdr->marker[2] = 'p';
+	p_hdr->type = COMPRESSION_TYPE_LZ;
+	p_hdr->orig_size = orig_size;
+	auto output_count = sizeof(CompressionFileHeader);
+	if (orig_size) {
+		output_count += agon_lz_compress(source->getBuffer(), orig_size, p_temp.get() + output_count, hash_table.get());
+	}
+
+	auto bufferStream = make_shared_psram<BufferStream>(output_count);
+	if (!bufferStream || !bufferStream->getBuffer()) {
+		// buffer couldn't be created
+		debug_log("bufferCompress: failed to create buffer %d\n\r", bufferId);
+		return;
+	}
+	memcpy(bufferStream->getBuffer(), p_temp.get(), output_count);
+	bufferClear(bufferId);
+	buffers[bufferId].push_back(bufferStream);
+	debug_log("Compressed %u input bytes to %u output bytes\n\r", orig_size, output_count);
+}
+
+// Decompress a buffer using the LZ4-style format
+// Matches can reach back across block boundaries, so multiple blocks are consolidated first
+//
+void VDUStreamProcessor::bufferDecompressLZ(uint16_t bufferId, const BufferVector &sourceBuffer, uint32_t orig_size) {
+	auto source = consolidateBuffers(sourceBuffer);
+	if (!source) {
+		debug_log("bufferDecompress: failed to consolidate source buffer\n\r");
+		return;
+	}
+
+	auto bufferStream = make_shared_psram<BufferStream>(orig_size);
+	if (!bufferStream || !bufferStream->getBuffer()) {
+		// buffer couldn't be created
+		debug_log("bufferDecompress: failed to create buffer %d\n\r", bufferId);
+		return;
+	}
+
+	auto skip_hdr = sizeof(CompressionFileHeader);
+	auto output_count = agon_lz_decompress(source->getBuffer() + skip_hdr, source->size() - skip_hdr, bufferStream->getBuffer(), orig_size);
+	if (output_count != orig_size) {
+		debug_log("Decompressed buffer size %u does not equal original size %u\r\n", output_count, orig_size);
+	}
+	bufferClear(bufferId);
+	buffers[bufferId].push_back(bufferStream);
+	debug_log("Decompressed %u input bytes to %u output bytes\n\r", source->size(), output_count);
+}
+
 // VDU 23, 0, &A0, bufferId; &48, options, sourceBufferId; [width;] [mapBufferId;] [mapValues...] : Expand a bitmap buffer
 // Expands a bitmap buffer into a new buffer with 8-bit values
 // options dictates how the expansion is done
@@ -14,7 +14,7 @@
 
 #define VDP_LAYER_TILEBANK_INIT				0x00		// VDU 23,0,194,0
 #define VDP_LAYER_TILEBANK_LOAD				0x01		// VDU 23,0,194,1
-#define VDP_LAYER_TILEBANK_LOAD_BUFFER		0x02		// VDU 23,0,194,2	[Future]
+#define VDP_LAYER_TILEBANK_LOAD_BUFFER		0x02		// VDU 23,0,194,2
 #define VDP_LAYER_TILEBANK_DRAW				0x06		// VDU 23,0,194,6
 #define VDP_LAYER_TILEBANK_FREE				0x07		// VDU 23,0,194,7
 #define VDP_LAYER_TILEPALETTE_INIT			0x08		// VDU 23,0,194,8	[Future]
@@ -24,7 +24,7 @@
 #define VDP_LAYER_TILEPALETTE_FREE			0x0F		// VDU 23,0,194,15 	[Future]
 #define VDP_LAYER_TILEMAP_INIT				0x10		// VDU 23,0,194,16
 #define VDP_LAYER_TILEMAP_SET_TILE			0x11		// VDU 23,0,194,17
-#define VDP_LAYER_TILEMAP_SET_MULTIPLE		0x12		// VDU 23,0,194,18	[Future]
+#define VDP_LAYER_TILEMAP_SET_MULTIPLE		0x12		// VDU 23,0,194,18
 #define VDP_LAYER_TILEMAP_FREE				0x17		// VDU 23,0,194,23
 #define VDP_LAYER_TILELAYER_INIT			0x18		// VDU 23,0,194,24
 #define VDP_LAYER_TILELAYER_SET_PROPERTY	0x19		// VDU 23,0,194,25
@@ -36,6 +36,12 @@
 #define VDP_LAYER_TILELAYER_DRAW_LAYERBUFFER	0x1D		// VDU 23,0,194,29 	[Future]
 #define VDP_LAYER_TILELAYER_DRAW				0x1E		// VDU 23,0,194,30
 #define VDP_LAYER_TILELAYER_FREE				0x1F		// VDU 23,0,194,31
+#define VDP_LAYER_TILELAYER_DRAW_ALL			0x20		// VDU 23,0,194,32
+
+// Tile layer properties, set with VDP_LAYER_TILELAYER_SET_PROPERTY
+#define VDP_LAYER_PROPERTY_TILEBANK			0x00		// Tile bank the layer draws its tiles from
+#define VDP_LAYER_PROPERTY_PRIORITY			0x01		// Layers with a higher priority are drawn on top
+#define VDP_LAYER_PROPERTY_VISIBLE			0x02		// Non-zero to include the layer in VDP_LAYER_TILELAYER_DRAW_ALL
 
 // Begin: Function Prototypes for internal Tile Engine use
 void debug_log_mem(void);
@@ -53,7 +59,7 @@ void VDUStreamProcessor::vdu_sys_layers(void) {
 
 			// VDU 23,0,194,0,<tileBankNum>,<tileBankBitDepth>,<reservedParameter1>,<reservedParameter2>
 
-			uint8_t tileBankNum = readByte_t();			// 0 [Future: 0-3]
+			uint8_t tileBankNum = readByte_t();			// 0-3
 			uint8_t tileBankBitDepth = readByte_t();	// 0 = 64 colours, [Future: 1 = 16 colours, 2 = 4 colours, 3 = 2 colours]
 			uint8_t reservedParameter1 = readByte_t();	// Ignored in release 1.0. Should be set to 0.
 			uint8_t reservedParameter2 = readByte_t();	// Ignored in release 1.0. Should be set to 0.
@@ -66,7 +72,7 @@ void VDUStreamProcessor::vdu_sys_layers(void) {
 
 			// VDU 23,0,194,1,<tileBankNum>,<tileNumber>,<pixel0>,...<pixel63>
 
-			uint8_t tileBankNum = readByte_t();			// 0 [Future: 0-3]
+			uint8_t tileBankNum = readByte_t();			// 0-3
 			uint8_t tileId = readByte_t();				// 0-255
 
 			vdu_sys_layers_tilebank_load(tileBankNum, tileId);
@@ -75,6 +81,14 @@ void VDUStreamProcessor::vdu_sys_layers(void) {
 
 		case VDP_LAYER_TILEBANK_LOAD_BUFFER: {
 
+			// VDU 23,0,194,2,<tileBankNum>,<tileId>,<bufferId;>
+
+			uint8_t tileBankNum = readByte_t();			// 0-3
+			uint8_t tileId = readByte_t();				// First tile to load, 0-255
+			uint16_t bufferId = readWord_t();
+
+			vdu_sys_layers_tilebank_load_buffer(tileBankNum, tileId, bufferId);
+
 		} break;
 
 		case VDP_LAYER_TILEBANK_DRAW: {
@@ -136,6 +150,20 @@ void VDUStreamProcessor::vdu_sys_layers(void) {
 
 		case VDP_LAYER_TILEMAP_SET_MULTIPLE: {
 
+			// VDU 23,0,194,18,<tilelayernumber>,<xpos>,<ypos>,<width>,<height>,<bufferId;>,<stride;>
+			// The buffer holds <tileid>,<tileattribute> pairs. Stride is the number of tiles from the start
+			// of one row to the next in the buffer, or 0 if the rows are packed.
+
+			uint8_t tileLayerNum = readByte_t();
+			uint8_t xPos = readByte_t();
+			uint8_t yPos = readByte_t();
+			uint8_t width = readByte_t();
+			uint8_t height = readByte_t();
+			uint16_t bufferId = readWord_t();
+			uint16_t stride = readWord_t();
+
+			vdu_sys_layers_tilemap_set_multiple(tileLayerNum, xPos, yPos, width, height, bufferId, stride);
+
 		} break;
 
 		case VDP_LAYER_TILEMAP_FREE: {
@@ -169,6 +197,14 @@ void VDUStreamProcessor::vdu_sys_layers(void) {
 
 		case VDP_LAYER_TILELAYER_SET_PROPERTY: {
 
+			// VDU 23,0,194,25,<tileLayerNum>,<property>,<value>
+
+			uint8_t tileLayerNum = readByte_t();
+			uint8_t property = readByte_t();
+			uint8_t value = readByte_t();
+
+			vdu_sys_layers_tilelayer_set_property(tileLayerNum, property, value);
+
 		} break;
 
 		case VDP_LAYER_TILELAYER_SET_SCROLL: {
@@ -227,6 +263,14 @@ void VDUStreamProcessor::vdu_sys_layers(void) {
 			vdu_sys_layers_tilelayer_free(tileLayerNum);
 
 		} break;
+
+		case VDP_LAYER_TILELAYER_DRAW_ALL: {
+
+			// VDU 23,0,194,32
+
+			vdu_sys_layers_tilelayer_draw_all();
+
+		} break;
 	}
 }
 
@@ -235,6 +279,11 @@ void VDUStreamProcessor::vdu_sys_layers_tilebank_init(uint8_t tileBankNum, uint8
 	// Initial release to only support 8bpp tiles
 	if (tileBankBitDepth != 0) return;
 
+	if (tileBankNum >= MAX_TILE_BANKS) {
+		debug_log("vdu_sys_layers_tilebank_init: Invalid tilebank %d specified.\r\n",tileBankNum);
+		return;
+	}
+
 	// Initial release to only support 8x8 tiles
 	uint8_t tileBankTileWidth = 8;
 	uint8_t tileBankTileHeight = 8;
@@ -245,42 +294,36 @@ void VDUStreamProcessor::vdu_sys_layers_tilebank_init(uint8_t tileBankNum, uint8
 	debug_log("In vdu_sys_layers_tilebank_init: Before memory allocation\n\r");
 	debug_log_mem();
 
-	switch (tileBankNum) {		// Which tile bank is being initiated?
+	auto &tileBank = tileBanks[tileBankNum];
 
-		case 0: {				// Tile Bank 0
-			
-			// Check if already exists
-			
-			if (tileBank0Data != NULL) {
+	// Check if already exists
 
-				// If already exists, then free and reallocate
-				vdu_sys_layers_tilebank_free(tileBankNum);
-			}
-			
-			// Now allocate the new memory
-			tileBank0Data = heap_caps_malloc(tileBankBufferSize,MALLOC_CAP_SPIRAM);
-						
-			// Only continue if the reinit was successful
-			
-			if (tileBank0Data != NULL) {
+	if (tileBank.ptr != NULL) {
 
-				// Cast the void pointer to an integer
-				tileBank0Ptr = (uint8_t *)tileBank0Data;
+		// If already exists, then free and reallocate
+		vdu_sys_layers_tilebank_free(tileBankNum);
+	}
 
-				// Set every byte in the tile bank to 0
-				for (auto i=0; i <tileBankBufferSize; i++)
-					*(tileBank0Ptr + i) = 0; 
-			}
-			else {
-				// Something went wrong. Calll the free function to clear up the memory
-				vdu_sys_layers_tilebank_free(tileBankNum);
-			}
-		} break;
+	// Now allocate the new memory
+	tileBank.data = heap_caps_malloc(tileBankBufferSize,MALLOC_CAP_SPIRAM);
+	tileBank.variantData = heap_caps_malloc(TILEBANK_VARIANTS_SIZE,MALLOC_CAP_SPIRAM);
+	invalidateTileBankLayers(tileBankNum);
 
-		default: {
-			debug_log("vdu_sys_layers_tilebank_init: Invalid tilebank %d specified.\r\n",tileBankNum);
-			return;
-		}
+	// Only continue if the reinit was successful
+
+	if (tileBank.data != NULL && tileBank.variantData != NULL) {
+
+		// Cast the void pointer to an integer
+		tileBank.ptr = (uint8_t *)tileBank.data;
+		tileBank.variants = (uint8_t *)tileBank.variantData;
+
+		// Set every byte in the tile bank to 0, which is also correct for the blank variants
+		memset(tileBank.ptr, 0, tileBankBufferSize);
+		memset(tileBank.variants, 0, TILEBANK_VARIANTS_SIZE);
+	}
+	else {
+		// Something went wrong. Calll the free function to clear up the memory
+		vdu_sys_layers_tilebank_free(tileBankNum);
 	}
 
 	debug_log("In vdu_sys_layers_tilebank_init: After memory allocation\n\r");
@@ -289,62 +332,110 @@ void VDUStreamProcessor::vdu_sys_layers_tilebank_init(uint8_t tileBankNum, uint8
 
 void VDUStreamProcessor::vdu_sys_layers_tilebank_load(uint8_t tileBankNum, uint8_t tileId) {
 
-	// Note: In the initial release of the Tile Engine, the tileBankNum is ignored as there is only
-	// a single tile bank.
+	// Only do something if the tilebank exists
 
-	uint8_t sourcePixel = 0;
-	int destPixel = 0;
+	if (tileBankNum < MAX_TILE_BANKS && tileBanks[tileBankNum].ptr != NULL && detachTileBank(tileBanks[tileBankNum])) {
 
-	// Only do something if the tilebank exists
+		auto &tileBank = tileBanks[tileBankNum];
 
-	if (tileBank0Data != NULL) {
-	
 		// Initial implementation is hardcoded to 8x8 tiles and 64 colours (i.e., 64 pixels * 1 byte per pixel)
 
 		for (auto n=0; n<64; n++) {
-			sourcePixel = readByte_t();
-			destPixel = (tileId * 64) + n;
-			tileBank0Ptr[destPixel]= sourcePixel;
+			tileBank.ptr[(tileId * 64) + n] = readByte_t();
 		}
+		updateTileVariants(tileBank, tileId);
+
+		// Tile graphics have changed, so every layer using this bank needs redrawing
+		invalidateTileBankLayers(tileBankNum);
 	} else {
-		debug_log("vdu_sys_layers_tilebank_load: tileBank0Data is not defined.\r\n");
+		// Consume the tile data so that the stream stays in sync
+		for (auto n=0; n<64; n++) {
+			readByte_t();
+		}
+		debug_log("vdu_sys_layers_tilebank_load: tileBank %d is not defined.\r\n",tileBankNum);
 	}
 }
 
-void VDUStreamProcessor::vdu_sys_layers_tilebank_draw(uint8_t tileBankNum, uint8_t tileId, uint8_t palette, uint8_t xPos, uint8_t yPos, uint8_t xOffset, uint8_t yOffset, uint8_t tileAttribute) {
+void VDUStreamProcessor::vdu_sys_layers_tilebank_load_buffer(uint8_t tileBankNum, uint8_t tileId, uint16_t bufferId) {
+
+	// Load consecutive tiles from a buffer, starting at tileId, for as many whole tiles as the buffer holds.
+	// A single block buffer holding a whole bank is used in place rather than copied. The bank then shares
+	// the buffer's storage, so the buffer should be loaded again if it is changed.
+
+	if (tileBankNum >= MAX_TILE_BANKS || tileBanks[tileBankNum].ptr == NULL) {
+		debug_log("vdu_sys_layers_tilebank_load_buffer: tileBank %d is not defined.\r\n",tileBankNum);
+		return;
+	}
+
+	auto bufferIter = buffers.find(bufferId);
+	if (bufferIter == buffers.end()) {
+		debug_log("vdu_sys_layers_tilebank_load_buffer: buffer %d not found.\r\n",bufferId);
+		return;
+	}
+
+	auto &buffer = bufferIter->second;
+	auto &tileBank = tileBanks[tileBankNum];
+	int tileCount = std::min<uint32_t>(buffer.totalSize() / 64, 256 - tileId);
+
+	if (tileId == 0 && buffer.size() == 1 && tileCount == 256) {
+
+		// Adopt the buffer's storage, releasing the bank's own
+
+		if (tileBank.data != NULL) {
+			heap_caps_free(tileBank.data);
+			tileBank.data = NULL;
+		}
+		tileBank.source = buffer[0];
+		tileBank.ptr = tileBank.source->getBuffer();
+
+	} else {
+
+		if (!detachTileBank(tileBank)) return;
+
+		// Copy the tiles, which may straddle buffer blocks
+
+		uint8_t * dest = tileBank.ptr + (tileId * 64);
+		uint32_t remaining = tileCount * 64;
+		AdvancedOffset offset = {};
+
+		while (remaining > 0) {
+			auto span = getBufferSpan(buffer, offset);
+			if (span.empty()) break;
+			uint32_t count = std::min<uint32_t>(span.size(), remaining);
+			memcpy(dest, span.data(), count);
+			dest += count;
+			remaining -= count;
+			offset.blockOffset += count;
+		}
+	}
+
+	for (auto n=0; n<tileCount; n++) {
+		updateTileVariants(tileBank, tileId + n);
+	}
+
+	// Tile graphics have changed, so every layer using this bank needs redrawing
+	invalidateTileBankLayers(tileBankNum);
+}
 
-	// Initial release only supports tileBank 0
+void VDUStreamProcessor::vdu_sys_layers_tilebank_draw(uint8_t tileBankNum, uint8_t tileId, uint8_t palette, uint8_t xPos, uint8_t yPos, uint8_t xOffset, uint8_t yOffset, uint8_t tileAttribute) {
 
-	if (tileBankNum != 0) {
+	if (tileBankNum >= MAX_TILE_BANKS) {
 		debug_log("vdu_sys_layers_tilebank_draw: Invalid tileBankNum %d specified.\r\n",tileBankNum);
 		return;
 	}
-	
+
 	// tileId 0 is special so cannot be drawn
 	if (tileId == 0) return;
 
 	int xPix, yPix;
 
-	if (tileBank0Data != NULL) {
-
-		// Check attribute bits 0 and 1 to get tile draw direction and call appropriate draw function
-
-		uint8_t tileFlip = tileAttribute & 0x03;
-
-		switch (tileFlip) {
-			case 0x00:		// Normal drawing
-				writeTileToBuffer(tileId, 0, 0, currentTileDataBuffer, 1);
-				break;
-			case 0x01:		// Flip X
-				writeTileToBufferFlipX(tileId, 0, 0, currentTileDataBuffer, 1);
-				break;
-			case 0x02:		// Flip Y
-				writeTileToBufferFlipY(tileId, 0, 0, currentTileDataBuffer, 1);
-				break;
-			case 0x03:		// Flip X and Y
-				writeTileToBufferFlipXY(tileId, 0, 0, currentTileDataBuffer, 1);
-				break;
-		}
+	auto &tileBank = tileBanks[tileBankNum];
+
+	if (tileBank.ptr != NULL) {
+
+		// Attribute bits 0 and 1 select the pre-flipped tile variant to draw
+
+		writeTileToBuffer(tileBank, tileId, tileAttribute, currentTileDataBuffer);
 
 		xPix = (xPos * 8) - xOffset;
 		yPix = (yPos * 8) - yOffset;
@@ -353,32 +444,38 @@ void VDUStreamProcessor::vdu_sys_layers_tilebank_draw(uint8_t tileBankNum, uint8
 
 		// Draw Tile
 
+		invalidateScreenChars();
 		canvas->drawBitmap(xPix,yPix,&currentTile);
 
 		waitPlotCompletion();		// If this is not set then tiles do not display correctly if called rapidly.
 
 	} else {
-		debug_log("vdu_sys_layers_tilebank_draw: tileBank0Data not initialised.\r\n");
+		debug_log("vdu_sys_layers_tilebank_draw: tileBank %d not initialised.\r\n",tileBankNum);
 	}
 }
 
 void VDUStreamProcessor::vdu_sys_layers_tilebank_free(uint8_t tileBankNum) {
 
+	if (tileBankNum >= MAX_TILE_BANKS) {
+		debug_log("vdu_sys_layers_tilebank_free: Invalid tileBankNum %d specified.\r\n",tileBankNum);
+		return;
+	}
+
 	debug_log("In vdu_sys_layers_tilebank_free: Before memory free call\n\r");
 	debug_log_mem();
 
-	switch (tileBankNum) {
-		case 0: {
-			if (tileBank0Data != NULL) {
-				debug_log("vdu_sys_layers_tilebank_free: Freeing tileBank0Data.\r\n");
-				heap_caps_free(tileBank0Data);
-				tileBank0Data = NULL;
-			}
-		} break;
-		
-		default: {
-			debug_log("vdu_sys_layers_tilebank_free: Invalid tileBankNum %d specified.\r\n",tileBankNum);
-		}
+	auto &tileBank = tileBanks[tileBankNum];
+
+	if (tileBank.data != NULL) {
+		debug_log("vdu_sys_layers_tilebank_free: Freeing tileBank %d.\r\n",tileBankNum);
+		heap_caps_free(tileBank.data);
+		tileBank.data = NULL;
+	}
+	tileBank.source.reset();
+	tileBank.ptr = NULL;
+	if (tileBank.variantData != NULL) {
+		heap_caps_free(tileBank.variantData);
+		tileBank.variantData = NULL;
 	}
 
 	debug_log("In vdu_sys_layers_tilebank_free: After memory free call\r\n");
@@ -387,244 +484,222 @@ void VDUStreamProcessor::vdu_sys_layers_tilebank_free(uint8_t tileBankNum) {
 
 void VDUStreamProcessor::vdu_sys_layers_tilemap_init(uint8_t tileLayerNum, uint8_t tileMapSize) {
 
+	// Each tile layer has its own tile map, with the same number
+
+	if (tileLayerNum >= MAX_TILE_LAYERS) {
+		debug_log("vdu_sys_layers_tilemap_init: Invalid tileLayerNum %d specified.\r\n",tileLayerNum);
+		return;
+	}
+
 	debug_log("In vdu_sys_layers_tilemap_init: Before memory allocation\n\r");
 	debug_log_mem();
 
-	// Check if tileMap0 already exists and free if it is.
-
-	switch (tileLayerNum) {
+	auto &tileMap = tileMaps[tileLayerNum];
 
-		case 0: {		// If tilemap/layer number is 0
-			
-			// Check if already exists
-	
-			if (tileMap0 != NULL) {
-				// If already exists, then free and reinitialise
+	// Check if already exists
 
-				vdu_sys_layers_tilemap_free(tileLayerNum); 
-			}
-			
-		} break;
+	if (tileMap.tiles != NULL) {
+		// If already exists, then free and reinitialise
 
-		default: {
-			debug_log("vdu_sys_layers_tilemap_init: Invalid tileLayerNum %d specified.\r\n",tileLayerNum);
-			return;
-		}
+		vdu_sys_layers_tilemap_free(tileLayerNum);
 	}
 
 	//	The following tile map sizes are supported:
 	//	0=32x32, 1=32x64, 2=32x128, 3=64x32, 4=64x64, 5=64x128, 6=128x32, 7=128x64, 8=128x128
 
-	switch (tileMapSize) {
+	if (tileMapSize > 8) {
+		debug_log("vdu_sys_layers_tilemap_init: Invalid tileMapSize %d specified.\r\n",tileMapSize);
+		return;
+	}
 
-		case 0: {		// 32x32 tilemap
-			
-			tileMap0Properties.width = 32;
-			tileMap0Properties.height = 32;
+	tileMap.width = 32 << (tileMapSize / 3);
+	tileMap.height = 32 << (tileMapSize % 3);
 
-		} break;
+	uint8_t tileMapWidth = tileMap.width;
+	uint8_t tileMapHeight = tileMap.height;
 
-		case 1: {		// 32x64 tilemap
-			
-			tileMap0Properties.width = 32;
-			tileMap0Properties.height = 64;
+	tileMap.dirtyTiles.clear();
+	tileLayers[tileLayerNum].rendered = false;
 
-		} break;
+	int tileMapBufferSize = tileMapWidth * sizeof(struct Tile*);
 
-		case 2: {		// 32x128 tilemap
-			
-			tileMap0Properties.width = 32;
-			tileMap0Properties.height = 128;
+	bool tileMapMemoryAllocation = false;			// Flag to check memory allocation status. Default to false (i.e., not allocated).
 
-		} break;
+	// Allocate memory wide enough for each column in the tile map
+	tileMap.tiles = (struct Tile**)heap_caps_malloc(tileMapBufferSize,MALLOC_CAP_SPIRAM);
 
-		case 3: {		// 64x32 tilemap
-			
-			tileMap0Properties.width = 64;
-			tileMap0Properties.height = 32;
+	// If memory allocation for the width of the tilemap was a success, then allocate memory for each column in the tilemap
 
-		} break;
+	if (tileMap.tiles != NULL) {
 
-		case 4: {		// 64x64 tilemap
-			
-			tileMap0Properties.width = 64;
-			tileMap0Properties.height = 64;
+		// If tiles is not null, then the memory has been successfully allocated
 
-		} break;
+		tileMapMemoryAllocation = true;
 
-		case 5: {		// 64x128 tilemap
-			
-			tileMap0Properties.width = 64;
-			tileMap0Properties.height = 128;
+		// As memory allocation was successful for the width of the tilemap, now allocate a column for each row
 
-		} break;
+		for (auto i=0; i<tileMapWidth; i++) {
+			tileMap.tiles[i] = (struct Tile*)heap_caps_malloc(tileMapHeight * sizeof(struct Tile),MALLOC_CAP_SPIRAM);
 
-		case 6: {		// 128x32 tilemap
-			
-			tileMap0Properties.width = 128;
-			tileMap0Properties.height = 32;
+			// Check that the memory allocation for the row is successful
+			if (tileMap.tiles[i] == NULL) {
+				debug_log("vdu_sys_layers_tilemap_init: Failed to allocate memory for column %d of tile map %d.\r\n",i,tileLayerNum);
+				tileMapMemoryAllocation = false;
+			}
+		}
+	} else {
+		debug_log("vdu_sys_layers_tilemap_init: Failed to allocate memory for tile map %d.\r\n",tileLayerNum);
 
-		} break;
+		tileMapMemoryAllocation = false;
 
-		case 7: {		// 128x64 tilemap
-			
-			tileMap0Properties.width = 128;
-			tileMap0Properties.height = 64;
+	}
 
-		} break;
+	// Check that memory allocation was successful. If not, then clean up. If successful, then set contents to 0.
 
-		case 8: {		// 128x128 tilemap
-			
-			tileMap0Properties.width = 128;
-			tileMap0Properties.height = 128;
+	if (tileMapMemoryAllocation == false) {
 
-		} break;
+		// Tidy up by calling free...
 
-		default: {
-			debug_log("vdu_sys_layers_tilemap_init: Invalid tileMapSize %d specified.\r\n",tileMapSize);
-			return;
-		}
-	}
+		vdu_sys_layers_tilemap_free(tileLayerNum);
 
-	uint8_t tileMapWidth = tileMap0Properties.width;
-	uint8_t tileMapHeight = tileMap0Properties.height;
+	} else {
 
-	int tileMapBufferSize = tileMapWidth * sizeof(struct Tile*);
+		// Only continue if the init was successful...
 
-	bool tileMapMemoryAllocation = false;			// Flag to check memory allocation status. Default to false (i.e., not allocated).
+		// Set every byte in the tile map to 0
+
+		for (auto i=0; i<tileMapWidth; i++) {
+			memset(tileMap.tiles[i], 0, tileMapHeight * sizeof(struct Tile));
+		}
 
-	// Initial release to only support a single tile layer
-	if (tileLayerNum != 0) {
-		debug_log("vdu_sys_layers_tilemap_init: Invalid tileLayerNum %d specified.\r\n",tileLayerNum);
-		return;
 	}
 
-	switch (tileLayerNum) {
+	debug_log("In vdu_sys_layers_tilemap_init: After memory allocation\n\r");
+	debug_log_mem();
+}
 
-		case 0: {		// If tile map number is 0
-						
-			// Allocate memory wide enough for each column in the tile map
-			tileMap0 = (struct Tile**)heap_caps_malloc(tileMapBufferSize,MALLOC_CAP_SPIRAM);
+void VDUStreamProcessor::vdu_sys_layers_tilemap_set(uint8_t tileLayerNum, uint8_t xPos, uint8_t yPos, uint8_t tileId, uint8_t tileAttribute) {
 
-			// If memory allocation for the width of the tilemap was a success, then allocate memory for each column in the tilemap
+	if (tileLayerNum >= MAX_TILE_LAYERS) {
+		debug_log("vdu_sys_layers_tilemap_set: Invalid tileLayerNum %d specified.\r\n",tileLayerNum);
+		return;
+	}
 
-			if (tileMap0 != NULL) {
+	auto &tileMap = tileMaps[tileLayerNum];
 
-				// If tileMap0 is not null, then the memory has been successfully allocated
+	if (tileMap.tiles != NULL) {
+		// Skip if passed x and y are greater than the size of the tilemap
+		if (xPos >= tileMap.width || yPos >= tileMap.height) return;
 
-				tileMapMemoryAllocation = true;
+		tileMap.tiles[xPos][yPos].id = tileId;
+		tileMap.tiles[xPos][yPos].attribute = tileAttribute;
+		markTileDirty(tileLayers[tileLayerNum], tileMap, xPos, yPos);
+	}
+}
 
-				// As memory allocation was successful for the width of the tilemap, now allocate a column for each row
+void VDUStreamProcessor::vdu_sys_layers_tilemap_set_multiple(uint8_t tileLayerNum, uint8_t xPos, uint8_t yPos, uint8_t width, uint8_t height, uint16_t bufferId, uint16_t stride) {
 
-				for (auto i=0; i<tileMapWidth; i++) {
-					tileMap0[i] = (struct Tile*)heap_caps_malloc(tileMapHeight * sizeof(struct Tile),MALLOC_CAP_SPIRAM);
+	// Set a rectangle of tiles from a buffer of (tileId, tileAttribute) pairs, a row at a time.
+	// Tiles outside the tile map are skipped.
+	// NB tiles must not span over buffer block boundaries
 
-					// Check that the memory allocation for the row is successful
-					if (tileMap0[i] == NULL) {
-						debug_log("vdu_sys_layers_tilemap_init: Failed to allocate memory for tileMap0[%d].\r\n",tileMap0[i]);
-						tileMapMemoryAllocation = false;
-					}
-				}
-			} else {
-				debug_log("vdu_sys_layers_tilemap_init: Failed to allocate memory for tileMap0.\r\n");
-				
-				tileMapMemoryAllocation = false;
-				
-			}
+	if (tileLayerNum >= MAX_TILE_LAYERS) {
+		debug_log("vdu_sys_layers_tilemap_set_multiple: Invalid tileLayerNum %d specified.\r\n",tileLayerNum);
+		return;
+	}
 
-			// Check that memory allocation was successful. If not, then clean up. If successful, then set contents to 0.
+	auto &tileMap = tileMaps[tileLayerNum];
 
-			if (tileMapMemoryAllocation == false) {
+	if (tileMap.tiles == NULL) {
+		debug_log("vdu_sys_layers_tilemap_set_multiple: tileMap %d is not initialised.\r\n",tileLayerNum);
+		return;
+	}
 
-				// Tidy up by calling free...
+	auto bufferIter = buffers.find(bufferId);
+	if (bufferIter == buffers.end()) {
+		debug_log("vdu_sys_layers_tilemap_set_multiple: buffer %d not found.\r\n",bufferId);
+		return;
+	}
 
-				vdu_sys_layers_tilemap_free(tileLayerNum);
+	auto &buffer = bufferIter->second;
 
-			} else {
+	if (stride == 0) {
+		stride = width;
+	}
 
-				// Only continue if the init was successful...
-			
-				// Set every byte in the tile map to 0
+	for (auto row=0; row<height && yPos + row < tileMap.height; row++) {
 
-				for (auto i=0; i<tileMapWidth; i++) {
-					for (auto j=0; j<tileMapHeight; j++) {
-						tileMap0[i][j].id = 0;
-						tileMap0[i][j].attribute = 0 ;
-					}
-				}
+		uint8_t y = yPos + row;
+		AdvancedOffset offset = {};
+		offset.blockOffset = row * stride * sizeof(Tile);
 
+		for (auto column=0; column<width;) {
+			auto span = getBufferSpan(buffer, offset, sizeof(Tile));
+			if (span.size() < sizeof(Tile)) {
+				// Run out of buffer
+				return;
 			}
 
-		} break;
-	}
-
-	debug_log("In vdu_sys_layers_tilemap_init: After memory allocation\n\r");
-	debug_log_mem();
-}
+			int count = std::min<int>(span.size() / sizeof(Tile), width - column);
+			auto data = span.data();
 
-void VDUStreamProcessor::vdu_sys_layers_tilemap_set(uint8_t tileLayerNum, uint8_t xPos, uint8_t yPos, uint8_t tileId, uint8_t tileAttribute) {
-	
-	switch (tileLayerNum) {
-		case 0: {
-			if (tileMap0 != NULL) {
-				// Skip if passed x and y are greater than the size of the tilemap
-				if (xPos >= tileMap0Properties.width || yPos >= tileMap0Properties.height) return;
-
-				if (tileMap0 != NULL) {
-					tileMap0[xPos][yPos].id = tileId;
-					tileMap0[xPos][yPos].attribute = tileAttribute;
+			for (auto n=0; n<count; n++, column++, data += sizeof(Tile)) {
+				if (xPos + column < tileMap.width) {
+					uint8_t x = xPos + column;
+					tileMap.tiles[x][y].id = data[0];
+					tileMap.tiles[x][y].attribute = data[1];
+					markTileDirty(tileLayers[tileLayerNum], tileMap, x, y);
 				}
 			}
-		} break;
-
-		default: {
-			debug_log("vdu_sys_layers_tilemap_set: Invalid tileLayerNum %d specified.\r\n",tileLayerNum);
-			return;
+			offset.blockOffset += count * sizeof(Tile);
 		}
 	}
 }
 
 void VDUStreamProcessor::vdu_sys_layers_tilemap_free(uint8_t tileLayerNum) {
 
+	if (tileLayerNum >= MAX_TILE_LAYERS) {
+		debug_log("vdu_sys_layers_tilemap_free: Invalid tileLayerNum %d specified.\r\n",tileLayerNum);
+		return;
+	}
+
 	debug_log("In vdu_sys_layers_tilemap_free: Before memory free call.\r\n");
 	debug_log_mem();
 
-	switch (tileLayerNum) {
-		case 0: {
+	auto &tileMap = tileMaps[tileLayerNum];
 
-			uint8_t tileMapWidth = tileMap0Properties.width;
+	uint8_t tileMapWidth = tileMap.width;
 
-			if (tileMap0 != NULL) {
+	if (tileMap.tiles != NULL) {
 
-				debug_log("vdu_sys_layers_tilemap_free: Freeing tileMap0.\r\n");
+		debug_log("vdu_sys_layers_tilemap_free: Freeing tile map %d.\r\n",tileLayerNum);
 
-				for (auto i=0; i<tileMapWidth; i++) {
+		for (auto i=0; i<tileMapWidth; i++) {
 
-					// For each column in the tilemap, free the memory if allocated
-					if (tileMap0[i] != NULL) {
-						heap_caps_free(tileMap0[i]);
-					}
-				}
-				heap_caps_free(tileMap0);
-
-				tileMap0 = NULL;
-
-			} else {
-				debug_log("vdu_sys_layers_tilemap_free: Tile Map %d memory not allocated.\r\n", tileLayerNum);
+			// For each column in the tilemap, free the memory if allocated
+			if (tileMap.tiles[i] != NULL) {
+				heap_caps_free(tileMap.tiles[i]);
 			}
-		} break;
-
-		default: {
-			debug_log("vdu_sys_layers_tilemap_free: Invalid tileLayerNum %d specified.\r\n",tileLayerNum);
 		}
-	}	
+		heap_caps_free(tileMap.tiles);
+
+		tileMap.tiles = NULL;
+
+	} else {
+		debug_log("vdu_sys_layers_tilemap_free: Tile Map %d memory not allocated.\r\n", tileLayerNum);
+	}
 
 	debug_log("In vdu_sys_layers_tilemap_free: After memory free call.\r\n");
-	debug_log_mem();	
+	debug_log_mem();
 }
 
 void VDUStreamProcessor::vdu_sys_layers_tilelayer_init(uint8_t tileLayerNum, uint8_t tileLayerSize, uint8_t tileSize) {
-	
+
+	if (tileLayerNum >= MAX_TILE_LAYERS) {
+		debug_log("vdu_sys_layers_tilelayer_init: Invalid tileLayerNum %d specified.\r\n",tileLayerNum);
+		return;
+	}
+
 	debug_log("In vdu_sys_layers_tilelayer_init: Before memory allocation\n\r");
 	debug_log_mem();
 
@@ -634,334 +709,204 @@ void VDUStreamProcessor::vdu_sys_layers_tilelayer_init(uint8_t tileLayerNum, uin
 	switch (tileLayerSize) {
 
 		case 0: {		// 80x60 layer
-			
+
 			tileLayerHeight = 60;
 			tileLayerWidth = 80;
 
 		} break;
 
 		case 1: {		// 80x30 layer
-			
+
 			tileLayerHeight = 30;
 			tileLayerWidth = 80;
 
 		} break;
 
 		case 2: {		// 40x30 layer
-			
+
 			tileLayerHeight = 30;
 			tileLayerWidth = 40;
 
 		} break;
 
 		case 3: {		// 40x25 layer
-			
+
 			tileLayerHeight = 25;
 			tileLayerWidth = 40;
 
 		} break;
-		
+
 		default: {
 			debug_log("vdu_sys_layers_tilelayer_init: Invalid tileLayerSize %d specified.\r\n",tileLayerSize);
 			return;
 		}
 	}
 
-	switch (tileLayerNum) {
+	auto &tileLayer = tileLayers[tileLayerNum];
 
-		case 0: {		// Tile Layer 0
-			
-			tileLayer0.height = tileLayerHeight;
-			tileLayer0.width = tileLayerWidth;
-			tileLayer0.sourceXPos = 0;
-			tileLayer0.sourceYPos = 0;
-			tileLayer0.xOffset = 0;
-			tileLayer0.yOffset = 0;
-			tileLayer0.attribute = 0;
-
-			if (tileLayer0Buffer != NULL) {
-
-				// If already exists, then free and reallocate
-				vdu_sys_layers_tilelayer_free(tileLayerNum);
-			}
+	if (tileLayer.buffer != NULL) {
 
-			int tileLayer0BufferSize = ((tileLayerHeight + 1) * 8) * ((tileLayerWidth + 1) * 8);
-			// int tileLayer0BufferSize = ((tileLayerHeight) * 8) * ((tileLayerWidth) * 8);
+		// If already exists, then free and reallocate
+		vdu_sys_layers_tilelayer_free(tileLayerNum);
+	}
 
-			debug_log("In vdu_sys_layers_tilelayer_init: tileLayerHeight: %d tileLayerWidth: %d\r\n", tileLayerHeight, tileLayerWidth);
-			debug_log("In vdu_sys_layers_tilelayer_init: tileLayer0BufferSize: %dbytes (%dK)\r\n", tileLayer0BufferSize, tileLayer0BufferSize / 1024);
+	tileLayer.height = tileLayerHeight;
+	tileLayer.width = tileLayerWidth;
+	tileLayer.sourceXPos = 0;
+	tileLayer.sourceYPos = 0;
+	tileLayer.xOffset = 0;
+	tileLayer.yOffset = 0;
+	tileLayer.attribute = 0;
+	tileLayer.rendered = false;
 
-			tileLayer0Buffer = heap_caps_malloc(tileLayer0BufferSize,MALLOC_CAP_SPIRAM);
+	int tileLayerBufferSize = ((tileLayerHeight + 1) * 8) * ((tileLayerWidth + 1) * 8);
 
+	debug_log("In vdu_sys_layers_tilelayer_init: tileLayerHeight: %d tileLayerWidth: %d\r\n", tileLayerHeight, tileLayerWidth);
+	debug_log("In vdu_sys_layers_tilelayer_init: tileLayerBufferSize: %dbytes (%dK)\r\n", tileLayerBufferSize, tileLayerBufferSize / 1024);
 
-			// Log the allocated memory
+	tileLayer.buffer = heap_caps_malloc(tileLayerBufferSize,MALLOC_CAP_SPIRAM);
 
+	if (tileLayer.buffer != NULL) {
 
-			if (tileLayer0Buffer != nullptr) {
-				size_t actualSize = heap_caps_get_allocated_size(tileLayer0Buffer);
-				debug_log("Allocated size: %zu bytes\r\n", actualSize);
-			} else {
-				debug_log("Memory allocation failed\r\n");
-			}
+		// Cast the void pointer to an integer
+		tileLayer.ptr = (uint8_t *)tileLayer.buffer;
 
-			debug_log("In vdu_sys_layers_tilelayer_init: tileLayer0Buffer starting address: %d\r\n", &tileLayer0Buffer);
+		// Set every byte in the layer buffer to the background colour of the layer (default 0 = transparent)
+		memset(tileLayer.ptr, tileLayer.backgroundColour, tileLayerBufferSize);
 
-			if (tileLayer0Buffer != NULL) {
+		tileLayer.bitmap = Bitmap(tileLayerWidth * 8, tileLayerHeight * 8, tileLayer.buffer, PixelFormat::RGBA2222);
+		tileLayer.initialised = true;
+	}
+	else {
+		debug_log("vdu_sys_layers_tilelayer_init: Memory allocation failed\r\n");
+		// Something went wrong. Calll the free function to clear up the memory
+		vdu_sys_layers_tilelayer_free(tileLayerNum);
+	}
+
+	debug_log("In vdu_sys_layers_tilelayer_init: After memory allocation\n\r");
+	debug_log_mem();
+}
+
+void VDUStreamProcessor::vdu_sys_layers_tilelayer_set_property(uint8_t tileLayerNum, uint8_t property, uint8_t value) {
+
+	if (tileLayerNum >= MAX_TILE_LAYERS) {
+		debug_log("vdu_sys_layers_tilelayer_set_property: Invalid tileLayerNum %d specified.\r\n",tileLayerNum);
+		return;
+	}
 
-				// Cast the void pointer to an integer
-				tileLayer0Ptr = (uint8_t *)tileLayer0Buffer;
+	auto &tileLayer = tileLayers[tileLayerNum];
 
-				// Set every byte in the tile bank to the background colour of the layer (default 0 = transparent)
-				for (auto i=0; i <tileLayer0BufferSize; i++)
-					tileLayer0Ptr[i] = tileLayer0.backgroundColour; 
+	switch (property) {
 
-				tileLayer0Bitmap = Bitmap(tileLayerWidth * 8, tileLayerHeight * 8, tileLayer0Buffer, PixelFormat::RGBA2222);
+		case VDP_LAYER_PROPERTY_TILEBANK: {
+			if (value >= MAX_TILE_BANKS) {
+				debug_log("vdu_sys_layers_tilelayer_set_property: Invalid tileBankNum %d specified.\r\n",value);
+				return;
 			}
-			else {
-				// Something went wrong. Calll the free function to clear up the memory
-				vdu_sys_layers_tilelayer_free(tileLayerNum);
+			if (tileLayer.tileBank != value) {
+				tileLayer.tileBank = value;
+				tileLayer.rendered = false;
 			}
+		} break;
 
-			tileLayer0init = 1;		// Set as initialised
+		case VDP_LAYER_PROPERTY_PRIORITY: {
+			tileLayer.priority = value;
+		} break;
 
+		case VDP_LAYER_PROPERTY_VISIBLE: {
+			tileLayer.visible = value != 0;
 		} break;
 
 		default: {
-			debug_log("vdu_sys_layers_tilelayer_init: Invalid tileLayerNum %d specified.\r\n",tileLayerNum);
-			return;
+			debug_log("vdu_sys_layers_tilelayer_set_property: Invalid property %d specified.\r\n",property);
 		}
-
 	}
-
-	debug_log("In vdu_sys_layers_tilelayer_init: After memory allocation\n\r");
-	debug_log_mem();
 }
 
 void VDUStreamProcessor::vdu_sys_layers_tilelayer_set_scroll(uint8_t tileLayerNum, uint8_t xPos, uint8_t yPos, uint8_t xOffset, uint8_t yOffset) {
 
-	switch (tileLayerNum) {
-		
-		case 0: {
+	if (tileLayerNum >= MAX_TILE_LAYERS) {
+		debug_log("vdu_sys_layers_tilelayer_set_scroll: Invalid tileLayerNum %d specified.\r\n",tileLayerNum);
+		return;
+	}
 
-			if (tileLayer0init != 0) {		// Only continue if the tile layer is initialised
-				if (tileMap0 != NULL) {		// Only continue if the tile map is initialised
+	auto &tileLayer = tileLayers[tileLayerNum];
+	auto &tileMap = tileMaps[tileLayerNum];
 
-					uint8_t tileMapWidth = tileMap0Properties.width;
-					uint8_t tileMapHeight = tileMap0Properties.height;
+	if (!tileLayer.initialised) {		// Only continue if the tile layer is initialised
+		debug_log("vdu_sys_layers_tilelayer_set_scroll: tileLayer %d is not initialised.\r\n",tileLayerNum);
+		return;
+	}
+	if (tileMap.tiles == NULL) {		// Only continue if the tile map is initialised
+		debug_log("vdu_sys_layers_tilelayer_set_scroll: tileMap %d is not initialised.\r\n",tileLayerNum);
+		return;
+	}
 
-					if (xPos >= tileMapWidth) { xPos = 0; }
-					if (yPos >= tileMapHeight) { yPos = 0; }
+	if (xPos >= tileMap.width) { xPos = 0; }
+	if (yPos >= tileMap.height) { yPos = 0; }
 
-					if (xOffset > 7) { xOffset = 0; }
-					if (yOffset > 7) { yOffset = 0;	}
+	if (xOffset > 7) { xOffset = 0; }
+	if (yOffset > 7) { yOffset = 0;	}
 
-					tileLayer0.sourceXPos = xPos;
-					tileLayer0.sourceYPos = yPos;
-					tileLayer0.xOffset = xOffset;
-					tileLayer0.yOffset = yOffset;
-				} else {
-					debug_log("vdu_sys_layers_tilelayer_set_scroll: tileMap0 is not initialised.\r\n");
-					return;
-				}
-			} else {
-				debug_log("vdu_sys_layers_tilelayer_set_scroll: tileLayer is not initialised.\r\n");
-				return;
-			}
+	tileLayer.sourceXPos = xPos;
+	tileLayer.sourceYPos = yPos;
+	tileLayer.xOffset = xOffset;
+	tileLayer.yOffset = yOffset;
+}
 
-		} break;
+bool VDUStreamProcessor::vdu_sys_layers_tilelayer_update_layerbuffer(uint8_t tileLayerNum) {
 
-		default: {
-			debug_log("vdu_sys_layers_tilelayer_set_scroll: Invalid tileLayerNum %d specified.\r\n",tileLayerNum);
-			return;
-		}
+	if (tileLayerNum >= MAX_TILE_LAYERS) {
+		debug_log("vdu_sys_layers_tilelayer_renderlayer: Invalid tileLayerNum: %d\r\n",tileLayerNum);
+		return false;
 	}
-}
 
-void VDUStreamProcessor::vdu_sys_layers_tilelayer_update_layerbuffer(uint8_t tileLayerNum) {
+	auto &tileLayer = tileLayers[tileLayerNum];
+	auto &tileMap = tileMaps[tileLayerNum];
 
-	uint8_t xPos;
-	uint8_t yPos;
-	uint8_t tileId;
-	uint8_t tileAttribute;
-	uint8_t tileLayerHeight;
-	uint8_t tileLayerWidth;
-	uint8_t sourceXPos;
-	uint8_t sourceYPos;
-	uint8_t xOffset;
-	uint8_t yOffset;
-	uint8_t tileMapWidth;
-	uint8_t tileMapHeight;
+	if (!tileLayer.initialised) {
+		debug_log ("vdu_sys_layers_tilelayer_renderlayer: tileLayer %d is not initialised.\r\n",tileLayerNum);
+		return false;
+	}
+	if (tileMap.tiles == NULL) {
+		debug_log("vdu_sys_layers_tilelayer_renderlayer: tileMap %d is not initialised.\r\n",tileLayerNum);
+		return false;
+	}
 
-	switch (tileLayerNum) {
+	// Do not continue if the layer's tileBank is not initialised.
+	if (tileBanks[tileLayer.tileBank].ptr == NULL) {
+		debug_log("vdu_sys_layers_tilelayer_renderlayer: tileBank %d is not initialised.\r\n",tileLayer.tileBank);
+		return false;
+	}
 
-		case 0: {
+	updateLayerBuffer(tileLayer, tileMap, tileBanks[tileLayer.tileBank]);
+	return true;
+}
 
-			if (tileLayer0init != 0) {
-				if (tileMap0 != NULL) {
 
-					tileLayerHeight = tileLayer0.height;
-					tileLayerWidth = tileLayer0.width;
+void VDUStreamProcessor::vdu_sys_layers_tilelayer_draw_layerbuffer(uint8_t tileLayerNum) {
 
-					sourceXPos = tileLayer0.sourceXPos;
-					sourceYPos = tileLayer0.sourceYPos;
+	int xPix = 0;		// X position in pixels is now always 0 as the offset is written directly to the layer buffer
+	int yPix = 0;
 
-					xOffset = tileLayer0.xOffset;
-					yOffset = tileLayer0.yOffset;
+	if (tileLayerNum >= MAX_TILE_LAYERS) {
+		debug_log("vdu_sys_layers_tilelayer_renderlayer: Invalid tileLayerNum: %d\r\n",tileLayerNum);
+		return;
+	}
 
-					tileMapWidth = tileMap0Properties.width;
-					tileMapHeight = tileMap0Properties.height;
-				} else {
-					debug_log("vdu_sys_layers_tilelayer_renderlayer: tileMap0 is not initialised.\r\n");
-					return;
-				}
-			} else {
-				debug_log ("vdu_sys_layers_tilelayer_renderlayer: tileLayer0 is not initialised.\r\n");
-				return;
-			}
-		} break;
-
-		default: {
-			debug_log("vdu_sys_layers_tilelayer_renderlayer: Invalid tileLayerNum: %d\r\n",tileLayerNum);
-			return;
-		}
-	}
-
-	int layerBufferWidth = tileLayerWidth * 8;
-	int layerBufferHeight = tileLayerHeight * 8;
-	int layerDataBufferSize = layerBufferWidth * layerBufferHeight;
+	auto &tileLayer = tileLayers[tileLayerNum];
 
-	// Perform validation checks
-
-	if (sourceXPos >= tileMapWidth) { sourceXPos = 0; }
-	if (sourceYPos >= tileMapHeight) { sourceYPos = 0; }
-
-	// Do not continue if tileBank is not initialised.
-	if (tileBank0Data == NULL) { 
-		debug_log("vdu_sys_layers_tilelayer_renderlayer: tileBank0Data is not initialised.\r\n");
+	if (!tileLayer.initialised) {
+		debug_log ("vdu_sys_layers_tilelayer_renderlayer: tileLayer %d is not initialised.\r\n",tileLayerNum);
 		return;
 	}
-
-	// Clear Row Buffer - move this up...
-	
-		for (auto i=0; i<layerDataBufferSize; i++) {
-			tileLayer0Ptr[i] = 0;				// Setting to 0 is transparent. Future: Layer BG Colour setting.
-	}
-
-	// Process rows for each frame
-
-	for (auto y=0; y<=tileLayerHeight; y++) {
-
-		// Process tile map for current row
-
-		yPos = y;
-
-		for (auto x=0; x<=tileLayerWidth; x++) {
-																
-			// read the Tile Map
-			tileId = tileMap0[sourceXPos][sourceYPos].id;
-			tileAttribute = tileMap0[sourceXPos][sourceYPos].attribute;
-
-			xPos = x;	
-
-			if (tileId == 0) {		// Tile 0 is special...
-
-				// What you do here depends on the tile attribute in "special" mode:
-
-				switch (tileAttribute) {
-
-					case 0: {		// Tile is transparent and not drawn
-
-					} break;
-				}
-
-			} else {				// Tile is normal and should be processed accordingly
-
-				// Check attribute to get tile draw direction and call appropriate draw function
-
-				uint8_t tileFlip = tileAttribute & 0x03;
-
-				switch (tileFlip) {
-					case 0x00:		// Normal drawing
-						writeTileToLayerBuffer(tileId, xPos, xOffset, yPos, yOffset, tileLayer0Ptr, tileLayerHeight, tileLayerWidth);
-						break;
-					case 0x01:		// Flip X
-						writeTileToLayerBufferFlipX(tileId, xPos, xOffset, yPos, yOffset, tileLayer0Ptr, tileLayerHeight, tileLayerWidth);
-						break;
-					case 0x02:		// Flip Y
-						writeTileToLayerBufferFlipY(tileId, xPos, xOffset, yPos, yOffset, tileLayer0Ptr, tileLayerHeight, tileLayerWidth);
-						break;
-					case 0x03:		// Flip X and Y
-						writeTileToLayerBufferFlipXY(tileId, xPos, xOffset, yPos, yOffset, tileLayer0Ptr, tileLayerHeight, tileLayerWidth);
-						break;
-					default:
-						debug_log("Invalid tileAttribute value: %d\r\n",tileFlip);
-				}
-			}
-
-			// If we're at the edge of the tile map, reset to the beginning.
-			sourceXPos++;
-			if (sourceXPos == tileMapWidth) { 
-				sourceXPos = 0; 
-			}
-		}
-
-		// At the end of the row, reset sourceXPos back (else it will keep incrementing)
-		sourceXPos = tileLayer0.sourceXPos;
-	
-		sourceYPos++;
-		if (sourceYPos == tileMapHeight) {
-			sourceYPos = 0; 
-		}
-	}
-}
-
-
-void VDUStreamProcessor::vdu_sys_layers_tilelayer_draw_layerbuffer(uint8_t tileLayerNum) {
-
-	int xPix = 0;		// X position in pixels is now always 0 as the offset is written directly to the tileRowBuffer
-	int yPix = 0;
-
-	uint8_t tileLayerHeight;
-	uint8_t tileLayerWidth;
-
-	switch (tileLayerNum) {
-
-		case 0: {
-
-			if (tileLayer0init != 0) {
-				if (tileMap0 != NULL) {
-
-					tileLayerHeight = tileLayer0.height;
-					tileLayerWidth = tileLayer0.width;
-
-				} else {
-					debug_log("vdu_sys_layers_tilelayer_renderlayer: tileMap0 is not initialised.\r\n");
-					return;
-				}
-			} else {
-				debug_log ("vdu_sys_layers_tilelayer_renderlayer: tileLayer0 is not initialised.\r\n");
-				return;
-			}
-		} break;
-
-		default: {
-			debug_log("vdu_sys_layers_tilelayer_renderlayer: Invalid tileLayerNum: %d\r\n",tileLayerNum);
-			return;
-		}
-	}
-
-	int layerBufferWidth = tileLayerWidth * 8;
-	int layerBufferHeight = tileLayerHeight * 8;
-
-	// Do not continue if tileBank is not initialised.
-	if (tileBank0Data == NULL) { 
-		debug_log("vdu_sys_layers_tilelayer_renderlayer: tileBank0Data is not initialised.\r\n");
+	if (!tileLayer.rendered) {
+		debug_log ("vdu_sys_layers_tilelayer_renderlayer: tileLayer %d has not been rendered.\r\n",tileLayerNum);
 		return;
 	}
 
-	tileLayer0Bitmap = Bitmap(layerBufferWidth, layerBufferHeight, tileLayer0Ptr, PixelFormat::RGBA2222);
-
-	canvas->drawBitmap(xPix,yPix,&tileLayer0Bitmap);		
+	invalidateScreenChars();
+	canvas->drawBitmap(xPix,yPix,&tileLayer.bitmap);
 
 	// waitPlotCompletion();			// If enabled, then the code waits for VSYNC before continuing and is slower.
 
@@ -976,7 +921,7 @@ void VDUStreamProcessor::vdu_sys_layers_tilelayer_draw(uint8_t tileLayerNum) {
 
 	// startTime = xTaskGetTickCountFromISR();
 
-	vdu_sys_layers_tilelayer_update_layerbuffer(tileLayerNum);
+	if (!vdu_sys_layers_tilelayer_update_layerbuffer(tileLayerNum)) return;
 
 	// endTime = xTaskGetTickCountFromISR();
 	// elapsedTime = endTime - startTime;
@@ -994,1103 +939,148 @@ void VDUStreamProcessor::vdu_sys_layers_tilelayer_draw(uint8_t tileLayerNum) {
 
 }
 
-void VDUStreamProcessor::vdu_sys_layers_tilelayer_free(uint8_t tileLayerNum) {
-
-	debug_log("In vdu_sys_layers_tilelayer_free: Before memory free call\n\r");
-	debug_log_mem();
-
-	switch (tileLayerNum) {
-		case 0: {
-			if (tileLayer0Buffer != NULL) {
-				debug_log("vdu_sys_layers_tilelayer_free: Freeing tileLayer0Buffer.\r\n");
-				heap_caps_free(tileLayer0Buffer);
-				tileLayer0Buffer = NULL;
-			}
-		} break;
-		
-		default: {
-			debug_log("vdu_sys_layers_tilelayer_free: Invalid tileLayerNum %d specified.\r\n",tileLayerNum);
-		}
-	}
-
-	debug_log("In vdu_sys_layers_tilelayer_free: After memory free call\r\n");
-	debug_log_mem();
-}
-
-// Tile drawing functions
-
-void VDUStreamProcessor::writeTileToLayerBuffer(uint8_t tileId, uint8_t xPos, uint8_t xOffset, uint8_t yPos, uint8_t yOffset, uint8_t * tileBuffer, uint8_t tileLayerHeight, uint8_t tileLayerWidth) {
-
-/*
-		The drawing loop reads from the source in a direction depending on the flip parameters:
-		- For normal drawing, read from top row to bottom row, left to right.
-		- For flip X drawing, read from top row to bottom row, right to left.
-		- For flip Y drawing, read from bottom row to top row, left to right.
-		- For flip X+Y drawing, read from bottom row to top row, right to left.
-		
-		Writes to the layer buffer are in a linear fashion: top row to bottom row, left to right.
-
-		The drawing loops for rows and columns (as defined by variables x and y) are intended to be
-		the counters for reading the *source* data. While there may be some cases where this can also
-		apply to the destination data, a separate set of variables are used to ensure clarity.
-	*/
-
-	int sourceTile = (tileId * 64);																	// The starting position in the tile bank for a given tileId;
-	int sourcePixel = 0;
-	int tileLayerPixelWidth = tileLayerWidth * 8;													// The width of the tile layer in pixels
-	int destLineStart = (yPos * tileLayerPixelWidth * 8 ) - (tileLayerPixelWidth * yOffset);		// The line where drawing the tile should be drawn
-	int destLineStartXOffset = (xPos * 8) - xOffset;												// The number of pixels along the line where the tile should be drawn
-	int destLineStartYOffset = 0;																	// The line in the tile (0-7) where the tile should be drawn
-	int destPixel;
-	int destPixelCount;
-	int destPixelStart;
-
-	/* 
-	Set the start and end variables used in the source reading loop depending on whether it is the first, middle or last column:
-	- For the first column (0), then potentially only read the last "n" pixels in the tile row.
-	- For columns in the middle (1 through to tileLayerWidth -1), then read all eight pixels in the tile row.
-	- For the last column (tileLayerWidth), then potentially only read the first "n" pixels. 
-	*/
-
-	if (yPos > 0 && yPos < tileLayerHeight) {
-
-		if (xPos > 0 && xPos < tileLayerWidth) {		// Process the most common use-case (middle tiles) first
-
-			for (auto y=0; y<8; y++) {
-
-				destLineStartYOffset = tileLayerPixelWidth * y;
-				destPixelStart = destLineStart + destLineStartYOffset + destLineStartXOffset;
-				destPixelCount = 0;
-
-				for (auto x=0; x<8; x++) {
-					sourcePixel = sourceTile + (y * 8) + x;
-					destPixel = destPixelStart + destPixelCount;
-					tileBuffer[destPixel] = tileBank0Ptr[sourcePixel];
-					destPixelCount++;
-				}
-			}  			
-		} else if (xPos == 0) {							// Process the first column
-
-			destLineStartXOffset = 0;
-
-			for (auto y=0; y<8; y++) {
+void VDUStreamProcessor::vdu_sys_layers_tilelayer_draw_all(void) {
 
-				destLineStartYOffset = tileLayerPixelWidth * y;
-				destPixelStart = destLineStart + destLineStartYOffset + destLineStartXOffset;
-				destPixelCount = 0;
+	// Update every visible layer, then composite them in priority order into a single buffer,
+	// one scanline at a time, so the screen only needs one bitmap draw however many layers there are
 
-				for (auto x=xOffset; x<8; x++) {
-					sourcePixel = sourceTile + (y * 8) + x;
-					destPixel = destPixelStart + destPixelCount;
-					tileBuffer[destPixel] = tileBank0Ptr[sourcePixel];
-					destPixelCount++;
-				}
-			} 
-		} else if (xPos == tileLayerWidth) {			// Process the last column
-		
-			for (auto y=0; y<8; y++) {
-
-				destLineStartYOffset = tileLayerPixelWidth * y;
-				destPixelStart = destLineStart + destLineStartYOffset + destLineStartXOffset;
-				destPixelCount = 0;
-
-				for (auto x=0; x<xOffset; x++) {
-					sourcePixel = sourceTile + (y * 8) + x;
-					destPixel = destPixelStart + destPixelCount;
-					tileBuffer[destPixel] = tileBank0Ptr[sourcePixel];
-					destPixelCount++;
-				}
-			}
-		}
-
-	} else if (yPos == 0) {
-
-		// Do the top row
-
-		if (xPos > 0 && xPos < tileLayerWidth) {		// Process the most common use-case (middle tiles) first
-
-			for (auto y=yOffset; y<8; y++) {
-
-				destLineStartYOffset = tileLayerPixelWidth * y;
-				destPixelStart = destLineStart + destLineStartYOffset + destLineStartXOffset;
-				destPixelCount = 0;
-
-				for (auto x=0; x<8; x++) {
-					sourcePixel = sourceTile + (y * 8) + x;
-					destPixel = destPixelStart + destPixelCount;
-					tileBuffer[destPixel] = tileBank0Ptr[sourcePixel];
-					destPixelCount++;
-				}
-			}
-
-		} else if (xPos == 0) {							// Process the first column
-
-	 		destLineStartXOffset = 0;
-
- 			for (auto y=yOffset; y<8; y++) {
-
-				destLineStartYOffset = tileLayerPixelWidth * y;
-				destPixelStart = destLineStart + destLineStartYOffset + destLineStartXOffset;
-				destPixelCount = 0;
-
-				for (auto x=xOffset; x<8; x++) {
-					sourcePixel = sourceTile + (y * 8) + x;
-					destPixel = destPixelStart + destPixelCount;
-					tileBuffer[destPixel] = tileBank0Ptr[sourcePixel];
-					destPixelCount++;
-				}
-			}
-		} else if (xPos == tileLayerWidth) {			// Process the last column
-		
- 			for (auto y=yOffset; y<8; y++) {
+	uint8_t order[MAX_TILE_LAYERS];
+	int layerCount = 0;
+	int compositeWidth = 0;
+	int compositeHeight = 0;
 
-				destLineStartYOffset = tileLayerPixelWidth * y;
-				destPixelStart = destLineStart + destLineStartYOffset + destLineStartXOffset;
-				destPixelCount = 0;
-
-				for (auto x=0; x<xOffset; x++) {
-					sourcePixel = sourceTile + (y * 8) + x;
-					destPixel = destPixelStart + destPixelCount;
-					tileBuffer[destPixel] = tileBank0Ptr[sourcePixel];
-					destPixelCount++;
-				}
-			} 
+	for (auto n=0; n<MAX_TILE_LAYERS; n++) {
+		if (tileLayers[n].visible && tileLayers[n].initialised && vdu_sys_layers_tilelayer_update_layerbuffer(n)) {
+			order[layerCount++] = n;
+			compositeWidth = std::max(compositeWidth, tileLayers[n].width * 8);
+			compositeHeight = std::max(compositeHeight, tileLayers[n].height * 8);
 		}
-
-
-	} else if (yPos == tileLayerHeight) {
-
-		// Do the bottom row
-
-		if (xPos > 0 && xPos < tileLayerWidth) {		// Process the most common use-case (middle tiles) first
-
-		 	for (auto y=0; y<=yOffset; y++) {
-
-				destLineStartYOffset = tileLayerPixelWidth * y;
-				destPixelStart = destLineStart + destLineStartYOffset + destLineStartXOffset;
-				destPixelCount = 0;
-
-				for (auto x=0; x<8; x++) {
-					sourcePixel = sourceTile + (y * 8) + x;
-					destPixel = destPixelStart + destPixelCount;
-					tileBuffer[destPixel] = tileBank0Ptr[sourcePixel];
-					destPixelCount++;
-				}
-			}
-
-			// debug_log("Bottom Row Middle: destPixel address: %d\r\n", &tileBuffer[destPixel]);
-
-		} else if (xPos == 0) {							// Process the first column
-
-			destLineStartXOffset = 0;
-
-			for (auto y=0; y<=yOffset; y++) {
-
-				destLineStartYOffset = tileLayerPixelWidth * y;
-				destPixelStart = destLineStart + destLineStartYOffset + destLineStartXOffset;
-				destPixelCount = 0;
-
-				for (auto x=xOffset; x<8; x++) {
-					sourcePixel = sourceTile + (y * 8) + x;
-					destPixel = destPixelStart + destPixelCount;
-					tileBuffer[destPixel] = tileBank0Ptr[sourcePixel];
-					destPixelCount++;
-				}
-			}
-
-			// debug_log("Bottom Row Column 0: destPixel address: %d\r\n", &tileBuffer[destPixel]);
-
-		} else if (xPos == tileLayerWidth) {			// Process the last column
-	
-			for (auto y=0; y<=yOffset; y++) {
-
-				destLineStartYOffset = tileLayerPixelWidth * y;
-				destPixelStart = destLineStart + destLineStartYOffset + destLineStartXOffset;
-				destPixelCount = 0;
-
-				for (auto x=0; x<xOffset; x++) {
-					sourcePixel = sourceTile + (y * 8) + x;
-					destPixel = destPixelStart + destPixelCount;
-					tileBuffer[destPixel] = tileBank0Ptr[sourcePixel];
-					destPixelCount++;
-				}
-			}
-
-			// The output will be random if y and x never match and the loops never execute.
-			// debug_log("Bottom Row End: destPixel address: %d\r\n", &tileBuffer[destPixel]);
-		} 
 	}
-}
-
-void VDUStreamProcessor::writeTileToLayerBufferFlipX(uint8_t tileId, uint8_t xPos, uint8_t xOffset, uint8_t yPos, uint8_t yOffset, uint8_t * tileBuffer, uint8_t tileLayerHeight, uint8_t tileLayerWidth) {
-
-	int sourceTile = (tileId * 64);
-	int sourcePixel = 0;
-	int tileLayerPixelWidth = tileLayerWidth * 8;
-	int destLineStart = (yPos * tileLayerPixelWidth * 8 ) - (tileLayerPixelWidth * yOffset);
-	int destLineStartXOffset = (xPos * 8) - xOffset;
-	int destLineStartYOffset = 0;	
-	int destPixel;
-	int destPixelCount;
-	int destPixelStart;
-
-	if (yPos > 0 && yPos < tileLayerHeight) {
-
-		if (xPos > 0 && xPos < tileLayerWidth) {
-
-			for (auto y=0; y<8; y++) {
-
-				destLineStartYOffset = tileLayerPixelWidth * y;
-				destPixelStart = destLineStart + destLineStartYOffset + destLineStartXOffset;
-				destPixelCount = 0;
-
-				for (auto x=7; x>=0; x--) {
-					sourcePixel = sourceTile + (y * 8) + x;
-					destPixel = destPixelStart + destPixelCount;
-					tileBuffer[destPixel] = tileBank0Ptr[sourcePixel];
-					destPixelCount++;
-				}
-			}  
-		} else if (xPos == 0) {
-
-			destLineStartXOffset = 0;
-
-			for (auto y=0; y<8; y++) {
-
-				destLineStartYOffset = tileLayerPixelWidth * y;
-				destPixelStart = destLineStart + destLineStartYOffset + destLineStartXOffset;
-				destPixelCount = 0;
-
-				for (auto x=(7-xOffset); x>=0; x--) {
-					sourcePixel = sourceTile + (y * 8) + x;
-					destPixel = destPixelStart + destPixelCount;
-					tileBuffer[destPixel] = tileBank0Ptr[sourcePixel];
-					destPixelCount++;
-				}
-			} 
-		} else if (xPos == tileLayerWidth) {
-
-			for (auto y=0; y<8; y++) {
-
-				destLineStartYOffset = tileLayerPixelWidth * y;
-				destPixelStart = destLineStart + destLineStartYOffset + destLineStartXOffset;
-				destPixelCount = 0;
-
-				for (auto x=7; x>(7-xOffset); x--) {
-					sourcePixel = sourceTile + (y * 8) + x;
-					destPixel = destPixelStart + destPixelCount;
-					tileBuffer[destPixel] = tileBank0Ptr[sourcePixel];
-					destPixelCount++;
-				}
-			}
-		}
-	
-	}  else if (yPos == 0) {
-
-		// Do the top row
-
-		if (xPos > 0 && xPos < tileLayerWidth) {
-
-			for (auto y=yOffset; y<8; y++) {
-
-				destLineStartYOffset = tileLayerPixelWidth * y;
-				destPixelStart = destLineStart + destLineStartYOffset + destLineStartXOffset;
-				destPixelCount = 0;
-
-				for (auto x=7; x>=0; x--) {
-					sourcePixel = sourceTile + (y * 8) + x;
-					destPixel = destPixelStart + destPixelCount;
-					tileBuffer[destPixel] = tileBank0Ptr[sourcePixel];
-					destPixelCount++;
-				}
-			}
-			
-		} else if (xPos == 0) {
-
- 			destLineStartXOffset = 0;
-
-			for (auto y=xOffset; y<8; y++) {
-
-				destLineStartYOffset = tileLayerPixelWidth * y;
-				destPixelStart = destLineStart + destLineStartYOffset + destLineStartXOffset;
-				destPixelCount = 0;
-
-				for (auto x=(7-xOffset); x>=0; x--) {
-					sourcePixel = sourceTile + (y * 8) + x;
-					destPixel = destPixelStart + destPixelCount;
-					tileBuffer[destPixel] = tileBank0Ptr[sourcePixel];
-					destPixelCount++;
-				}
-			}
-
-		} else if (xPos == tileLayerWidth) {
-
- 			for (auto y=xOffset; y<8; y++) {
-
-				destLineStartYOffset = tileLayerPixelWidth * y;
-				destPixelStart = destLineStart + destLineStartYOffset + destLineStartXOffset;
-				destPixelCount = 0;
-
-				for (auto x=7; x>(7-xOffset); x--) {
-					sourcePixel = sourceTile + (y * 8) + x;
-					destPixel = destPixelStart + destPixelCount;
-					tileBuffer[destPixel] = tileBank0Ptr[sourcePixel];
-					destPixelCount++;
-				}
-			}
-		}
-
-	} else if (yPos == tileLayerHeight) {
-
-		// Do the bottom row
-		
-		if (xPos > 0 && xPos < tileLayerWidth) {
-
-			for (auto y=0; y<=yOffset; y++) {
-
-				destLineStartYOffset = tileLayerPixelWidth * y;
-				destPixelStart = destLineStart + destLineStartYOffset + destLineStartXOffset;
-				destPixelCount = 0;
-
-				for (auto x=7; x>=0; x--) {
-					sourcePixel = sourceTile + (y * 8) + x;
-					destPixel = destPixelStart + destPixelCount;
-					tileBuffer[destPixel] = tileBank0Ptr[sourcePixel];
-					destPixelCount++;
-				}
-			}  
-		} else if (xPos == 0) {
-
-			destLineStartXOffset = 0;
-
-			for (auto y=0; y<=yOffset; y++) {
-
-				destLineStartYOffset = tileLayerPixelWidth * y;
-				destPixelStart = destLineStart + destLineStartYOffset + destLineStartXOffset;
-				destPixelCount = 0;
-
-				for (auto x=(7-xOffset); x>=0; x--) {
-					sourcePixel = sourceTile + (y * 8) + x;
-					destPixel = destPixelStart + destPixelCount;
-					tileBuffer[destPixel] = tileBank0Ptr[sourcePixel];
-					destPixelCount++;
-				}
-			}
-		} else if (xPos == tileLayerWidth) {
-
-			for (auto y=0; y<=yOffset; y++) {
-
-				destLineStartYOffset = tileLayerPixelWidth * y;
-				destPixelStart = destLineStart + destLineStartYOffset + destLineStartXOffset;
-				destPixelCount = 0;
-
-				for (auto x=7; x>(7-xOffset); x--) {
-					sourcePixel = sourceTile + (y * 8) + x;
-					destPixel = destPixelStart + destPixelCount;
-					tileBuffer[destPixel] = tileBank0Ptr[sourcePixel];
-					destPixelCount++;
-				}
-			}
-		} 
-	}	
-}
-
-void VDUStreamProcessor::writeTileToLayerBufferFlipY(uint8_t tileId, uint8_t xPos, uint8_t xOffset, uint8_t yPos, uint8_t yOffset, uint8_t * tileBuffer, uint8_t tileLayerHeight, uint8_t tileLayerWidth) {
- 
-	int sourceTile = (tileId * 64);
-	int sourcePixel = 0;
-	int tileLayerPixelWidth = tileLayerWidth * 8;
-	int destLineStart = (yPos * tileLayerPixelWidth * 8 ) - (tileLayerPixelWidth * yOffset);
-	int destLineStartXOffset = (xPos * 8) - xOffset;
-	int destLineStartYOffset = 0;								// Start writing from the top line
-	int destPixel;
-	int destPixelCount;
-	int destPixelStart;
-	
-	if (yPos > 0 && yPos < tileLayerHeight) {
-
-		if (xPos > 0 && xPos < tileLayerWidth) {
-
-			for (auto y=7; y>=0; y--) {
-
-				destPixelStart = destLineStart + destLineStartYOffset + destLineStartXOffset;
-				destPixelCount = 0;
-
-				for (auto x=0; x<8; x++) {
-					sourcePixel = sourceTile + (y * 8) + x;
-					destPixel = destPixelStart + destPixelCount;
-					tileBuffer[destPixel]=tileBank0Ptr[sourcePixel];
-					destPixelCount++;
-				}
-
-				destLineStartYOffset = destLineStartYOffset + tileLayerPixelWidth;
-			}	
-
-		} else if (xPos == 0) {
-
-			destLineStartXOffset = 0;							// Need to override destStartLineXOffset to start at column 0 with no xOffset
-					
-			for (auto y=7; y>=0; y--) {
-
-				destPixelStart = destLineStart + destLineStartYOffset + destLineStartXOffset;
-				destPixelCount = 0;														// Need to track destination pixel counter as x starts with an offset
-
-				for (auto x=xOffset; x<8; x++) {
-					sourcePixel = sourceTile + (y * 8) + x;
-					destPixel = destPixelStart + destPixelCount;
-					tileBuffer[destPixel]=tileBank0Ptr[sourcePixel];
-					destPixelCount++;
-				}
-
-				destLineStartYOffset = destLineStartYOffset + tileLayerPixelWidth;		// Update destLineStartYOffset to the next line.
-			}
-
-		} else if (xPos == tileLayerWidth) {
-
-			for (auto y=7; y>=0; y--) {
-
-				destPixelStart = destLineStart + destLineStartYOffset + destLineStartXOffset;
-				destPixelCount = 0;	
-
-				for (auto x=0; x<xOffset; x++) {
-					sourcePixel = sourceTile + (y * 8) + destPixelCount;
-					destPixel = destPixelStart + x;
-					tileBuffer[destPixel]=tileBank0Ptr[sourcePixel];
-					destPixelCount++;
-				}
-
-				destLineStartYOffset = destLineStartYOffset + tileLayerPixelWidth;
-			}
-		}	
-
-	} else if (yPos == 0) {
-
-	 	// Do the top row
-
-		destLineStart = 0;		// We are only reading a smaller number of lines, so start from 0, not a negative start y position.
-
-		if (xPos > 0 && xPos < tileLayerWidth) {
-
-			for (auto y=(7-yOffset); y>=0; y--) {
-
-				destPixelStart = destLineStart + destLineStartYOffset + destLineStartXOffset;
-				destPixelCount = 0;
-
-				for (auto x=0; x<8; x++) {
-					sourcePixel = sourceTile + (y * 8) + x;
-					destPixel = destPixelStart + destPixelCount;
-					tileBuffer[destPixel]=tileBank0Ptr[sourcePixel];
-					destPixelCount++;
-				}
 
-				destLineStartYOffset = destLineStartYOffset + tileLayerPixelWidth;
-			}	 
-
-		} else if (xPos == 0) {
-
- 			destLineStartXOffset = 0;							// Need to override destStartLineXOffset to start at column 0 with no xOffset
-					
-			for (auto y=(7-yOffset); y>=0; y--) {
-
-				destPixelStart = destLineStart + destLineStartYOffset + destLineStartXOffset;
-				destPixelCount = 0;														// Need to track destination pixel counter as x starts with an offset
-
-				for (auto x=xOffset; x<8; x++) {
-					sourcePixel = sourceTile + (y * 8) + x;
-					destPixel = destPixelStart + destPixelCount;
-					tileBuffer[destPixel]=tileBank0Ptr[sourcePixel];
-					destPixelCount++;
-				}
-
-				destLineStartYOffset = destLineStartYOffset + tileLayerPixelWidth;		// Update destLineStartYOffset to the next line.
-			}
-
-		} else if (xPos == tileLayerWidth) {
-
- 			for (auto y=(7-yOffset); y>=0; y--) {
-
-				destPixelStart = destLineStart + destLineStartYOffset + destLineStartXOffset;
-				destPixelCount = 0;	
-
-				for (auto x=0; x<xOffset; x++) {
-					sourcePixel = sourceTile + (y * 8) + destPixelCount;
-					destPixel = destPixelStart + x;
-					tileBuffer[destPixel]=tileBank0Ptr[sourcePixel];
-					destPixelCount++;
-				}
-
-				destLineStartYOffset = destLineStartYOffset + tileLayerPixelWidth;
-			}  
-		}
-				
-	} else if (yPos == tileLayerHeight) {
-
-		// Do the bottom row
-
-		if (xPos > 0 && xPos < tileLayerWidth) {
-
-			for (auto y=7; y>=(7-yOffset); y--) {
-
-				destPixelStart = destLineStart + destLineStartYOffset + destLineStartXOffset;
-				destPixelCount = 0;
-
-				for (auto x=0; x<8; x++) {
-					sourcePixel = sourceTile + (y * 8) + x;
-					destPixel = destPixelStart + destPixelCount;
-					tileBuffer[destPixel]=tileBank0Ptr[sourcePixel];
-					destPixelCount++;
-				}
-
-				destLineStartYOffset = destLineStartYOffset + tileLayerPixelWidth;
-			}	
-
-		} else if (xPos == 0) {
-
-			destLineStartXOffset = 0;							// Need to override destStartLineXOffset to start at column 0 with no xOffset
-					
-			for (auto y=7; y>=(7-yOffset); y--) {
-
-				destPixelStart = destLineStart + destLineStartYOffset + destLineStartXOffset;
-				destPixelCount = 0;														// Need to track destination pixel counter as x starts with an offset
-
-				for (auto x=xOffset; x<8; x++) {
-					sourcePixel = sourceTile + (y * 8) + x;
-					destPixel = destPixelStart + destPixelCount;
-					tileBuffer[destPixel]=tileBank0Ptr[sourcePixel];
-					destPixelCount++;
-				}
-
-				destLineStartYOffset = destLineStartYOffset + tileLayerPixelWidth;		// Update destLineStartYOffset to the next line.
-			}
-
-		} else if (xPos == tileLayerWidth) {
-
-			for (auto y=7; y>=(7-yOffset); y--) {
-
-				destPixelStart = destLineStart + destLineStartYOffset + destLineStartXOffset;
-				destPixelCount = 0;	
-
-				for (auto x=0; x<xOffset; x++) {
-					sourcePixel = sourceTile + (y * 8) + destPixelCount;
-					destPixel = destPixelStart + x;
-					tileBuffer[destPixel]=tileBank0Ptr[sourcePixel];
-					destPixelCount++;
-				}
-
-				destLineStartYOffset = destLineStartYOffset + tileLayerPixelWidth;
-			}
-		} 	
+	if (layerCount == 0) {
+		debug_log("vdu_sys_layers_tilelayer_draw_all: No tile layers to draw.\r\n");
+		return;
 	}
-}
-
-void VDUStreamProcessor::writeTileToLayerBufferFlipXY(uint8_t tileId, uint8_t xPos, uint8_t xOffset, uint8_t yPos, uint8_t yOffset, uint8_t * tileBuffer, uint8_t tileLayerHeight, uint8_t tileLayerWidth) {
- 
-	int sourceTile = (tileId * 64);	
-	int sourcePixel = 0;
-	int tileLayerPixelWidth = tileLayerWidth * 8;
-	int destLineStart = (yPos * tileLayerPixelWidth * 8 ) - (tileLayerPixelWidth * yOffset);
-	int destLineStartXOffset = (xPos * 8) - xOffset;
-	int destLineStartYOffset = 0;
-	int destPixel;
-	int destPixelCount = 0;
-	int destPixelStart;
-
-	if (yPos > 0 && yPos < tileLayerHeight) {
-
-		if (xPos > 0 && xPos < tileLayerWidth) {
-
-			for (auto y=7; y>=0; y--) {
-
-				destPixelStart = destLineStart + destLineStartYOffset + destLineStartXOffset;
-				destPixelCount = 0;
-
-				for (auto x=7; x>=0; x--) {
-					sourcePixel = sourceTile + (y * 8) + x;
-					destPixel = destPixelStart + destPixelCount;
-					tileBuffer[destPixel] = tileBank0Ptr[sourcePixel];
-					destPixelCount++;
-				}
-
-				destLineStartYOffset = destLineStartYOffset + tileLayerPixelWidth;
-			}  
-
-		} else if (xPos == 0) {
-
-			destLineStartXOffset = 0;
-
-			for (auto y=7; y>=0; y--) {
-
-				destPixelStart = destLineStart + destLineStartYOffset + destLineStartXOffset;
-				destPixelCount = 0;
-
-				for (auto x=(7-xOffset); x>=0; x--) {
-					sourcePixel = sourceTile + (y * 8) + x;
-					destPixel = destPixelStart + destPixelCount;
-					tileBuffer[destPixel] = tileBank0Ptr[sourcePixel];
-					destPixelCount++;
-				}
-
-				destLineStartYOffset = destLineStartYOffset + tileLayerPixelWidth;
-			} 
-
-		} else if (xPos == tileLayerWidth) {
-
-			for (auto y=7; y>=0; y--) {
 
-				destPixelStart = destLineStart + destLineStartYOffset + destLineStartXOffset;
-				destPixelCount = 0;
+	// Lowest priority first, with ties going to the lower layer number
+	std::stable_sort(order, order + layerCount, [this](uint8_t a, uint8_t b) {
+		return tileLayers[a].priority < tileLayers[b].priority;
+	});
 
-				for (auto x=7; x>(7-xOffset); x--) {
-					sourcePixel = sourceTile + (y * 8) + x;
-					destPixel = destPixelStart + destPixelCount;
-					tileBuffer[destPixel] = tileBank0Ptr[sourcePixel];
-					destPixelCount++;
-				}
-
-				destLineStartYOffset = destLineStartYOffset + tileLayerPixelWidth;
-			}
+	if (compositeWidth != tileCompositeWidth || compositeHeight != tileCompositeHeight) {
+		if (tileCompositeBuffer != NULL) {
+			heap_caps_free(tileCompositeBuffer);
 		}
-
-	} else if (yPos == 0) {
-
-		// Do the top row
-
-		destLineStart = 0;
-
-		if (xPos > 0 && xPos < tileLayerWidth) {
-
- 			for (auto y=(7-yOffset); y>=0; y--) {
-
-				destPixelStart = destLineStart + destLineStartYOffset + destLineStartXOffset;
-				destPixelCount = 0;
-
-				for (auto x=7; x>=0; x--) {
-					sourcePixel = sourceTile + (y * 8) + x;
-					destPixel = destPixelStart + destPixelCount;
-					tileBuffer[destPixel] = tileBank0Ptr[sourcePixel];
-					destPixelCount++;
-				}
-
-				destLineStartYOffset = destLineStartYOffset + tileLayerPixelWidth;
-			} 
-
-		} else if (xPos == 0) {
-
-		 	destLineStartXOffset = 0;
-
-			for (auto y=(7-yOffset); y>=0; y--) {
-
-				destPixelStart = destLineStart + destLineStartYOffset + destLineStartXOffset;
-				destPixelCount = 0;
-
-				for (auto x=(7-xOffset); x>=0; x--) {
-					sourcePixel = sourceTile + (y * 8) + x;
-					destPixel = destPixelStart + destPixelCount;
-					tileBuffer[destPixel] = tileBank0Ptr[sourcePixel];
-					destPixelCount++;
-				}
-
-				destLineStartYOffset = destLineStartYOffset + tileLayerPixelWidth;
-			}
-
-		} else if (xPos == tileLayerWidth) {
-
-			for (auto y=(7-yOffset); y>=0; y--) {
-
-				destPixelStart = destLineStart + destLineStartYOffset + destLineStartXOffset;
-				destPixelCount = 0;
-
-				for (auto x=7; x>(7-xOffset); x--) {
-					sourcePixel = sourceTile + (y * 8) + x;
-					destPixel = destPixelStart + destPixelCount;
-					tileBuffer[destPixel] = tileBank0Ptr[sourcePixel];
-					destPixelCount++;
-				}
-
-				destLineStartYOffset = destLineStartYOffset + tileLayerPixelWidth;
-			}
-		}
-
-	} else if (yPos == tileLayerHeight) {
-
-		// Do the bottom row
-
-		if (xPos > 0 && xPos < tileLayerWidth) {
-
-			for (auto y=7; y>=(7-yOffset); y--) {
-
-				destPixelStart = destLineStart + destLineStartYOffset + destLineStartXOffset;
-				destPixelCount = 0;
-
-				for (auto x=7; x>=0; x--) {
-					sourcePixel = sourceTile + (y * 8) + x;
-					destPixel = destPixelStart + destPixelCount;
-					tileBuffer[destPixel] = tileBank0Ptr[sourcePixel];
-					destPixelCount++;
-				}
-
-				destLineStartYOffset = destLineStartYOffset + tileLayerPixelWidth;
-			}  
-
-		} else if (xPos == 0) {
-
-			destLineStartXOffset = 0;
-
-			for (auto y=7; y>=(7-yOffset); y--) {
-
-				destPixelStart = destLineStart + destLineStartYOffset + destLineStartXOffset;
-				destPixelCount = 0;
-
-				for (auto x=(7-xOffset); x>=0; x--) {
-					sourcePixel = sourceTile + (y * 8) + x;
-					destPixel = destPixelStart + destPixelCount;
-					tileBuffer[destPixel] = tileBank0Ptr[sourcePixel];
-					destPixelCount++;
-				}
-
-				destLineStartYOffset = destLineStartYOffset + tileLayerPixelWidth;
-			} 
-
-		} else if (xPos == tileLayerWidth) {
-
-			for (auto y=7; y>=(7-yOffset); y--) {
-
-				destPixelStart = destLineStart + destLineStartYOffset + destLineStartXOffset;
-				destPixelCount = 0;
-
-				for (auto x=7; x>(7-xOffset); x--) {
-					sourcePixel = sourceTile + (y * 8) + x;
-					destPixel = destPixelStart + destPixelCount;
-					tileBuffer[destPixel] = tileBank0Ptr[sourcePixel];
-					destPixelCount++;
-				}
-
-				destLineStartYOffset = destLineStartYOffset + tileLayerPixelWidth;
-			} 
+		tileCompositeBuffer = heap_caps_malloc(compositeWidth * compositeHeight,MALLOC_CAP_SPIRAM);
+		if (tileCompositeBuffer == NULL) {
+			debug_log("vdu_sys_layers_tilelayer_draw_all: Failed to allocate composite buffer.\r\n");
+			tileCompositeWidth = 0;
+			tileCompositeHeight = 0;
+			return;
 		}
-
+		tileCompositeWidth = compositeWidth;
+		tileCompositeHeight = compositeHeight;
+		tileCompositeBitmap = Bitmap(compositeWidth, compositeHeight, tileCompositeBuffer, PixelFormat::RGBA2222);
 	}
-}
-
-
-
-void VDUStreamProcessor::writeTileToBuffer(uint8_t tileId, uint8_t tileCount, uint8_t xOffset, uint8_t tileBuffer[], uint8_t tileLayerWidth) {
-
-	int destStartPos;
-	int destRowStart;
-	int destPixel;
-	int bufferWidth = tileLayerWidth * 8;
-
-	// Read 64 bytes from the data bank and write to the tile buffer
-
-	int sourcePixel = tileId * 64;
-
-	// Handle the first column on screen which may only be partially drawn depending on the xOffset value
-	// This is also called by vdu_sys_layers_tilebank_draw() when drawing a single tile.
 
-	if (tileCount == 0) {
+	auto compositePtr = (uint8_t *)tileCompositeBuffer;
 
-		destStartPos = 0;
+	for (auto y=0; y<compositeHeight; y++) {
 
-		sourcePixel = sourcePixel + xOffset;				// Need to start reading the source data at the xOffset
+		uint8_t * dest = compositePtr + (y * compositeWidth);
+		bool covered = false;
 
-		for (auto y=0; y<8; y++) {
+		for (auto i=0; i<layerCount; i++) {
+			auto &tileLayer = tileLayers[order[i]];
+			int layerWidth = tileLayer.width * 8;
 
-			destRowStart = destStartPos + (bufferWidth * y);
+			if (y >= tileLayer.height * 8) continue;
 
-			for (auto x=xOffset; x<8; x++) {				// Start counting at xOffset through to end of the tile line
+			const uint8_t * source = tileLayer.ptr + (y * layerWidth);
 
-				destPixel = destRowStart + x - xOffset;
-
-				tileBuffer[destPixel] = tileBank0Ptr[sourcePixel];
-
-				sourcePixel++;
+			if (!covered) {
+				// The bottom layer on this scanline can be copied as-is
+				memcpy(dest, source, layerWidth);
+				if (layerWidth < compositeWidth) {
+					memset(dest + layerWidth, 0, compositeWidth - layerWidth);
+				}
+				covered = true;
+			} else {
+				mergeLayerRow(dest, source, layerWidth);
 			}
-
-			sourcePixel = sourcePixel + xOffset;
 		}
-	}
-
-	// General drawing code for all columns except the first and last columns
-
-	if (tileCount > 0 && tileCount < tileLayerWidth) {
 
-		destStartPos = (tileCount * 8) - xOffset;
-
-		for (auto y=0; y<8; y++) {
-
-			destRowStart = destStartPos + (bufferWidth * y);
-
-			for (auto x=0; x<8; x++) {
-
-				destPixel = destRowStart + x;
-
-				tileBuffer[destPixel] = tileBank0Ptr[sourcePixel];
-
-				sourcePixel++;
-			}
+		if (!covered) {
+			memset(dest, 0, compositeWidth);
 		}
 	}
 
-	// Handle the final column on screen which may only be partially drawn depending on the xOffset value
-
-	if (tileCount == tileLayerWidth) {
-
-		destStartPos = (tileCount * 8) - xOffset;
-
-		for (auto y=0; y<8; y++) {
-
-			destRowStart = destStartPos + (bufferWidth * y);
-
-			for (auto x=0; x<xOffset; x++) {				// Start counting at the start of the tile through to the xOffset
-
-				destPixel = destRowStart + x;
-
-				tileBuffer[destPixel] = tileBank0Ptr[sourcePixel];
-
-				sourcePixel++;
-			}
-
-			sourcePixel = sourcePixel + (8 - xOffset);		// As we are not drawing all pixels in the tile, skip ahead to the next line
-		}
-	}
+	invalidateScreenChars();
+	canvas->drawBitmap(0,0,&tileCompositeBitmap);
 }
 
-void VDUStreamProcessor::writeTileToBufferFlipX(uint8_t tileId, uint8_t tileCount, uint8_t xOffset, uint8_t tileBuffer[], uint8_t tileLayerWidth) {
-
-	int destStartPos;
-	int destRowStart;
-	int destPixel;
-	int bufferWidth = tileLayerWidth * 8;
-
-	int sourceTile = tileId * 64;		// The start of the specified tile Id
-	int sourcePixel = 0;
-
-	// Handle the first column on screen which may only be partially drawn depending on the xOffset value.
-	// This is also called by vdu_sys_layers_tilebank_draw() when drawing a single tile.
-
-	if (tileCount == 0) {
-
-		destStartPos = 0;
-
-		for (auto y=0; y<8; y++) {
-
-			destRowStart = destStartPos + (bufferWidth * y);
-
-			destPixel = destRowStart;
-
-			for (auto x=(7-xOffset); x>=0; x--) {		
-				sourcePixel = sourceTile + (y * 8) + x;
-				tileBuffer[destPixel]=tileBank0Ptr[sourcePixel];
-				destPixel++;
-			}
+void VDUStreamProcessor::vdu_sys_layers_tilelayer_free(uint8_t tileLayerNum) {
 
-			destPixel = destPixel + xOffset;
-		}
+	if (tileLayerNum >= MAX_TILE_LAYERS) {
+		debug_log("vdu_sys_layers_tilelayer_free: Invalid tileLayerNum %d specified.\r\n",tileLayerNum);
+		return;
 	}
 
-	// General drawing code for all columns except the first and last columns
-
-	if (tileCount > 0 && tileCount < tileLayerWidth) {
-
-		destStartPos = (tileCount * 8) - xOffset;
-
-		for (auto y=0; y<8; y++) {
-
-			destRowStart = destStartPos + (bufferWidth * y);
+	debug_log("In vdu_sys_layers_tilelayer_free: Before memory free call\n\r");
+	debug_log_mem();
 
-			destPixel = destRowStart;
+	auto &tileLayer = tileLayers[tileLayerNum];
 
-			for (auto x=7; x>=0; x--) {		
-				sourcePixel = sourceTile + (y * 8) + x;
-				tileBuffer[destPixel]=tileBank0Ptr[sourcePixel];
-				destPixel++;
-			}
-		}
+	if (tileLayer.buffer != NULL) {
+		debug_log("vdu_sys_layers_tilelayer_free: Freeing tileLayer %d buffer.\r\n",tileLayerNum);
+		heap_caps_free(tileLayer.buffer);
+		tileLayer.buffer = NULL;
 	}
+	tileLayer.initialised = false;
+	tileLayer.rendered = false;
 
-	// Handle the final column on screen which may only be partially drawn depending on the xOffset value
-
-	if (tileCount == tileLayerWidth) {
-
-		destStartPos = (tileCount * 8) - xOffset;
-
-		for (auto y=0; y<8; y++) {
-
-			destRowStart = destStartPos + (bufferWidth * y);
-
-			destPixel = destRowStart;
-
-			for (auto x=7; x>(7-xOffset); x--) {		
-				sourcePixel = sourceTile + (y * 8) + x;
-				tileBuffer[destPixel]=tileBank0Ptr[sourcePixel];
-				destPixel++;
-			}
-
-			destPixel = destPixel + xOffset;
-		}	
-	}		
+	debug_log("In vdu_sys_layers_tilelayer_free: After memory free call\r\n");
+	debug_log_mem();
 }
 
-void VDUStreamProcessor::writeTileToBufferFlipY(uint8_t tileId, uint8_t tileCount, uint8_t xOffset, uint8_t tileBuffer[], uint8_t tileLayerWidth) {
-
-	int destStartPos;		// Position in buffer the current tile needs to be written
-	int destRowStart;
-	int destPixel;
-	int bufferWidth = tileLayerWidth * 8;
-	
-	int sourceTile = tileId * 64;		// The start of the specified tile Id
-	int sourcePixel = 0;
-	int destRowCount = 0;
-
-	// Handle the first column on screen which may only be partially drawn depending on the xOffset value.
-	// This is also called by vdu_sys_layers_tilebank_draw() when drawing a single tile.
-
-	if (tileCount == 0) {
-
-		destStartPos = 0;
-
-		for (auto y=7; y>=0; y--) {
-
-			destRowStart = destStartPos + (bufferWidth * destRowCount);
+// Tile drawing functions
 
-			destPixel = destRowStart;
+void VDUStreamProcessor::invalidateTileBankLayers(uint8_t tileBankNum) {
 
-			for (auto x=xOffset; x<8; x++) {
-				sourcePixel = sourceTile + (y * 8) + x;
-				tileBuffer[destPixel]=tileBank0Ptr[sourcePixel];
-				destPixel++;
-			}
+	// Force a full redraw of every layer that draws its tiles from the given bank
 
-			destRowCount++;
-			destPixel = destPixel + xOffset;
+	for (auto &tileLayer : tileLayers) {
+		if (tileLayer.tileBank == tileBankNum) {
+			tileLayer.rendered = false;
 		}
 	}
-
-	// General drawing code for all columns except the first and last columns
-
-	if (tileCount > 0 && tileCount < tileLayerWidth) {
-
-		destStartPos = (tileCount * 8) - xOffset;
-
-		for (auto y=7; y>=0; y--) {
-
-			destRowStart = destStartPos + (bufferWidth * destRowCount);
-
-			destPixel = destRowStart;
-
-			for (auto x=0; x<8; x++) {
-				sourcePixel = sourceTile + (y * 8) + x;
-				tileBuffer[destPixel]=tileBank0Ptr[sourcePixel];
-				destPixel++;
-			}
-
-			destRowCount++;
-		}	
-	}
-
-	// Handle the final column on screen which may only be partially drawn depending on the xOffset value
-
-	if (tileCount == tileLayerWidth) {
-
-		destStartPos = (tileCount * 8) - xOffset;
-
-		for (auto y=7; y>=0; y--) {
-
-			destRowStart = destStartPos + (bufferWidth * destRowCount);
-
-			destPixel = destRowStart;
-
-			for (auto x=0; x<xOffset; x++) {
-				sourcePixel = sourceTile + (y * 8) + x;
-				tileBuffer[destPixel]=tileBank0Ptr[sourcePixel];
-				destPixel++;
-			}
-
-			destRowCount++;
-			destPixel = destPixel + xOffset;
-		}	
-	}
 }
 
-void VDUStreamProcessor::writeTileToBufferFlipXY(uint8_t tileId, uint8_t tileCount, uint8_t xOffset, uint8_t tileBuffer[], uint8_t tileLayerWidth) {
-
-	int destStartPos; 		// Position in buffer the current tile needs to be written
-	int destRowStart;
-	int destPixel;
-	int bufferWidth = tileLayerWidth * 8;
-	
-	int sourceTile = tileId * 64;		// The start of the specified tile Id
-	int sourcePixel = 0;
-	int destRowCount = 0;
-
-	// Handle the first column on screen which may only be partially drawn depending on the xOffset value.
-	// This is also called by vdu_sys_layers_tilebank_draw() when drawing a single tile.
-
-	if (tileCount == 0) {
-
-		destStartPos = 0;
-
-		for (auto y=7; y>=0; y--) {
-
-			destRowStart = destStartPos + (bufferWidth * destRowCount);
-
-			destPixel = destRowStart;
-
-			for (auto x=(7-xOffset); x>=0; x--) {
-				sourcePixel = sourceTile + (y * 8) + x;
-				tileBuffer[destPixel]=tileBank0Ptr[sourcePixel];
-				destPixel++;
-			}
-
-			destRowCount++;
-			destPixel = destPixel + xOffset;
-		}	
-	}
-
-	// General drawing code for all columns except the first and last columns
-
-	if (tileCount > 0 && tileCount < tileLayerWidth) {
-
-		destStartPos = (tileCount * 8) - xOffset;
-
-		for (auto y=7; y>=0; y--) {
+bool VDUStreamProcessor::detachTileBank(TileBank &tileBank) {
 
-			destRowStart = destStartPos + (bufferWidth * destRowCount);
+	// A bank using a buffer's storage takes its own copy before its tiles are changed,
+	// so that the buffer is left alone
 
-			destPixel = destRowStart;
+	if (!tileBank.source) return true;
 
-			for (auto x=7; x>=0; x--) {
-				sourcePixel = sourceTile + (y * 8) + x;
-				tileBuffer[destPixel]=tileBank0Ptr[sourcePixel];
-				destPixel++;
-			}
-
-			destRowCount++;
-		}	
+	tileBank.data = heap_caps_malloc(TILEBANK_SIZE,MALLOC_CAP_SPIRAM);
+	if (tileBank.data == NULL) {
+		debug_log("detachTileBank: Failed to allocate tile bank.\r\n");
+		return false;
 	}
+	memcpy(tileBank.data, tileBank.ptr, TILEBANK_SIZE);
+	tileBank.ptr = (uint8_t *)tileBank.data;
+	tileBank.source.reset();
+	return true;
+}
 
-	// Handle the final column on screen which may only be partially drawn depending on the xOffset value
-
-	if (tileCount == tileLayerWidth) {
-
-		destStartPos = (tileCount * 8) - xOffset;
-
-		for (auto y=7; y>=0; y--) {
-
-			destRowStart = destStartPos + (bufferWidth * destRowCount);
-
-			destPixel = destRowStart;
+void VDUStreamProcessor::writeTileToBuffer(TileBank &tileBank, uint8_t tileId, uint8_t tileAttribute, uint8_t * tileBuffer) {
 
-			for (auto x=7; x>(7-xOffset); x--) {
-				sourcePixel = sourceTile + (y * 8) + x;
-				tileBuffer[destPixel]=tileBank0Ptr[sourcePixel];
-				destPixel++;
-			}
+	// Write a single 8x8 tile to a tile sized buffer, flipped according to the tile attribute.
+	// This is called by vdu_sys_layers_tilebank_draw() when drawing a single tile.
 
-			destRowCount++;
-			destPixel = destPixel + xOffset;
-		}
+	for (auto y=0; y<8; y++) {
+		copyTileRow(tileBuffer + (y * 8), getTileRow(tileBank, tileId, tileAttribute, y));
 	}
 }
 
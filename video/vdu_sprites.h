@@ -225,6 +225,12 @@ void VDUStreamProcessor::vdu_sys_sprites() {
 			}
 		}	break;
 
+		case 0x50: {	// Batch update sprites from buffer of records, then refresh
+			auto bufferId = readWord_t(); if (bufferId == -1) return;
+			updateSpritesFromBuffer(bufferId);
+			debug_log("vdu_sys_sprites: sprites updated from buffer %d\n\r", bufferId);
+		}	break;
+
 		default: {
 			debug_log("vdu_sys_sprites: unknown command %d\n\r", cmd);
 		}	break;
@@ -264,6 +270,33 @@ void VDUStreamProcessor::createBitmapFromScreen(uint16_t bufferId) {
 	canvas->copyToBitmap(rect.X1, rect.Y1, getBitmap(bufferId).get());
 }
 
+// Apply a buffer of sprite update records in one pass, with a single refresh at the end
+// NB records must not span over buffer block boundaries
+//
+void VDUStreamProcessor::updateSpritesFromBuffer(uint16_t bufferId) {
+	auto bufferIter = buffers.find(bufferId);
+	if (bufferIter == buffers.end()) {
+		debug_log("updateSpritesFromBuffer: buffer %d not found\n\r", bufferId);
+		return;
+	}
+	auto &buffer = bufferIter->second;
+	AdvancedOffset offset = {};
+	SpriteUpdate update;
+	while (true) {
+		auto span = getBufferSpan(buffer, offset, sizeof(SpriteUpdate));
+		if (span.size() < sizeof(SpriteUpdate)) {
+			break;
+		}
+		auto count = span.size() / sizeof(SpriteUpdate);
+		for (auto data = span.data(); count > 0; count--, data += sizeof(SpriteUpdate)) {
+			memcpy(&update, data, sizeof(SpriteUpdate));
+			updateSprite(update);
+		}
+		offset.blockOffset += span.size();
+	}
+	refreshSprites();
+}
+
 void VDUStreamProcessor::createEmptyBitmap(uint16_t bufferId, uint16_t width, uint16_t height, uint32_t color) {
 	bufferClear(bufferId);
 
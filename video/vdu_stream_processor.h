@@ -12,7 +12,10 @@
 #include "buffers.h"
 #include "context.h"
 #include "buffer_stream.h"
+#include "compression.h"
+#include "multi_buffer_stream.h"
 #include "span.h"
+#include "tile_layers.h"
 #include "types.h"
 
 using ContextVector = std::vector<std::shared_ptr<Context>, psram_allocator<std::shared_ptr<Context>>>;
@@ -39,6 +42,32 @@ class VDUStreamProcessor {
 
 		std::vector<uint8_t> echoBuffer;
 
+		// Re-usable streams for buffer calls, indexed by call nesting depth
+		std::vector<std::shared_ptr<MultiBufferStream>> callStreamPool;
+		uint16_t callDepth = 0;
+
+		// Input ring, drained in bulk from the top-level (serial) input stream
+		// Head and tail are free-running counters, masked on access
+		uint8_t inputRing[INPUT_RING_SIZE];
+		uint32_t inputRingHead = 0;
+		uint32_t inputRingTail = 0;
+
+		inline bool inputRingActive() const {
+			// ring is only used when we're not executing from a buffer
+			return id == 65535;
+		}
+		inline uint32_t inputRingCount() const {
+			return inputRingTail - inputRingHead;
+		}
+		inline uint8_t inputRingTake() {
+			auto read = inputRing[inputRingHead++ & INPUT_RING_MASK];
+			pushEcho(read);
+			return read;
+		}
+		uint32_t fillInputRing();
+		bool waitForInputRing(uint16_t timeout);
+		uint32_t readFromInputRing(uint8_t * buffer, uint32_t length);
+
 		int16_t readByte_t(uint16_t timeout);
 		int32_t readWord_t(uint16_t timeout);
 		int32_t read24_t(uint16_t timeout);
@@ -111,6 +140,7 @@ class VDUStreamProcessor {
 		void vdu_sys_sprites();
 		void receiveBitmap(uint16_t bufferId, uint16_t width, uint16_t height);
 		void createBitmapFromScreen(uint16_t bufferId);
+		void updateSpritesFromBuffer(uint16_t bufferId);
 		void createEmptyBitmap(uint16_t bufferId, uint16_t width, uint16_t height, uint32_t color);
 		void createBitmapFromBuffer(uint16_t bufferId, uint8_t format, uint16_t width, uint16_t height);
 
@@ -120,6 +150,13 @@ class VDUStreamProcessor {
 		void vdu_sys_buffered();
 		uint32_t bufferWrite(uint16_t bufferId, uint32_t size);
 		void bufferCall(uint16_t bufferId, AdvancedOffset offset);
+		std::shared_ptr<MultiBufferStream> getCallStream(const BufferVector &streams);
+		bool canUseCommandCache();
+		void processCachedBuffer(uint16_t bufferId, AdvancedOffset offset, const BufferVector &streams, MultiBufferStream * stream);
+		void recordCommandCache(uint16_t bufferId, AdvancedOffset offset, const BufferVector &streams, MultiBufferStream * stream);
+		void replayCommandCache(uint16_t bufferId, std::shared_ptr<CommandCache> cache, MultiBufferStream * stream);
+		bool decodeCachedCommand(CachedCommand &command);
+		void executeCachedCommand(const CachedCommand &command, int16_t next);
 		void bufferRemoveUsers(uint16_t bufferId);
 		void bufferClear(uint16_t bufferId);
 		std::shared_ptr<WritableBufferStream> bufferCreate(uint16_t bufferId, uint32_t size);
@@ -144,8 +181,10 @@ class VDUStreamProcessor {
 		void bufferTransformBitmap(uint16_t bufferId, uint8_t options, uint16_t transformBufferId, uint16_t sourceBufferId);
 		void bufferTransformData(uint16_t bufferId, uint8_t options, uint8_t format, uint16_t transformBufferId, uint16_t sourceBufferId);
 		void bufferReadFlag(uint16_t bufferId);
-		void bufferCompress(uint16_t bufferId, uint16_t sourceBufferId);
+		void bufferCompress(uint16_t bufferId, uint16_t sourceBufferId, uint8_t format = COMPRESSION_TYPE_TURBO);
+		void bufferCompressLZ(uint16_t bufferId, const BufferVector &sourceBuffer);
 		void bufferDecompress(uint16_t bufferId, uint16_t sourceBufferId);
+		void bufferDecompressLZ(uint16_t bufferId, const BufferVector &sourceBuffer, uint32_t orig_size);
 		void bufferExpandBitmap(uint16_t bufferId, uint8_t options, uint16_t sourceBufferId);
 		void bufferAddCallback(uint16_t bufferId, uint16_t type);
 		void bufferRemoveCallback(uint16_t bufferId, uint16_t type);
@@ -160,78 +199,47 @@ class VDUStreamProcessor {
 		void vdu_sys_layers();
 		void vdu_sys_layers_tilebank_init(uint8_t tileBankNum, uint8_t tileBankBitDepth);
 		void vdu_sys_layers_tilebank_load(uint8_t tileBankNum, uint8_t tileId);
+		void vdu_sys_layers_tilebank_load_buffer(uint8_t tileBankNum, uint8_t tileId, uint16_t bufferId);
 		void vdu_sys_layers_tilebank_draw(uint8_t tileBankNum, uint8_t tileId, uint8_t palette, uint8_t x, uint8_t y, uint8_t xOffset, uint8_t yOffset, uint8_t tileAttribute);
 		void vdu_sys_layers_tilebank_free(uint8_t tileBankNum);
 		void vdu_sys_layers_tilemap_init(uint8_t tileLayerNum, uint8_t tileMapSize);
 		void vdu_sys_layers_tilemap_set(uint8_t tileLayerNum, uint8_t x, uint8_t y, uint8_t tileId, uint8_t tileAttribute);
+		void vdu_sys_layers_tilemap_set_multiple(uint8_t tileLayerNum, uint8_t x, uint8_t y, uint8_t width, uint8_t height, uint16_t bufferId, uint16_t stride);
 		void vdu_sys_layers_tilemap_free(uint8_t tileMapNum);
 		void vdu_sys_layers_tilelayer_init(uint8_t tileLayerNum, uint8_t tileLayerSize, uint8_t tileSize);
+		void vdu_sys_layers_tilelayer_set_property(uint8_t tileLayerNum, uint8_t property, uint8_t value);
 		void vdu_sys_layers_tilelayer_set_scroll(uint8_t tileLayerNum, uint8_t x, uint8_t y, uint8_t xOffset, uint8_t yOffset);
-		void vdu_sys_layers_tilelayer_update_layerbuffer(uint8_t tileLayerNum);
+		bool vdu_sys_layers_tilelayer_update_layerbuffer(uint8_t tileLayerNum);
 		void vdu_sys_layers_tilelayer_draw_layerbuffer(uint8_t tileLayerNum);
 		void vdu_sys_layers_tilelayer_draw(uint8_t tileLayerNum);
+		void vdu_sys_layers_tilelayer_draw_all();
 		void vdu_sys_layers_tilelayer_free(uint8_t tileLayerNum);
-		void writeTileToBuffer(uint8_t tileId, uint8_t tileCount, uint8_t xOffset, uint8_t tileBuffer[], uint8_t tileLayerWidth);
-		void writeTileToBufferFlipX(uint8_t tileId, uint8_t tileCount, uint8_t xOffset, uint8_t tileBuffer[], uint8_t tileLayerWidth);
-		void writeTileToBufferFlipY(uint8_t tileId, uint8_t tileCount, uint8_t xOffset, uint8_t tileBuffer[], uint8_t tileLayerWidth);
-		void writeTileToBufferFlipXY(uint8_t tileId, uint8_t tileCount, uint8_t xOffset, uint8_t tileBuffer[], uint8_t tileLayerWidth);
-
-		void writeTileToLayerBuffer(uint8_t tileId, uint8_t xPos, uint8_t xOffset, uint8_t yPos, uint8_t yOffset, uint8_t * tileBuffer,  uint8_t tileLayerHeight, uint8_t tileLayerWidth);
-		void writeTileToLayerBufferFlipX(uint8_t tileId, uint8_t xPos, uint8_t xOffset, uint8_t yPos, uint8_t yOffset, uint8_t * tileBuffer, uint8_t tileLayerHeight, uint8_t tileLayerWidth);
-		void writeTileToLayerBufferFlipY(uint8_t tileId, uint8_t xPos, uint8_t xOffset, uint8_t yPos, uint8_t yOffset, uint8_t * tileBuffer, uint8_t tileLayerHeight, uint8_t tileLayerWidth);
-		void writeTileToLayerBufferFlipXY(uint8_t tileId, uint8_t xPos, uint8_t xOffset, uint8_t yPos, uint8_t yOffset, uint8_t * tileBuffer, uint8_t tileLayerHeight, uint8_t tileLayerWidth);
 
 		// Tile Bank variables
 
-		void * tileBank0Data = NULL;
-		uint8_t * tileBank0Ptr;
+		TileBank tileBanks[MAX_TILE_BANKS];
 
 		Bitmap currentTile; 
-		uint8_t currentTileDataBuffer[64];
+		alignas(4) uint8_t currentTileDataBuffer[64];
 
 		// Tile Map variables
 
-		struct Tile {
-			uint8_t	id;
-			uint8_t attribute;
-		};
-
-		struct Tile** tileMap0 = NULL;
-
-		struct TileMap {
-			uint8_t height;
-			uint8_t width;
-		};
-
-		TileMap tileMap0Properties;
+		TileMap tileMaps[MAX_TILE_LAYERS];			// Each tile layer has its own tile map
 
 		// Tile Layer variables
 
-		Bitmap currentRow;
-		uint8_t currentRowDataBuffer[5184];		// Buffer big enough for 64 byte tiles * 81 columns (the largest supported size +1)
-
-		Bitmap tileLayer0Bitmap;					// Bitmap that points to the Layer 0 buffer
+		TileLayer tileLayers[MAX_TILE_LAYERS];
 
-		void * tileLayer0Buffer = NULL;				// The offscreen buffer for Layer 0
+		void * tileCompositeBuffer = NULL;			// All visible layers composited together, in priority order
+		int tileCompositeWidth = 0;
+		int tileCompositeHeight = 0;
+		Bitmap tileCompositeBitmap;
 
-		uint8_t * tileLayer0Ptr;					// A pointer to he tileLayer0Buffer
-
-		struct TileLayer {
-			uint8_t height;
-			uint8_t width;
-			uint8_t sourceXPos;
-			uint8_t sourceYPos;
-			uint8_t xOffset;
-			uint8_t yOffset;
-			uint8_t attribute;
-			uint8_t backgroundColour = 0;			// Default the background colour of the layer to 0 (transparent)
-		};
+		// Tile drawing functions
 
-		TileLayer tileLayer0;
-		TileLayer tileLayer1;
-		TileLayer tileLayer2;
-
-		uint8_t tileLayer0init = 0;		
+		void invalidateTileBankLayers(uint8_t tileBankNum);
+		bool detachTileBank(TileBank &tileBank);
+		void writeTileToBuffer(TileBank &tileBank, uint8_t tileId, uint8_t tileAttribute, uint8_t * tileBuffer);
 
 		// End: Tile Engine
 
@@ -256,9 +264,15 @@ class VDUStreamProcessor {
 			}
 
 		inline bool byteAvailable() {
+			if (inputRingActive() && inputRingCount() > 0) {
+				return true;
+			}
 			return inputStream->available() > 0;
 		}
 		inline uint8_t readByte() {
+			if (inputRingActive() && inputRingCount() > 0) {
+				return inputRingTake();
+			}
 			auto read = inputStream->read();
 			pushEcho(read);
 			return read;
@@ -318,11 +332,81 @@ class VDUStreamProcessor {
 		void bufferCallCallbacks(uint16_t type);
 };
 
+// Top up the input ring with whatever the input stream currently has available
+// using a single bulk read, so we avoid a virtual read call per byte
+// Returns the number of bytes held in the ring
+//
+uint32_t VDUStreamProcessor::fillInputRing() {
+	auto count = inputRingCount();
+	if (count == 0) {
+		// ring is empty, so rewind it to give us the largest contiguous space
+		inputRingHead = 0;
+		inputRingTail = 0;
+	}
+	auto available = inputStream->available();
+	if (available <= 0) {
+		return count;
+	}
+	// only read into the contiguous free space at the tail of the ring
+	auto tailIndex = inputRingTail & INPUT_RING_MASK;
+	uint32_t space = std::min<uint32_t>(INPUT_RING_SIZE - count, INPUT_RING_SIZE - tailIndex);
+	uint32_t toRead = std::min<uint32_t>(space, available);
+	if (toRead > 0) {
+		inputRingTail += inputStream->readBytes(&inputRing[tailIndex], toRead);
+	}
+	return inputRingCount();
+}
+
+// Ensure the input ring holds at least one byte
+// Will only wait (up to timeout ms) for more data if the ring is empty
+// Returns false if timed out
+//
+bool VDUStreamProcessor::waitForInputRing(uint16_t timeout) {
+	if (inputRingCount() > 0 || fillInputRing() > 0) {
+		return true;
+	}
+
+	auto start = xTaskGetTickCountFromISR();
+	const auto timeCheck = pdMS_TO_TICKS(timeout);
+
+	do {
+		if (fillInputRing() > 0) {
+			return true;
+		}
+	} while (xTaskGetTickCountFromISR() - start < timeCheck);
+	return false;
+}
+
+// Copy up to length bytes out of the input ring into a buffer
+// Returns number of bytes copied
+//
+uint32_t VDUStreamProcessor::readFromInputRing(uint8_t * buffer, uint32_t length) {
+	uint32_t copied = 0;
+	while (copied < length && inputRingCount() > 0) {
+		// copy the contiguous run from the head of the ring
+		auto headIndex = inputRingHead & INPUT_RING_MASK;
+		uint32_t run = std::min<uint32_t>(inputRingCount(), INPUT_RING_SIZE - headIndex);
+		run = std::min<uint32_t>(run, length - copied);
+		memcpy(buffer + copied, &inputRing[headIndex], run);
+		pushEcho(buffer + copied, run);
+		inputRingHead += run;
+		copied += run;
+	}
+	return copied;
+}
+
 // Read an unsigned byte from the serial port, with a timeout
 // Returns:
 // - Byte value (0 to 255) if value read, otherwise -1
 //
 int16_t inline VDUStreamProcessor::readByte_t(uint16_t timeout = COMMS_TIMEOUT) {
+	if (inputRingActive()) {
+		if (!waitForInputRing(timeout)) {
+			return -1;
+		}
+		return inputRingTake();
+	}
+
 	auto read = inputStream->read();
 	if (read != -1) {
 		pushEcho(read);
@@ -344,6 +428,11 @@ int16_t inline VDUStreamProcessor::readByte_t(uint16_t timeout = COMMS_TIMEOUT)
 // - Word value (0 to 65535) if 2 bytes read, otherwise -1
 //
 int32_t VDUStreamProcessor::readWord_t(uint16_t timeout = COMMS_TIMEOUT) {
+	if (inputRingActive() && inputRingCount() >= 2) {
+		auto l = inputRingTake();
+		auto h = inputRingTake();
+		return (h << 8) | l;
+	}
 	auto l = readByte_t(timeout);
 	if (l != -1) {
 		auto h = readByte_t(timeout);
@@ -359,6 +448,12 @@ int32_t VDUStreamProcessor::readWord_t(uint16_t timeout = COMMS_TIMEOUT) {
 // - Value (0 to 16777215) if 3 bytes read, otherwise -1
 //
 int32_t VDUStreamProcessor::read24_t(uint16_t timeout = COMMS_TIMEOUT) {
+	if (inputRingActive() && inputRingCount() >= 3) {
+		auto l = inputRingTake();
+		auto m = inputRingTake();
+		auto h = inputRingTake();
+		return (h << 16) | (m << 8) | l;
+	}
 	auto l = readByte_t(timeout);
 	if (l != -1) {
 		auto m = readByte_t(timeout);
@@ -375,7 +470,7 @@ int32_t VDUStreamProcessor::read24_t(uint16_t timeout = COMMS_TIMEOUT) {
 // Read an unsigned byte from the serial port (blocking)
 //
 uint8_t VDUStreamProcessor::readByte_b() {
-	while (inputStream->available() == 0);
+	while (!byteAvailable());
 	return readByte();
 }
 
@@ -391,6 +486,13 @@ uint32_t VDUStreamProcessor::readIntoBuffer(uint8_t * buffer, uint32_t length, u
 		return remaining;
 	}
 
+	if (inputRingActive()) {
+		// serve what we already hold from the ring, then read the rest directly
+		auto read = readFromInputRing(buffer, remaining);
+		buffer += read;
+		remaining -= read;
+	}
+
 	while (remaining > 0) {
 		auto read = inputStream->readBytes(buffer, remaining);
 		if (read == 0) {
@@ -434,6 +536,13 @@ uint32_t VDUStreamProcessor::discardBytes(uint32_t length, uint16_t timeout = CO
 // returns -1 if timed out, or the byte value (0 to 255)
 //
 int16_t VDUStreamProcessor::peekByte_t(uint16_t timeout = COMMS_TIMEOUT) {
+	if (inputRingActive()) {
+		if (!waitForInputRing(timeout)) {
+			return -1;
+		}
+		return inputRing[inputRingHead & INPUT_RING_MASK];
+	}
+
 	auto start = xTaskGetTickCountFromISR();
 	const auto timeCheck = pdMS_TO_TICKS(timeout);
 